@@ -1,43 +1,295 @@
 #!/bin/bash
+#
+# Application benchmarks: dpthread (det) vs plain pthreads (posix)
+#
+# Every workload is built both ways: the SPLASH-2 codes with the
+# c.m4.null.det and c.m4.null.POSIX macros, the OpenMP kernels with
+# libdetgomp and libgomp, pfscan by make lnx and lnx-posix, sqlite
+# threadtest1 with DPTHREAD=1 and 0, aget with USE_DPTHREAD=y and n
+# against a local httpd. Each build runs REPEAT times at every thread
+# count, timed by date(1); one more det run per point collects
+# DPTHREAD_STATS.
+#
+# ex) ./bench.sh                          # all, 1 2 4 .. NPROC threads
+#     ./bench.sh -t "1 2 4 8" -r 5 fft lu radix
+#     ./bench.sh -l                       # list the workloads
+#
+# log.bench             progress. the output of the runs is in log.bench.out
+# log.bench.runs.csv    workload,impl,threads,rep,secs,status of every run
+# log.bench.csv, .json  per workload, impl and thread count: runs, mean,
+#                       min, max, stddev and cv of the time, speedup over
+#                       the fewest threads of the same impl, det/posix
+#                       overhead, and the sync ops, turn retries and turn
+#                       wait (usec) of the stats run
+# log.microbench.*      test/dpbench (micro)
+#
+
+ROOT=`cd $(dirname $0); pwd`
+SPLASH=$ROOT/papps/splash2/codes
+NPROC=`grep CPU $ROOT/src/config.h 2>/dev/null | awk '{ print $3 }'`
+[ -z "$NPROC" ] && NPROC=`getconf _NPROCESSORS_ONLN`
+
+THREADS=""
+REPEAT=3
+OUT=log.bench
+STATS=1
+BUILD=1
+HTTP_PORT=18080
+
+# LD_BIND_NOW keeps lazy binding of ld.so out of the counts
+export LD_BIND_NOW=on
+
+SPLASH_ALL="fft lu lu-nc radix cholesky barnes fmm ocean ocean-nc radiosity raytrace volrend water-nsq water-sp"
+ALL="micro $SPLASH_ALL omp-lu omp-ocean omp-radix omp-water pfscan sqlite aget"
+
+usage()
+{
+    echo "usage: $0 [-t \"threads...\"] [-r repeat] [-o prefix] [-S] [-B] [workload...]"
+    echo "  -t  thread counts (default: 1 2 4 .. $NPROC)"
+    echo "  -r  runs per point (default: $REPEAT)"
+    echo "  -o  output prefix (default: $OUT)"
+    echo "  -S  no DPTHREAD_STATS run"
+    echo "  -B  use the binaries of the last build"
+    echo "  -l  list the workloads"
+    exit 1
+}
 
 fail()
 {
-	echo "FAILED: $*"
-	exit  # real problem 
-}
-
-echo "Benchmark" > log.bench
-for NPROC in 4; do 
-
-DIRS[0]="papps/splash2/codes/kernels/fft"
-EXES[0]="./FFT -m22 -p$NPROC"
-DIRS[1]="papps/splash2/codes/kernels/lu/contiguous_blocks"
-EXES[1]="./LU -n1280 -p$NPROC"
-DIRS[2]="papps/splash2/codes/kernels/radix"
-EXES[2]="./RADIX -n5000000 -p$NPROC"
-DIRS[3]="papps/splash2/codes/apps/barnes"
-EXES[3]="./BARNES < input.p$NPROC"
-DIRS[4]="papps/splash2/codes/apps/radiosity"
-EXES[4]="./RADIOSITY -room -batch -p $NPROC" 
-DIRS[5]="papps/splash2/codes/apps/raytrace"
-EXES[5]="./RAYTRACE -m128 -p$NPROC inputs/car.env"
-DIRS[6]="papps/splash2/codes/apps/ocean/contiguous_partitions"
-EXES[6]="./OCEAN -n514 -p$NPROC" 
-DIRS[7]="papps/splash2/codes/apps/water-nsquared"
-EXES[7]="./WATER-NSQUARED < input.p$NPROC"
-
-echo 
-echo "---------------------"
-echo "$NPROC CORES" 
-echo "---------------------"
-for i in 0 1 2 4 5 6 7; do 
-    echo "$i ${DIRS[i]} ${EXES[i]}"
-    echo "Clean"
-    (cd "${DIRS[i]}"; make clean ) >& /dev/null 
-    echo "Compile"
-    (cd "${DIRS[i]}"; make ) >& log.build
-    echo "Run"
-    (cd "${DIRS[i]}"; time nice sh -c "${EXES[i]}") 2>> log.bench || fail "${DIRS[i]}"
-    grep real log.bench | awk '{ print $2 }' | sed "s/0m//g" | sed "s/s//"
-done # i 
-done # NPROC
+    echo "FAILED: $*" | tee -a $OUT >&2
+}
+
+# workload <name>: sets KIND, DIR, BIN, ARGS, PREP and PREBUILD. ARGS and
+# PREP are evaluated in DIR with the thread count in $P.
+workload()
+{
+    PREP=""
+    PREBUILD=""
+    case $1 in
+    fft)       KIND=splash DIR=kernels/fft BIN=FFT ARGS='-m20 -p$P' ;;
+    lu)        KIND=splash DIR=kernels/lu/contiguous_blocks BIN=LU ARGS='-n1024 -p$P' ;;
+    lu-nc)     KIND=splash DIR=kernels/lu/non_contiguous_blocks BIN=LU ARGS='-n1024 -p$P' ;;
+    radix)     KIND=splash DIR=kernels/radix BIN=RADIX ARGS='-n4000000 -p$P' ;;
+    cholesky)  KIND=splash DIR=kernels/cholesky BIN=CHOLESKY ARGS='-p$P inputs/tk15.O'
+	       PREP='[ -f inputs/tk15.O ] || zcat inputs/tk15.O.Z > inputs/tk15.O' ;;
+    barnes)    KIND=splash DIR=apps/barnes BIN=BARNES ARGS='< input.bench'
+	       PREP='sed "12s/.*/$P/" input > input.bench' ;;
+    fmm)       KIND=splash DIR=apps/fmm BIN=FMM ARGS='< input.bench'
+	       PREP='sed "5s/.*/$P/" inputs/input.16384 > input.bench' ;;
+    ocean)     KIND=splash DIR=apps/ocean/contiguous_partitions BIN=OCEAN ARGS='-n514 -p$P' ;;
+    ocean-nc)  KIND=splash DIR=apps/ocean/non_contiguous_partitions BIN=OCEAN ARGS='-n258 -p$P' ;;
+    radiosity) KIND=splash DIR=apps/radiosity BIN=RADIOSITY ARGS='-room -batch -p $P' ;;
+    raytrace)  KIND=splash DIR=apps/raytrace BIN=RAYTRACE ARGS='-m128 -p$P inputs/car.env' ;;
+    volrend)   KIND=splash DIR=apps/volrend BIN=VOLREND ARGS='$P inputs/head'
+	       PREBUILD='[ -f libtiff/libtiff.a ] || (cd libtiff; make)'
+	       PREP='[ -f inputs/head.den ] || zcat inputs/head.den.Z > inputs/head.den' ;;
+    water-nsq) KIND=splash DIR=apps/water-nsquared BIN=WATER-NSQUARED ARGS='< input.bench'
+	       PREP='sed "3s/^ *[0-9]*/$P/" input > input.bench' ;;
+    water-sp)  KIND=splash DIR=apps/water-spatial BIN=WATER-SPATIAL ARGS='< input.bench'
+	       PREP='sed "3s/^ *[0-9]*/$P/" input > input.bench' ;;
+    omp-lu)    KIND=omp DIR=papps/omp BIN=lu ARGS='-n1024 -p$P' ;;
+    omp-ocean) KIND=omp DIR=papps/omp BIN=ocean ARGS='-n514 -i100 -p$P' ;;
+    omp-radix) KIND=omp DIR=papps/omp BIN=radix ARGS='-n5000000 -p$P' ;;
+    omp-water) KIND=omp DIR=papps/omp BIN=water ARGS='-n4096 -s4 -p$P' ;;
+    pfscan)    KIND=pfscan DIR=papps/pfscan-1.0 BIN=pfscan
+	       ARGS='-n $P pthread_mutex_lock $ROOT/papps > /dev/null' ;;
+    sqlite)    KIND=sqlite DIR=papps/sqlite/test BIN=threadtest1 ARGS='$P' ;;
+    aget)      KIND=aget DIR=papps/aget-devel BIN=aget
+	       ARGS='-p $HTTP_PORT -n $P -l bench.out http://localhost/bench.in'
+	       PREP='rm -f bench.out bench.out-aget*.log' ;;
+    micro)     KIND=micro DIR=test BIN=dpbench ;;
+    *)         return 1 ;;
+    esac
+    [ "$KIND" = splash ] && DIR=$SPLASH/$DIR || DIR=$ROOT/$DIR
+    return 0
+}
+
+# binary of an impl
+bin()
+{
+    if [ "$KIND" = omp ]; then
+	[ "$1" = det ] && echo $BIN || echo $BIN-gomp
+    else
+	echo $BIN.$1
+    fi
+}
+
+build()
+{
+    cd $DIR || return 1
+    eval "$PREBUILD" || return 1
+    case $KIND in
+    splash)
+	for impl in posix det; do
+	    m=det; [ $impl = posix ] && m=POSIX
+	    make clean && make MACROS=$SPLASH/null_macros/c.m4.null.$m && mv $BIN $BIN.$impl || return 1
+	done ;;
+    omp)
+	make ;;
+    pfscan)
+	make clean && make lnx-posix && mv pfscan pfscan.posix || return 1
+	make clean && make lnx && mv pfscan pfscan.det ;;
+    sqlite)
+	make clean; make DPTHREAD=0 threadtest1 && mv threadtest1 threadtest1.posix || return 1
+	make clean; make threadtest1 && mv threadtest1 threadtest1.det ;;
+    aget)
+	make clean && make USE_DPTHREAD=n aget && mv aget aget.posix || return 1
+	make clean && make aget && mv aget aget.det && make httpd ;;
+    micro)
+	make dpbench ;;
+    esac
+}
+
+# run <name> <impl> <threads> <rep> [env]
+run()
+{
+    local s e st
+
+    (cd $DIR; eval "$PREP")
+    echo "== $1 $2 -p$3 #$4" >> $OUT.out
+    s=`date +%s%N`
+    (cd $DIR; eval "$5 ./`bin $2` $ARGS") >> $OUT.out 2>&1
+    st=$?
+    e=`date +%s%N`
+    echo "$1,$2,$3,$4,`echo $s $e | awk '{ printf "%.3f", ($2 - $1) / 1e9 }'`,$st" >> $OUT.runs.csv
+    [ $st = 0 ] || fail "$1 $2 -p$3 #$4 exit $st"
+}
+
+# sums of a DPTHREAD_STATS file: sync ops, turn retries, turn wait usec
+stats_sum()
+{
+    for f in count retries turn_wait_us; do
+	grep -o "\"$f\": [0-9.]*" $1 2>/dev/null | awk '{ s += $2 } END { printf ",%.0f", s }'
+    done
+}
+
+summary()
+{
+    awk -F, -v json=$OUT.json '
+    function val(x) { return x == "" ? "null" : x }
+    FNR == 1 { next }
+    FILENAME ~ /stats.csv$/ { stat[$1 "," $2] = $3 "," $4 "," $5; next }
+    {
+	k = $1 "," $2 "," $3
+	if ( !(k in seen) ) { seen[k] = 1; order[++nk] = k }
+	b = $1 "," $2
+	if ( !(b in base) || $3 + 0 < base[b] + 0 ) base[b] = $3
+	if ( $6 != 0 ) next
+	n[k]++; sum[k] += $5; sq[k] += $5 * $5
+	if ( !(k in mn) || $5 < mn[k] ) mn[k] = $5
+	if ( $5 > mx[k] ) mx[k] = $5
+    }
+    END {
+	print "workload,impl,threads,runs,mean,min,max,stddev,cv,speedup,overhead,sync_ops,retries,turn_wait_us"
+	printf "[\n" > json
+	for ( i = 1; i <= nk; i++ ) {
+	    k = order[i]; split(k, f, ",")
+	    mean = sd = cv = speedup = overhead = ""
+	    ops = retries = wait = ""
+	    if ( n[k] > 0 ) {
+		mean = sum[k] / n[k]
+		sd = n[k] > 1 ? sqrt((sq[k] - n[k] * mean * mean) / (n[k] - 1)) : 0
+		if ( sd != 0 && sd * sd < 1e-12 ) sd = 0
+		cv = mean > 0 ? sprintf("%.4f", sd / mean) : ""
+		b = f[1] "," f[2] "," base[f[1] "," f[2]]
+		if ( n[b] > 0 && mean > 0 ) speedup = sprintf("%.3f", sum[b] / n[b] / mean)
+		p = f[1] ",posix," f[3]
+		if ( f[2] == "det" && n[p] > 0 && sum[p] > 0 )
+		    overhead = sprintf("%.3f", mean / (sum[p] / n[p]))
+		mean = sprintf("%.3f", mean); sd = sprintf("%.3f", sd)
+	    }
+	    if ( f[2] == "det" && (f[1] "," f[3]) in stat ) {
+		split(stat[f[1] "," f[3]], s, ",")
+		ops = s[1]; retries = s[2]; wait = s[3]
+	    }
+	    print k "," n[k] + 0 "," mean "," mn[k] "," mx[k] "," sd "," cv "," \
+		speedup "," overhead "," ops "," retries "," wait
+	    printf "%s{\"workload\":\"%s\",\"impl\":\"%s\",\"threads\":%d,\"runs\":%d," \
+		"\"mean\":%s,\"min\":%s,\"max\":%s,\"stddev\":%s,\"cv\":%s," \
+		"\"speedup\":%s,\"overhead\":%s,\"sync_ops\":%s,\"retries\":%s," \
+		"\"turn_wait_us\":%s}", i > 1 ? ",\n" : "", f[1], f[2], f[3], n[k],
+		val(mean), val(mn[k]), val(mx[k]), val(sd), val(cv), val(speedup),
+		val(overhead), val(ops), val(retries), val(wait) > json
+	}
+	printf "\n]\n" > json
+    }' $OUT.stats.csv $OUT.runs.csv > $OUT.csv
+}
+
+while getopts "t:r:o:SBlh" c; do
+    case $c in
+    t) THREADS="$OPTARG" ;;
+    r) REPEAT=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    S) STATS=0 ;;
+    B) BUILD=0 ;;
+    l) echo $ALL; exit 0 ;;
+    *) usage ;;
+    esac
+done
+shift `expr $OPTIND - 1`
+WORKLOADS="$*"
+[ -z "$WORKLOADS" ] && WORKLOADS="$ALL"
+if [ -z "$THREADS" ]; then
+    p=1
+    while [ $p -lt $NPROC ]; do THREADS="$THREADS $p"; p=`expr $p \* 2`; done
+    THREADS="$THREADS $NPROC"
+fi
+case $OUT in /*) ;; *) OUT=$ROOT/$OUT ;; esac
+
+for w in $WORKLOADS; do
+    workload $w || { echo "unknown workload $w"; usage; }
+done
+
+echo "Benchmark: threads$THREADS, $REPEAT runs, `date`" | tee $OUT
+: > $OUT.out
+: > $OUT.build
+echo "workload,impl,threads,rep,secs,status" > $OUT.runs.csv
+echo "workload,threads,sync_ops,retries,turn_wait_us" > $OUT.stats.csv
+mkdir -p $OUT.stats
+
+make -C $SPLASH >> $OUT.build 2>&1
+
+for w in $WORKLOADS; do
+    workload $w
+    echo "$w: $DIR" | tee -a $OUT
+    if [ $BUILD = 1 ]; then
+	(build) >> $OUT.build 2>&1 || { fail "$w build. see $OUT.build"; continue; }
+    fi
+
+    if [ $KIND = micro ]; then
+	$DIR/dpbench -n $NPROC -r $REPEAT -o ${OUT%.bench}.microbench >> $OUT 2>&1 || fail "dpbench"
+	continue
+    fi
+    if [ $KIND = aget ]; then
+	[ -f $DIR/bench.in ] || head -c 64M /dev/zero > $DIR/bench.in
+	$DIR/httpd -p $HTTP_PORT $DIR/bench.in &
+	HTTPD=$!
+	sleep 1
+    fi
+
+    for P in $THREADS; do
+	for impl in posix det; do
+	    for rep in `seq 1 $REPEAT`; do
+		run $w $impl $P $rep
+	    done
+	done
+	if [ $STATS = 1 ]; then
+	    f=$OUT.stats/$w.p$P.json
+	    rm -f $f
+	    run $w det $P stats "DPTHREAD_STATS=$f"
+	    sed -i '$d' $OUT.runs.csv # not timed
+	    echo "$w,$P`stats_sum $f`" >> $OUT.stats.csv
+	fi
+	grep "^$w,[a-z]*,$P," $OUT.runs.csv | \
+	    awk -F, '{ t[$2] = t[$2] " " $5 } END { printf "  -p%s posix:%s  det:%s\n", P, t["posix"], t["det"] }' P=$P | tee -a $OUT
+    done
+
+    if [ $KIND = aget ]; then
+	kill $HTTPD
+	rm -f $DIR/bench.out*
+    fi
+done
+
+summary
+echo "wrote $OUT.csv $OUT.json $OUT.runs.csv" | tee -a $OUT
+column -s, -t < $OUT.csv | tee -a $OUT
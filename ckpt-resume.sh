@@ -0,0 +1,43 @@
+#!/bin/bash
+# Resume a dpthread checkpoint. 
+#
+# usage: ckpt-resume.sh <index file> [logical clock]
+#
+# The program must have been run with DPTHREAD_CKPT_INTERVAL=<clock> (and 
+# usually DPTHREAD_CKPT_KEEP=1). Each line of the index file (default: 
+# ckpt.<pid>) is "<pid> <logical clock> <seq>". The newest checkpoint taken at 
+# or before the given logical clock is resumed and the others are discarded. 
+
+INDEX="$1"
+TARGET="$2"
+
+error()
+{
+    echo $*
+    exit 1
+}
+
+[ -f "$INDEX" ] || error "usage: $0 <index file> [logical clock]"
+
+PID=""
+while read pid clock seq; do 
+    kill -0 $pid 2> /dev/null || continue 	# evicted 
+    if [ -z "$TARGET" ] || [ "$clock" -le "$TARGET" ]; then 
+	PID=$pid; CLOCK=$clock; SEQ=$seq
+    fi 
+done < "$INDEX"
+
+[ -z "$PID" ] && error "no checkpoint before $TARGET" 
+
+# discard the others 
+while read pid clock seq; do 
+    [ "$pid" = "$PID" ] || kill -TERM $pid 2> /dev/null 
+done < "$INDEX"
+
+echo "resume checkpoint $SEQ (pid $PID) at clock $CLOCK" 
+kill -USR2 $PID || error "failed to resume $PID" 
+
+# the snapshot is not our child. wait until it finishes. 
+while kill -0 $PID 2> /dev/null; do 
+    sleep 1
+done 
@@ -12,6 +12,7 @@
 #include <string.h>
 #include <time.h>
 
+#define EVENTS_PER_USEC 122 // average store events per 1 usec. logical time of 1 usec 
 
 ///////////////////////////////////////////////////////////////////////////////////
 // Extennal library APIs  
@@ -58,6 +59,9 @@ void *detio_realloc(void *ptr, size_t size);
 // sys/time.h 
 int detio_gettimeofday(struct timeval *tv, void *tz); 
 
+// time.h 
+int detio_clock_gettime(clockid_t clk_id, struct timespec *tp); 
+
 ///////////////////////////////////////////////////////////////////////////////////
 // System call APIs  
 ///////////////////////////////////////////////////////////////////////////////////
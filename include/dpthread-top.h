@@ -0,0 +1,54 @@
+/**
+ * Deterministic threading runtime - live status page
+ *
+ * With DPTHREAD_TOP=<name>, each process publishes its threads' clocks,
+ * states and waits in the POSIX shm object /<name>.<pid>, updated at
+ * every sync event without a lock. tools/dptop attaches to it read-only
+ * and shows the rates and who waits for whom.
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+
+#ifndef DPTHREAD_TOP_H
+#define DPTHREAD_TOP_H
+
+#include <stdint.h>
+
+#define DET_TOP_MAGIC "DPTOP001"
+#define DET_TOP_MAX_THR 128      // MAX_THR
+#define DET_TOP_MAX_MUTEX 4096   // owners of higher mutex ids are not shown
+
+enum {
+	DET_TOP_FREE,
+	DET_TOP_RUNNING,
+	DET_TOP_BLOCKED,         // at wait_op on wait_obj
+	DET_TOP_EXITED,
+};
+
+typedef struct {
+	volatile int64_t clock;  // logical clock at the last sync event
+	volatile uint64_t events; // sync events
+	volatile uint64_t retries; // turns lost in wait_for_turn()
+	volatile int32_t state;  // DET_TOP_*
+	volatile int32_t turn;   // in wait_for_turn()
+	volatile int32_t blocker; // minimum clock at the last lost turn, or -1
+	volatile int32_t wait_op; // DET_TRACE_* that blocked
+	volatile int32_t wait_obj;
+	volatile int32_t domain;
+	int32_t pad[4];
+} det_top_thread_t;
+
+typedef struct {
+	char     magic[8];       // DET_TOP_MAGIC
+	uint32_t size;           // sizeof(det_top_page_t)
+	int32_t  pid;
+	volatile int32_t max_thr; // thread slots in use
+	volatile int32_t mode;   // DET_MODE_*
+	volatile int64_t last_sync_clock;
+	det_top_thread_t thread[DET_TOP_MAX_THR];
+	volatile int32_t mutex_owner[DET_TOP_MAX_MUTEX]; // thread, -1 free
+} det_top_page_t;
+
+#endif /* DPTHREAD_TOP_H */
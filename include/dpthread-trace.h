@@ -0,0 +1,123 @@
+/**
+ * Deterministic threading runtime - binary event trace
+ *
+ * With DPTHREAD_TRACE=<prefix>, each thread appends a record per sync
+ * operation to <prefix>.p<id>.trace, a file mapped as a ring of
+ * DPTHREAD_TRACE_SIZE records. No lock and no formatting on the way;
+ * tools/dptrace prints a trace in the DPTHREAD_DEBUG=1 text format, as a
+ * Chrome trace timeline, or diffs the sync order of two runs.
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+
+#ifndef DPTHREAD_TRACE_H
+#define DPTHREAD_TRACE_H
+
+#include <stdint.h>
+
+#define DET_TRACE_MAGIC "DPTRACE1"
+
+// name, chrome phase (B - begin, E - end, i - instant), text. the text
+// takes the object id (%d) and the argument (%lld).
+#define DET_TRACE_OPS(X) \
+	X(MUTEX_INIT,          'i', "mutex_init(%d)\n") \
+	X(TRYLOCK,             'i', "trylock(%d)\n") \
+	X(TRYLOCK_ACQ,         'i', "trylock acq(%d)\n") \
+	X(TRYLOCK_FAIL,        'i', "trylock fail(%d)\n") \
+	X(ACQ_ENTER,           'B', "acq(%d) - enter\n") \
+	X(SPINNING,            'i', "--spinning\n") \
+	X(ACQ_TIMEOUT,         'E', "acq(%d) timed out\n") \
+	X(ACQ,                 'E', "acq(%d)\n") \
+	X(REL,                 'i', "rel(%d)\n") \
+	X(ACQ_MANY_ENTER,      'B', "acq_many(%d..%lld) enter\n") \
+	X(ACQ_MANY,            'E', "acq_many(%d..%lld)\n") \
+	X(REL_MANY,            'i', "rel_many(%d..%lld)\n") \
+	X(COND_INIT,           'i', "cond_init(%d)\n") \
+	X(COND_WAIT,           'B', "cond(%d) wait enter\n") \
+	X(COND_WAKE,           'E', "cond(%d) wait leave\n") \
+	X(COND_TIMEDWAIT,      'B', "cond(%d) timedwait enter. deadline %lld\n") \
+	X(COND_TIMEDWAKE,      'E', "cond(%d) timedwait leave\n") \
+	X(COND_TIMEOUT,        'E', "cond(%d) timedwait leave (timeout)\n") \
+	X(COND_SIGNAL,         'i', "cond(%d) signal to %lld\n") \
+	X(BARRIER_ENTER,       'B', "barrier(%d) enter\n") \
+	X(BARRIER_LEAVE,       'E', "barrier(%d) leave\n\n") \
+	X(BARRIER_ARRIVE,      'i', "barrier(%d) arrive\n") \
+	X(BARRIER_TOKEN,       'i', "barrier(%d) leave phase %lld\n") \
+	X(REDUCE_INIT,         'i', "reduce_init(%d)\n") \
+	X(REDUCE_ENTER,        'B', "reduce(%d) enter\n") \
+	X(REDUCE_LEAVE,        'E', "reduce(%d) leave\n") \
+	X(RWLOCK_INIT,         'i', "rwlock_init(%d)\n") \
+	X(RDLOCK_ENTER,        'B', "rdlock(%d) enter\n") \
+	X(RDLOCK,              'E', "rdlock(%d) acq. %lld readers\n") \
+	X(TRYRDLOCK,           'i', "tryrdlock(%d) acq\n") \
+	X(TRYRDLOCK_FAIL,      'i', "tryrdlock(%d) fail\n") \
+	X(WRLOCK_ENTER,        'B', "wrlock(%d) enter\n") \
+	X(WRLOCK,              'E', "wrlock(%d) acq\n") \
+	X(TRYWRLOCK,           'i', "trywrlock(%d) acq\n") \
+	X(TRYWRLOCK_FAIL,      'i', "trywrlock(%d) fail\n") \
+	X(WR_REL,              'i', "rwlock(%d) wr rel\n") \
+	X(RD_REL,              'i', "rwlock(%d) rd rel\n") \
+	X(SEM_INIT,            'i', "sem_init(%d) = %lld\n") \
+	X(SEM_WAIT,            'i', "sem(%d) wait\n") \
+	X(SEM_BLOCK,           'B', "sem(%d) wait block\n") \
+	X(SEM_WAKE,            'E', "sem(%d) wait leave\n") \
+	X(SEM_TIMEDWAIT,       'i', "sem(%d) timedwait\n") \
+	X(SEM_TIMEDWAIT_FAIL,  'i', "sem(%d) timedwait (timeout)\n") \
+	X(SEM_TIMEDBLOCK,      'B', "sem(%d) timedwait block. deadline %lld\n") \
+	X(SEM_TIMEDWAKE,       'E', "sem(%d) timedwait leave\n") \
+	X(SEM_TIMEOUT,         'E', "sem(%d) timedwait leave (timeout)\n") \
+	X(SEM_TRYWAIT,         'i', "sem(%d) trywait ok\n") \
+	X(SEM_TRYWAIT_FAIL,    'i', "sem(%d) trywait fail\n") \
+	X(SEM_POST_TO,         'i', "sem(%d) post to %lld\n") \
+	X(SEM_POST,            'i', "sem(%d) post\n") \
+	X(SPIN_INIT,           'i', "spin_init(%d)\n") \
+	X(SPIN,                'i', "spin(%d) acq\n") \
+	X(SPIN_TRYLOCK,        'i', "spin(%d) trylock acq\n") \
+	X(SPIN_TRYLOCK_FAIL,   'i', "spin(%d) trylock fail\n") \
+	X(SPIN_REL,            'i', "spin(%d) rel\n") \
+	X(QUEUE_INIT,          'i', "queue_init(%d) = %lld\n") \
+	X(QUEUE_PUT_BLOCK,     'i', "queue(%d) put block\n") \
+	X(QUEUE_PUT,           'i', "queue(%d) put %lld\n") \
+	X(QUEUE_GET_BLOCK,     'i', "queue(%d) get block\n") \
+	X(QUEUE_GET,           'i', "queue(%d) get %lld\n") \
+	X(QUEUE_CLOSE,         'i', "queue(%d) close\n") \
+	X(SELECT_BLOCK,        'i', "select(%d..) block\n") \
+	X(SELECT,              'i', "select(%d..) = %lld\n") \
+	X(PROMISE_INIT,        'i', "promise_init(%d)\n") \
+	X(PROMISE_SET,         'i', "promise(%d) set = %lld\n") \
+	X(FUTURE_BLOCK,        'i', "future(%d) get block\n") \
+	X(JOIN_ENTER,          'B', "JOIN(%d):enter \n") \
+	X(JOIN,                'E', "JOIN(%d):exit \n") \
+	X(WAITPID_ENTER,       'B', "WAITPID(%d):enter \n") \
+	X(WAITPID,             'E', "WAITPID(%d):exit \n")
+
+#define DET_TRACE_ENUM(name, ph, text) DET_TRACE_##name,
+enum {
+	DET_TRACE_OPS(DET_TRACE_ENUM)
+	DET_TRACE_NR_OPS
+};
+#undef DET_TRACE_ENUM
+
+typedef struct {
+	uint64_t tsc;            // time stamp counter
+	int64_t  clock;          // logical clock
+	int64_t  arg;
+	int32_t  obj;            // object id
+	uint16_t op;             // DET_TRACE_*
+	uint16_t tid;
+} det_trace_rec_t;
+
+typedef struct {
+	char     magic[8];       // DET_TRACE_MAGIC
+	uint32_t rec_size;       // sizeof(det_trace_rec_t)
+	uint32_t tid;
+	uint64_t size;           // records in the ring. a power of 2
+	volatile uint64_t count; // records written. the ring has the last size
+	uint64_t tsc_base;       // tsc at det_init()
+	double   tsc_per_usec;
+	char     pad[16];
+} det_trace_hdr_t;
+
+#endif /* DPTHREAD_TRACE_H */
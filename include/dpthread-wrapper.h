@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <sys/time.h>
 #include <sys/select.h>
+#include <semaphore.h>
 
 ///////////////////////////////////////////////////////////////////
 // pthread apis 
@@ -29,6 +30,9 @@
 #define pthread_mutex_t  det_mutex_t 
 #define pthread_barrier_t det_barrier_t 
 #define pthread_cond_t det_cond_t
+#define pthread_rwlock_t det_rwlock_t 
+#define pthread_spinlock_t det_spinlock_t 
+#define sem_t det_sem_t 
 
 // for 32bit machien see 
 
@@ -46,6 +50,9 @@
   {-1, { { 0, 0, 0, 0, 0, { 0 } } }, 0, 0, 0, { 0, 0, 0, 0} }
 #endif 
 
+#undef PTHREAD_RWLOCK_INITIALIZER
+#define PTHREAD_RWLOCK_INITIALIZER { -1 } 
+
 // not support recursive lock and so force. 
 #define pthread_mutexattr_init(a)       
 #define pthread_mutexattr_settype(a,v)
@@ -58,6 +65,7 @@
 #define pthread_mutex_init(m, x) det_lock_init(m)
 #define pthread_mutex_lock(m) det_lock(m)
 #define pthread_mutex_trylock(m) det_trylock(m)
+#define pthread_mutex_timedlock(m, t) det_timedlock(m, t)
 #define pthread_mutex_unlock(m) det_unlock(m)
 #define pthread_barrier_init(b, x, c ) det_barrier_init(b, c)
 #define pthread_barrier_wait(b) det_barrier_wait(b)
@@ -65,16 +73,68 @@
 #define pthread_cond_wait(c,m) det_cond_wait(c,m)
 #define pthread_cond_signal(c) det_cond_signal(c)
 #define pthread_cond_broadcast(c) det_cond_broadcast(c)
+#define pthread_rwlock_init(l, a) det_rwlock_init(l)
+#define pthread_rwlock_rdlock(l) det_rwlock_rdlock(l)
+#define pthread_rwlock_wrlock(l) det_rwlock_wrlock(l)
+#define pthread_rwlock_tryrdlock(l) det_rwlock_tryrdlock(l)
+#define pthread_rwlock_trywrlock(l) det_rwlock_trywrlock(l)
+#define pthread_rwlock_unlock(l) det_rwlock_unlock(l)
+#define pthread_spin_init(l, p) det_spin_init(l)
+#define pthread_spin_lock(l) det_spin_lock(l)
+#define pthread_spin_trylock(l) det_spin_trylock(l)
+#define pthread_spin_unlock(l) det_spin_unlock(l)
+#define sem_init(s, p, v) ((p) ? det_sem_init_shared(s, v) : det_sem_init(s, v))
+#define sem_wait(s) det_sem_wait(s)
+#define sem_trywait(s) det_sem_trywait(s)
+#define sem_timedwait(s, t) det_sem_timedwait(s, t)
+#define sem_post(s) det_sem_post(s)
+#define sem_getvalue(s, v) det_sem_getvalue(s, v)
 
 #define pthread_mutex_destroy(m) 0
 #define pthread_cond_destroy(c) 0 
-#define pthread_cond_timedwait(c,m,t) det_cond_wait(c,m)
+#define pthread_rwlock_destroy(l) 0 
+#define pthread_spin_destroy(l) 0 
+#define sem_destroy(s) 0 
+#define pthread_cond_timedwait(c,m,t) det_cond_timedwait(c,m,t)
 
 #define pthread_testcancel() 0
 #define pthread_setcancelstate(s,os) 0
 #define pthread_setcanceltype(t,ot) 0 
 #define pthread_sigmask(h, s, os) det_sigmask(h, s, os)
 
+///////////////////////////////////////////////////////////////////
+// atomic builtins (1, 2, 4 and 8 byte words). a turn each, where the 
+// builtin took none, so a compare-and-swap loop is two or more turns. 
+///////////////////////////////////////////////////////////////////
+
+#define __sync_fetch_and_add(p, v) det_atomic_fetch_add(p, v)
+#define __sync_fetch_and_sub(p, v) det_atomic_fetch_sub(p, v)
+#define __sync_fetch_and_and(p, v) det_atomic_fetch_and(p, v)
+#define __sync_fetch_and_or(p, v) det_atomic_fetch_or(p, v)
+#define __sync_add_and_fetch(p, v) ({ __typeof__(*(p)) __v = (v); \
+			det_atomic_fetch_add(p, __v) + __v; })
+#define __sync_sub_and_fetch(p, v) ({ __typeof__(*(p)) __v = (v); \
+			det_atomic_fetch_sub(p, __v) - __v; })
+#define __sync_val_compare_and_swap(p, o, n) det_atomic_cas(p, o, n)
+#define __sync_bool_compare_and_swap(p, o, n) ({ __typeof__(*(p)) __o = (o); \
+			det_atomic_cas(p, __o, n) == __o; })
+#define __sync_lock_test_and_set(p, v) det_atomic_exchange(p, v)
+#define __sync_lock_release(p) ((void)det_atomic_exchange(p, 0))
+
+#define __atomic_load_n(p, m) det_atomic_load(p)
+#define __atomic_store_n(p, v, m) ((void)det_atomic_exchange(p, v))
+#define __atomic_exchange_n(p, v, m) det_atomic_exchange(p, v)
+#define __atomic_fetch_add(p, v, m) det_atomic_fetch_add(p, v)
+#define __atomic_fetch_sub(p, v, m) det_atomic_fetch_sub(p, v)
+#define __atomic_fetch_and(p, v, m) det_atomic_fetch_and(p, v)
+#define __atomic_fetch_or(p, v, m) det_atomic_fetch_or(p, v)
+#define __atomic_add_fetch(p, v, m) __sync_add_and_fetch(p, v)
+#define __atomic_sub_fetch(p, v, m) __sync_sub_and_fetch(p, v)
+#define __atomic_compare_exchange_n(p, e, n, w, s, f) ({		\
+			__typeof__(*(p)) __e = *(e);			\
+			__typeof__(*(p)) __r = det_atomic_cas(p, __e, n); \
+			__r == __e ? 1 : (*(e) = __r, 0); })
+
 ///////////////////////////////////////////////////////////////////
 // external libraries 
 ///////////////////////////////////////////////////////////////////
@@ -126,6 +186,9 @@
 // sys/time.h 
 #define gettimeofday(tv, tz) detio_gettimeofday(tv, tz)
 
+// time.h 
+#define clock_gettime(c, ts) detio_clock_gettime(c, ts)
+
 ///////////////////////////////////////////////////////////////////
 // system calls
 ///////////////////////////////////////////////////////////////////
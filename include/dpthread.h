@@ -18,6 +18,11 @@
 #define USE_DPTHREAD 1 
 #define MAX_THR  128
 
+#define DET_DOMAIN_GLOBAL -1 // sync objects shared across domains 
+
+#define DET_MODE_DET     0 // deterministic ordering 
+#define DET_MODE_NATIVE  1 // passthrough to pthread 
+
 // #define unlikely(x)     __builtin_expect((x),0)
 
 typedef struct {
@@ -28,12 +33,14 @@ typedef struct {
 	volatile int ref;
 	TQueue queue; 
 	// TODO: queue 
+	int domain; 
 } det_mutex_t; 
 
 typedef struct {
 	int id; 
 	TQueue queue; 
 	det_mutex_t waiter[MAX_THR]; 
+	int domain; 
 } det_cond_t; 
 
 typedef struct {
@@ -42,8 +49,126 @@ typedef struct {
 	volatile int wait_count; 
 	det_cond_t wait_cond; 
 	det_mutex_t wait_mutex; 
+	volatile unsigned int phase;     // released phases 
+	volatile int64_t release_clock;  // clock of the last release 
+	int domain; 
 } det_barrier_t; 
 
+typedef struct {
+	int id; 
+	det_mutex_t lock;        // protects the fields below 
+	det_cond_t rd_cond; 
+	det_cond_t wr_cond; 
+	volatile int readers;    // readers holding the lock 
+	volatile int writer;     // owner. -1 - none 
+	int rd_waiting;          // readers blocked behind a writer 
+	int wr_waiting; 
+	unsigned int rd_phase;   // incremented when a batch of readers is admitted 
+	int domain; 
+} det_rwlock_t; 
+
+typedef struct {
+	int id; 
+	pthread_mutex_t mutex;   // protects value and the queue in native mode 
+	volatile int value; 
+	det_cond_t wait;         // blocked waiters 
+	int domain; 
+} det_sem_t; 
+
+typedef struct {
+	int id; 
+	volatile int locked; 
+	volatile int64_t released_logical_time; 
+	volatile int owner; 
+	int domain; 
+} det_spinlock_t; 
+
+#define DET_REDUCE_SUM   0 
+#define DET_REDUCE_MIN   1 
+#define DET_REDUCE_MAX   2 
+
+#define DET_REDUCE_DOUBLE 0 
+#define DET_REDUCE_INT64  1 
+
+// combine len elements of in into inout 
+typedef void (*det_reduce_fn)(void *inout, const void *in, int len); 
+
+typedef struct { 
+	int id; 
+	det_mutex_t lock;        // protects the fields below 
+	det_cond_t cond; 
+	int target_count; 
+	volatile int wait_count; 
+	volatile unsigned int phase; 
+	int op;                  // DET_REDUCE_SUM/MIN/MAX. -1 - fn 
+	int type;                // DET_REDUCE_DOUBLE/INT64 
+	det_reduce_fn fn; 
+	size_t size;             // bytes of an element 
+	int len;                 // elements of a contribution 
+	char *partial;           // a contribution per thread id 
+	char *present; 
+	char *result; 
+	int domain; 
+} det_reduce_t; 
+
+typedef struct { 
+	int id; 
+	pthread_mutex_t mutex;   // protects the fields below in native mode 
+	void **buf; 
+	int size; 
+	volatile int count; 
+	int head;                // next get 
+	int tail;                // next put 
+	volatile int closed; 
+	det_cond_t getters;      // blocked while empty 
+	det_cond_t putters;      // blocked while full 
+	void *handoff[MAX_THR];  // item to a blocked getter, from a blocked putter 
+	int domain; 
+} det_queue_t; 
+
+typedef det_queue_t det_chan_t; 
+
+typedef struct { 
+	int id; 
+	pthread_mutex_t mutex;   // protects the fields below in native mode 
+	volatile int ready; 
+	void *value; 
+	det_cond_t wait;         // getters blocked until set 
+	int domain; 
+} det_promise_t; 
+
+typedef void (*det_task_fn)(void *arg); 
+typedef void (*det_for_fn)(long lo, long hi, void *arg); 
+
+typedef struct { 
+	det_task_fn fn; 
+	det_for_fn body;         // parallel_for range if fn is NULL 
+	void *arg; 
+	long lo, hi, grain; 
+} det_task_t; 
+
+typedef struct { 
+	det_task_t *task;        // ring of size slots 
+	long size; 
+	long top;                // next steal. changes at turns 
+	long split;              // [top, split) public, [split, bottom) private 
+	long bottom;             // next push. owner only 
+	long top_seen;           // top at the owner's last turn 
+} det_deque_t; 
+
+typedef struct { 
+	int nworkers; 
+	det_deque_t *deque; 
+	int worker[MAX_THR];     // thread id -> worker + 1. 0 - not in the pool 
+	pthread_t thread[MAX_THR]; 
+	int started;             // threads of det_pool_create() 
+	det_mutex_t lock;        // public parts and the fields below 
+	det_cond_t work; 
+	int idle; 
+	int syncing; 
+	int quit; 
+} det_pool_t; 
+
 
 ///////////////////////////////////////////////////////////////////////////////////
 // dpthread core API    
@@ -64,25 +189,191 @@ int  det_get_pid(void);
 
 int det_cancel(pthread_t threadid); 
 
+// determinism domains: threads take turns only against threads of the same 
+// domain. a sync object belongs to one domain and may be used only by its 
+// threads (EPERM otherwise); DET_DOMAIN_GLOBAL objects take turns against 
+// all threads and are the way domains talk to each other. 
+// det_create() and the *_init() calls use the domain of the caller. 
+int  det_create_domain(pthread_t *thread, const pthread_attr_t *attr,
+		       void *(*start_routine)(void*), void *arg, int domain);
+int  det_get_domain(void); 
+int  det_lock_init_domain(det_mutex_t *mutex, int domain); 
+int  det_cond_init_domain(det_cond_t *cond, int domain); 
+int  det_barrier_init_domain(det_barrier_t *barrier, int count, int domain); 
+
+// multi-process group: with DPTHREAD_SHM set, the clocks live in shared 
+// memory and det_fork()ed processes take turns with the threads of the 
+// parent. objects used by several processes must be in memory mapped 
+// MAP_SHARED before the fork and initialized by the *_init_shared() calls. 
+// a process leaves the group at exit(); the parent reaps it by det_waitpid(). 
+pid_t det_fork(void); 
+pid_t det_waitpid(pid_t pid, int *status); 
+int  det_lock_init_shared(det_mutex_t *mutex); 
+int  det_cond_init_shared(det_cond_t *cond); 
+int  det_barrier_init_shared(det_barrier_t *barrier, int count); 
+
 // synchronizations: lock, condition variable, barrier 
 int  det_lock_init(det_mutex_t *mutex); 
 int  det_lock(det_mutex_t *mutex);
 int  det_trylock(det_mutex_t *mutex);
 int  det_unlock(det_mutex_t *mutex);
+// *_destroy() free the queues of an object no thread is waiting on. 
+int  det_lock_destroy(det_mutex_t *mutex); 
+
+// lock sets: take n mutexes at a single turn, in the order of their ids, 
+// or none of them. so a set costs one turn and sets never deadlock each 
+// other. det_unlock_many() releases a set at a single turn. 
+int  det_lock_many(det_mutex_t **mutexes, int n); 
+int  det_unlock_many(det_mutex_t **mutexes, int n); 
+
+// timed waits. abstime is in the time of the wrapped gettimeofday() and 
+// clock_gettime(), i.e. logical time. a waiter times out (ETIMEDOUT) in its 
+// turn after the threads of the domain have passed the deadline. 
+int  det_timedlock(det_mutex_t *mutex, const struct timespec *abstime); 
+int  det_cond_timedwait(det_cond_t *cond, det_mutex_t *mutex, 
+			const struct timespec *abstime); 
+int  det_sem_timedwait(det_sem_t *sem, const struct timespec *abstime); 
 
 int  det_barrier_init(det_barrier_t *barrier, int count); 
 int  det_barrier_wait(det_barrier_t *barrier); 
+int  det_barrier_destroy(det_barrier_t *barrier); 
+
+// split-phase barrier: det_barrier_arrive() counts the caller in without 
+// blocking and returns a token; det_barrier_wait_token() waits until that 
+// phase is released. the caller leaves at the clock of the last arrival 
+// (or its own, if later), so local work can run between the two. 
+unsigned int det_barrier_arrive(det_barrier_t *barrier); 
+int  det_barrier_wait_token(det_barrier_t *barrier, unsigned int token); 
+
+// reduction: count threads each contribute len elements and all of them 
+// get the combination, like a barrier. contributions are combined in thread 
+// id order, so floating point results do not depend on the arrival order. 
+int  det_reduce_init(det_reduce_t *red, int count, int op, int type, int len); 
+int  det_reduce_init_fn(det_reduce_t *red, int count, det_reduce_fn fn, 
+			size_t size, int len); 
+int  det_reduce_destroy(det_reduce_t *red); 
+int  det_reduce(det_reduce_t *red, const void *in, void *out); 
+
+// reader-writer lock: readers whose turns come before the next writer's 
+// turn hold the lock together. readers blocked behind a writer enter as a 
+// batch when it unlocks. 
+int  det_rwlock_init(det_rwlock_t *rwlock); 
+int  det_rwlock_init_domain(det_rwlock_t *rwlock, int domain); 
+int  det_rwlock_init_shared(det_rwlock_t *rwlock); 
+int  det_rwlock_rdlock(det_rwlock_t *rwlock); 
+int  det_rwlock_wrlock(det_rwlock_t *rwlock); 
+int  det_rwlock_tryrdlock(det_rwlock_t *rwlock); 
+int  det_rwlock_trywrlock(det_rwlock_t *rwlock); 
+int  det_rwlock_unlock(det_rwlock_t *rwlock); 
+
+// atomic read-modify-write on 32/64 bit words. each call takes a single 
+// turn in the domain of the caller; no mutex, no queue. the cas calls 
+// return the previous value. det_atomic_*() pick the size from the pointer; 
+// 1 and 2 byte words go through the *_n() calls, other sizes do not compile. 
+int32_t det_atomic_load_32(volatile int32_t *ptr); 
+int64_t det_atomic_load_64(volatile int64_t *ptr); 
+int32_t det_atomic_fetch_add_32(volatile int32_t *ptr, int32_t val); 
+int64_t det_atomic_fetch_add_64(volatile int64_t *ptr, int64_t val); 
+int32_t det_atomic_fetch_and_32(volatile int32_t *ptr, int32_t val); 
+int64_t det_atomic_fetch_and_64(volatile int64_t *ptr, int64_t val); 
+int32_t det_atomic_fetch_or_32(volatile int32_t *ptr, int32_t val); 
+int64_t det_atomic_fetch_or_64(volatile int64_t *ptr, int64_t val); 
+int32_t det_atomic_exchange_32(volatile int32_t *ptr, int32_t val); 
+int64_t det_atomic_exchange_64(volatile int64_t *ptr, int64_t val); 
+int32_t det_atomic_cas_32(volatile int32_t *ptr, int32_t oldval, int32_t newval); 
+int64_t det_atomic_cas_64(volatile int64_t *ptr, int64_t oldval, int64_t newval); 
+int64_t det_atomic_load_n(volatile void *ptr, int size); 
+int64_t det_atomic_fetch_add_n(volatile void *ptr, int size, int64_t val); 
+int64_t det_atomic_fetch_and_n(volatile void *ptr, int size, int64_t val); 
+int64_t det_atomic_fetch_or_n(volatile void *ptr, int size, int64_t val); 
+int64_t det_atomic_exchange_n(volatile void *ptr, int size, int64_t val); 
+int64_t det_atomic_cas_n(volatile void *ptr, int size, int64_t oldval, int64_t newval); 
+
+// semaphore: sem_*() return values and errno. a post or a wait that does 
+// not block is one turn. a blocked waiter resumes at the clock of the post 
+// that wakes it, like det_cond_signal(). 
+int  det_sem_init(det_sem_t *sem, unsigned int value); 
+int  det_sem_init_domain(det_sem_t *sem, unsigned int value, int domain); 
+int  det_sem_init_shared(det_sem_t *sem, unsigned int value); 
+int  det_sem_wait(det_sem_t *sem); 
+int  det_sem_trywait(det_sem_t *sem); 
+int  det_sem_post(det_sem_t *sem); 
+int  det_sem_getvalue(det_sem_t *sem, int *sval); 
+
+// spinlock: a det_mutex_t without the queue and the pthread mutex. 
+int  det_spin_init(det_spinlock_t *lock); 
+int  det_spin_lock(det_spinlock_t *lock); 
+int  det_spin_trylock(det_spinlock_t *lock); 
+int  det_spin_unlock(det_spinlock_t *lock); 
+
+// bounded mpmc queue: a put or get is one turn unless it has to wait. a 
+// blocked getter is handed the item of the put that wakes it, so which 
+// getter gets which item follows the turn order. put returns EPIPE and get 
+// returns EPIPE when empty once the queue is closed. the batch calls return 
+// the number of items put or got. 
+int  det_queue_init(det_queue_t *q, int size); 
+void det_queue_destroy(det_queue_t *q); 
+int  det_queue_put(det_queue_t *q, void *item); 
+int  det_queue_get(det_queue_t *q, void **item); 
+int  det_queue_put_batch(det_queue_t *q, void **items, int n); 
+int  det_queue_get_batch(det_queue_t *q, void **items, int n); 
+int  det_queue_close(det_queue_t *q); 
+
+// channel: a det_queue_t. select receives from the first channel in the 
+// array that has an item at the turn of the caller; if none has, it waits 
+// on all of them and the first send in turn order wins. returns the index 
+// of that channel, or -1 when all are closed and empty. 
+#define det_chan_init(ch, size) det_queue_init(ch, size) 
+#define det_chan_destroy(ch)    det_queue_destroy(ch) 
+#define det_chan_send(ch, item) det_queue_put(ch, item) 
+#define det_chan_recv(ch, item) det_queue_get(ch, item) 
+#define det_chan_close(ch)      det_queue_close(ch) 
+int  det_chan_select(det_chan_t **chans, int n, void **item); 
+
+// promise: set once, in a turn that wakes all the blocked getters. get 
+// returns the value, one turn if it is set already. set returns EBUSY the 
+// second time. 
+int  det_promise_init(det_promise_t *p); 
+int  det_promise_set(det_promise_t *p, void *value); 
+int  det_future_get(det_promise_t *p, void **value); 
+
+// task pool: per worker deques with a private bottom, used without turns, 
+// and a public top that thieves take from at turns in victim order 
+// w+1, w+2, ..., so the task to worker mapping is the same on every run. 
+// det_pool_create() starts nworkers-1 threads and the caller is worker 0; 
+// det_sync() runs tasks until all have run. det_pool_init() makes a pool 
+// for existing threads, which det_pool_attach() and det_pool_take() items 
+// of det_spawn(pool, NULL, item). det_pool_publish() makes all of the 
+// caller's private tasks public, e.g. after filling its deque up front. 
+int  det_pool_init(det_pool_t *pool, int nworkers); 
+int  det_pool_create(det_pool_t *pool, int nworkers); 
+int  det_pool_attach(det_pool_t *pool, int worker); 
+int  det_pool_destroy(det_pool_t *pool); 
+int  det_spawn(det_pool_t *pool, det_task_fn fn, void *arg); 
+int  det_sync(det_pool_t *pool); 
+int  det_parallel_for(det_pool_t *pool, long lo, long hi, long grain, 
+		      det_for_fn body, void *arg); 
+int  det_pool_take(det_pool_t *pool, det_task_t *task); 
+int  det_pool_publish(det_pool_t *pool); 
 
 int  det_cond_init(det_cond_t *cond);
 int  det_cond_wait(det_cond_t *cond, det_mutex_t *mutex);
 int  det_cond_signal(det_cond_t *cond);
 int  det_cond_broadcast(det_cond_t *cond);
+int  det_cond_destroy(det_cond_t *cond); 
 
 // enable/disable determinism manually
 void det_enable(void); 
 void det_disable(void); 
 int  det_is_enabled(); 
 
+// process-wide mode: all threads switch at a point where each of them is 
+// at a sync operation, blocked in det_cond_wait(), det_disable()d or 
+// exited. each det window starts with all the clocks equal, so a window 
+// replays the same way from the same state. DPTHREAD_MODE_SIGNAL toggles. 
+int  det_set_mode(int mode); 
+int  det_get_mode(void); 
+
 // deterministic clock 
 int64_t det_get_clock();
 
@@ -103,6 +394,26 @@ void det_print_lock(det_mutex_t *mutex, char *msg);
 }
 #endif
 
+// the size passed to *_n() is that of a char array that is negative, a 
+// compile error, unless *p is 1, 2, 4 or 8 bytes. 
+#define __DET_ATOMIC(op, p, args...)					\
+	({ (__typeof__(*(p)))(sizeof(*(p)) == 8 ?			\
+	  det_atomic_##op##_64((volatile int64_t *)(p), ## args) :	\
+	  sizeof(*(p)) == 4 ?						\
+	  det_atomic_##op##_32((volatile int32_t *)(p), ## args) :	\
+	  det_atomic_##op##_n((volatile void *)(p),			\
+			      sizeof(char[sizeof(*(p)) <= 8 &&		\
+					  !(sizeof(*(p)) & (sizeof(*(p)) - 1)) ? \
+					  (int)sizeof(*(p)) : -1]), ## args)); })
+
+#define det_atomic_load(p)          __DET_ATOMIC(load, p)
+#define det_atomic_fetch_add(p, v)  __DET_ATOMIC(fetch_add, p, (int64_t)(v))
+#define det_atomic_fetch_sub(p, v)  __DET_ATOMIC(fetch_add, p, -(int64_t)(v))
+#define det_atomic_fetch_and(p, v)  __DET_ATOMIC(fetch_and, p, (int64_t)(v))
+#define det_atomic_fetch_or(p, v)   __DET_ATOMIC(fetch_or, p, (int64_t)(v))
+#define det_atomic_exchange(p, v)   __DET_ATOMIC(exchange, p, (int64_t)(v))
+#define det_atomic_cas(p, o, n)     __DET_ATOMIC(cas, p, (int64_t)(o), (int64_t)(n))
+
 
 // pid_t gettid(void);
 #endif /* _DPTHREAD_H_ */ 
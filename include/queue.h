@@ -21,8 +21,10 @@ typedef struct _Queue {
 
 void  InitQ( TQueue* queue, int size);
 void  InitQ2( TQueue* queue, TQueue* src);
+void  InitQBuf( TQueue* queue, void **array, int size);
 int AddQ( TQueue* queue, void* item );
 void* DelQ( TQueue* queue );
+int DelItemQ( TQueue* queue, void* item );
 void* GetHeadQ( TQueue *queue );
 int IsEmptyQ( TQueue* queue );
 void  ClearQ( TQueue *queue, int freeObjs);
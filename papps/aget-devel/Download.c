@@ -34,7 +34,11 @@
 
 extern sigset_t signal_set;
 
+#if USE_DPTHREAD
 #define DBG(x) x 
+#else
+#define DBG(x)
+#endif
 
 unsigned int bwritten = 0;
 pthread_mutex_t bwritten_mutex;
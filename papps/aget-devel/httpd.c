@@ -0,0 +1,127 @@
+/**
+ * httpd - a local stand-in web server for running aget in benchmarks
+ *
+ * ex) ./httpd -p 8080 bigfile &
+ *     ./aget -n 4 -l out http://127.0.0.1:8080/bigfile
+ *
+ * serves one file for any path. HEAD gives its length; GET with
+ * "Range: bytes=<from>-" sends the rest from there as 206 Partial Content,
+ * the way aget asks for its pieces. a process per connection.
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#define REQ_SIZE 4096
+
+static void serve(int sd, const char *path)
+{
+	char req[REQ_SIZE], hdr[256], *range;
+	struct stat st;
+	off_t from = 0;
+	ssize_t n, len = 0;
+	int fd, head;
+
+	// aget sends a request in one piece. read up to the blank line.
+	while ( len < REQ_SIZE - 1 && (n = read(sd, req + len, REQ_SIZE - 1 - len)) > 0 ) {
+		len += n;
+		req[len] = '\0';
+		if ( strstr(req, "\r\n\r\n") )
+			break;
+	}
+	req[len] = '\0';
+	head = !strncmp(req, "HEAD ", 5);
+
+	if ( (fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0 ) {
+		n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 404 Not Found\r\n"
+			     "Content-Length: 0\r\nConnection: close\r\n\r\n");
+		write(sd, hdr, n);
+		return;
+	}
+	if ( (range = strstr(req, "Range: bytes=")) )
+		from = atoll(range + strlen("Range: bytes="));
+	if ( from > st.st_size ) {
+		n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 416 Requested Range Not Satisfiable\r\n"
+			     "Content-Length: 0\r\nConnection: close\r\n\r\n");
+		write(sd, hdr, n);
+		return;
+	}
+	if ( range && !head )
+		n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 206 Partial Content\r\n"
+			     "Content-Length: %lld\r\nContent-Range: bytes %lld-%lld/%lld\r\n"
+			     "Connection: close\r\n\r\n", (long long)(st.st_size - from),
+			     (long long)from, (long long)st.st_size - 1, (long long)st.st_size);
+	else
+		n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n"
+			     "Content-Length: %lld\r\nAccept-Ranges: bytes\r\n"
+			     "Connection: close\r\n\r\n", (long long)st.st_size);
+	if ( write(sd, hdr, n) != n || head )
+		return;
+	while ( from < st.st_size && sendfile(sd, fd, &from, st.st_size - from) > 0 )
+		;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: httpd [-p port] file\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	struct sockaddr_in sin;
+	int port = 8080, one = 1;
+	int ls, sd, c;
+
+	while ( (c = getopt(argc, argv, "p:h")) != EOF ) {
+		switch ( c ) {
+		case 'p':
+			port = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if ( argc - optind != 1 )
+		usage();
+	if ( access(argv[optind], R_OK) < 0 )
+		err(1, "%s", argv[optind]);
+
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+	if ( (ls = socket(AF_INET, SOCK_STREAM, 0)) < 0 )
+		err(1, "socket");
+	setsockopt(ls, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(port);
+	if ( bind(ls, (struct sockaddr *)&sin, sizeof(sin)) < 0 || listen(ls, 64) < 0 )
+		err(1, "port %d", port);
+
+	while ( 1 ) {
+		if ( (sd = accept(ls, NULL, NULL)) < 0 )
+			continue;
+		if ( fork() == 0 ) {
+			close(ls);
+			serve(sd, argv[optind]);
+			close(sd);
+			_exit(0);
+		}
+		close(sd);
+	}
+	return 0;
+}
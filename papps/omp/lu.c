@@ -0,0 +1,109 @@
+/**
+ * Blocked LU factorization (SPLASH-2 LU style) with OpenMP.
+ *
+ * The trailing blocks of each step are updated by a dynamic loop.
+ *
+ * ex) ./lu -n 512 -b 16 -p 4
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <omp.h>
+
+static int n = 512;     // matrix size
+static int bs = 16;     // block size
+static double *a;
+
+#define A(i,j) a[(long)(i) * n + (j)]
+
+static void lu_block(int k)
+{
+	int i, j, l, end = k + bs;
+
+	for ( l = k; l < end; l++ )
+		for ( i = l + 1; i < end; i++ ) {
+			A(i,l) /= A(l,l);
+			for ( j = l + 1; j < end; j++ )
+				A(i,j) -= A(i,l) * A(l,j);
+		}
+}
+
+static void update(int k, int bi, int bj)
+{
+	int i, j, l;
+
+	if ( bi == k && bj > k ) {        // row panel
+		for ( l = k; l < k + bs; l++ )
+			for ( i = l + 1; i < k + bs; i++ )
+				for ( j = bj; j < bj + bs; j++ )
+					A(i,j) -= A(i,l) * A(l,j);
+	} else if ( bj == k && bi > k ) { // column panel
+		for ( l = k; l < k + bs; l++ )
+			for ( i = bi; i < bi + bs; i++ ) {
+				A(i,l) /= A(l,l);
+				for ( j = l + 1; j < k + bs; j++ )
+					A(i,j) -= A(i,l) * A(l,j);
+			}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int c, nthr = omp_get_max_threads();
+	int i, j, k, nb;
+	double t, sum = 0;
+
+	while((c=getopt(argc, argv, "n:b:p:h")) != EOF) {
+		switch(c) {
+		case 'n': n = atoi(optarg); break;
+		case 'b': bs = atoi(optarg); break;
+		case 'p': nthr = atoi(optarg); break;
+		default:
+			printf("lu [-n size] [-b block] [-p threads]\n");
+			return 0;
+		}
+	}
+	n = n / bs * bs;
+	nb = n / bs;
+	omp_set_num_threads(nthr);
+
+	a = malloc(sizeof(double) * n * n);
+	for ( i = 0; i < n; i++ )
+		for ( j = 0; j < n; j++ )
+			A(i,j) = (i == j) ? n : ((i * 31 + j * 17) % 100) / 100.0;
+
+	t = omp_get_wtime();
+	#pragma omp parallel private(k)
+	for ( k = 0; k < n; k += bs ) {
+		#pragma omp single
+		lu_block(k);
+
+		// panels
+		#pragma omp for schedule(dynamic)
+		for ( i = 0; i < 2 * nb; i++ ) {
+			if ( i < nb ) update(k, k, i * bs);
+			else          update(k, (i - nb) * bs, k);
+		}
+
+		// interior
+		#pragma omp for schedule(dynamic)
+		for ( i = k / bs + 1; i < nb; i++ ) {
+			int bj, ii, jj, l;
+			for ( bj = k / bs + 1; bj < nb; bj++ )
+				for ( ii = i * bs; ii < (i + 1) * bs; ii++ )
+					for ( l = k; l < k + bs; l++ )
+						for ( jj = bj * bs; jj < (bj + 1) * bs; jj++ )
+							A(ii,jj) -= A(ii,l) * A(l,jj);
+		}
+	}
+	t = omp_get_wtime() - t;
+
+	for ( i = 0; i < n; i++ )
+		sum += A(i,i) + A(i, n - 1 - i);
+	printf("lu: n=%d threads=%d time=%.3f checksum=%.10e\n", n, nthr, t, sum);
+	return 0;
+}
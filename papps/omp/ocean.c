@@ -0,0 +1,79 @@
+/**
+ * Red-black SOR relaxation (SPLASH-2 OCEAN style) with OpenMP.
+ *
+ * Each sweep is a dynamic loop with a double residual reduction. The
+ * reduction is combined when the threads leave the loop, so with
+ * libdetgomp the residual, and the number of sweeps, is the same on every
+ * run.
+ *
+ * ex) ./ocean -n 258 -p 4
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <omp.h>
+
+static int n = 258;
+static double tol = 1e-7;
+static int max_iter = 1000;
+static double *g;
+
+#define G(i,j) g[(long)(i) * n + (j)]
+
+int main(int argc, char *argv[])
+{
+	int c, nthr = omp_get_max_threads();
+	int i, j, iter;
+	double t, res = 0, sum = 0;
+
+	while((c=getopt(argc, argv, "n:i:p:h")) != EOF) {
+		switch(c) {
+		case 'n': n = atoi(optarg); break;
+		case 'i': max_iter = atoi(optarg); break;
+		case 'p': nthr = atoi(optarg); break;
+		default:
+			printf("ocean [-n size] [-i max iteration] [-p threads]\n");
+			return 0;
+		}
+	}
+	omp_set_num_threads(nthr);
+
+	g = calloc((long)n * n, sizeof(double));
+	for ( i = 0; i < n; i++ ) {
+		G(i,0) = sin(i * M_PI / n);
+		G(i,n-1) = cos(i * M_PI / n);
+	}
+
+	t = omp_get_wtime();
+	for ( iter = 0; iter < max_iter; iter++ ) {
+		res = 0;
+		#pragma omp parallel private(j)
+		{
+			int color;
+			for ( color = 0; color < 2; color++ ) {
+				#pragma omp for schedule(dynamic, 4) reduction(+:res)
+				for ( i = 1; i < n - 1; i++ )
+					for ( j = 1 + (i + color) % 2; j < n - 1; j += 2 ) {
+						double v = 0.25 * (G(i-1,j) + G(i+1,j) +
+								   G(i,j-1) + G(i,j+1));
+						res += fabs(v - G(i,j)) * 1.0e-3;
+						G(i,j) += 1.2 * (v - G(i,j));
+					}
+			}
+		}
+		if ( res < tol )
+			break;
+	}
+	t = omp_get_wtime() - t;
+
+	for ( i = 0; i < n; i++ )
+		sum += G(i, i) + G(n / 2, i);
+	printf("ocean: n=%d threads=%d time=%.3f iter=%d residual=%.17e checksum=%.17e\n",
+	       n, nthr, t, iter, res, sum);
+	return 0;
+}
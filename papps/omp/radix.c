@@ -0,0 +1,93 @@
+/**
+ * Radix sort (SPLASH-2 RADIX style) with OpenMP.
+ *
+ * Per-thread histograms are built by a static loop, prefix sums are done
+ * in a single block and keys are scattered by a second static loop.
+ *
+ * ex) ./radix -n 4000000 -p 4
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+
+#define RADIX_BITS 8
+#define RADIX      (1 << RADIX_BITS)
+#define MAX_THR    64
+
+static long n = 4000000;
+static unsigned *key, *tmp;
+static long hist[MAX_THR][RADIX];
+
+int main(int argc, char *argv[])
+{
+	int c, nthr = omp_get_max_threads();
+	long i;
+	int shift;
+	unsigned long sum = 0;
+	double t;
+
+	while((c=getopt(argc, argv, "n:p:h")) != EOF) {
+		switch(c) {
+		case 'n': n = atol(optarg); break;
+		case 'p': nthr = atoi(optarg); break;
+		default:
+			printf("radix [-n keys] [-p threads]\n");
+			return 0;
+		}
+	}
+	if ( nthr > MAX_THR ) nthr = MAX_THR;
+	omp_set_num_threads(nthr);
+
+	key = malloc(sizeof(unsigned) * n);
+	tmp = malloc(sizeof(unsigned) * n);
+	for ( i = 0; i < n; i++ )
+		key[i] = (unsigned)(i * 2654435761UL) ^ (unsigned)(i >> 3);
+
+	t = omp_get_wtime();
+	for ( shift = 0; shift < 32; shift += RADIX_BITS ) {
+		#pragma omp parallel private(i)
+		{
+			int id = omp_get_thread_num(), nt = omp_get_num_threads();
+			long *h = hist[id];
+
+			memset(h, 0, sizeof(hist[0]));
+			#pragma omp for schedule(static)
+			for ( i = 0; i < n; i++ )
+				h[(key[i] >> shift) & (RADIX - 1)]++;
+
+			#pragma omp single
+			{
+				long base = 0;
+				int d, p;
+				for ( d = 0; d < RADIX; d++ )
+					for ( p = 0; p < nt; p++ ) {
+						long cnt = hist[p][d];
+						hist[p][d] = base;
+						base += cnt;
+					}
+			}
+
+			#pragma omp for schedule(static)
+			for ( i = 0; i < n; i++ )
+				tmp[h[(key[i] >> shift) & (RADIX - 1)]++] = key[i];
+		}
+		{ unsigned *s = key; key = tmp; tmp = s; }
+	}
+	t = omp_get_wtime() - t;
+
+	for ( i = 1; i < n; i++ )
+		if ( key[i-1] > key[i] ) {
+			printf("radix: not sorted at %ld\n", i);
+			return 1;
+		}
+	for ( i = 0; i < n; i += n / 1000 + 1 )
+		sum = sum * 31 + key[i];
+	printf("radix: n=%ld threads=%d time=%.3f checksum=%lu\n", n, nthr, t, sum);
+	return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * N-body force computation (SPLASH-2 WATER-NSQUARED style) with OpenMP.
+ *
+ * Pairwise forces are computed by a guided loop and the potential energy
+ * is accumulated in a critical section, so the floating point sum depends
+ * on the order threads enter it.
+ *
+ * ex) ./water -n 2048 -s 5 -p 4
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <omp.h>
+
+static int n = 2048;
+static int steps = 5;
+static double (*pos)[3], (*vel)[3], (*force)[3];
+
+int main(int argc, char *argv[])
+{
+	int c, nthr = omp_get_max_threads();
+	int i, s;
+	double t, pot = 0, sum = 0;
+
+	while((c=getopt(argc, argv, "n:s:p:h")) != EOF) {
+		switch(c) {
+		case 'n': n = atoi(optarg); break;
+		case 's': steps = atoi(optarg); break;
+		case 'p': nthr = atoi(optarg); break;
+		default:
+			printf("water [-n molecules] [-s steps] [-p threads]\n");
+			return 0;
+		}
+	}
+	omp_set_num_threads(nthr);
+
+	pos = malloc(sizeof(*pos) * n);
+	vel = calloc(n, sizeof(*vel));
+	force = malloc(sizeof(*force) * n);
+	for ( i = 0; i < n; i++ ) {
+		pos[i][0] = (i % 16) * 1.1;
+		pos[i][1] = ((i / 16) % 16) * 1.1;
+		pos[i][2] = (i / 256) * 1.1 + 0.01 * (i % 7);
+	}
+
+	t = omp_get_wtime();
+	for ( s = 0; s < steps; s++ ) {
+		pot = 0;
+		#pragma omp parallel
+		{
+			double my_pot = 0;
+			int j;
+
+			#pragma omp for schedule(guided, 8) nowait
+			for ( i = 0; i < n; i++ ) {
+				double f[3] = { 0, 0, 0 };
+				for ( j = 0; j < n; j++ ) {
+					double d[3], r2, r6, ff;
+					int k;
+					if ( j == i ) continue;
+					for ( k = 0; k < 3; k++ )
+						d[k] = pos[i][k] - pos[j][k];
+					r2 = d[0]*d[0] + d[1]*d[1] + d[2]*d[2] + 0.01;
+					r6 = 1.0 / (r2 * r2 * r2);
+					ff = (12 * r6 * r6 - 6 * r6) / r2;
+					for ( k = 0; k < 3; k++ )
+						f[k] += ff * d[k];
+					my_pot += 0.5 * (r6 * r6 - r6);
+				}
+				for ( j = 0; j < 3; j++ )
+					force[i][j] = f[j];
+			}
+
+			#pragma omp critical
+			pot += my_pot;
+
+			#pragma omp barrier
+
+			#pragma omp for schedule(static)
+			for ( i = 0; i < n; i++ ) {
+				int k;
+				for ( k = 0; k < 3; k++ ) {
+					vel[i][k] += 1e-4 * force[i][k];
+					pos[i][k] += 1e-4 * vel[i][k];
+				}
+			}
+		}
+	}
+	t = omp_get_wtime() - t;
+
+	for ( i = 0; i < n; i++ )
+		sum += pos[i][0] + pos[i][1] + pos[i][2];
+	printf("water: n=%d threads=%d time=%.3f potential=%.17e checksum=%.17e\n",
+	       n, nthr, t, pot, sum);
+	return 0;
+}
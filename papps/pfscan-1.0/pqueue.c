@@ -18,6 +18,43 @@
 
 #include "pqueue.h"
 
+#if DET_QUEUE
+
+int
+pqueue_init(PQUEUE *qp,
+	   int qsize)
+{
+    return det_queue_init(&qp->q, qsize) == 0 ? 0 : -1;
+}
+
+void
+pqueue_close(PQUEUE *qp)
+{
+    det_queue_close(&qp->q);
+}
+
+int
+pqueue_put(PQUEUE *qp,
+	  void *item)
+{
+    return det_queue_put(&qp->q, item) == 0;
+}
+
+int
+pqueue_get(PQUEUE *qp,
+	   void **item)
+{
+    return det_queue_get(&qp->q, item) == 0;
+}
+
+void
+pqueue_destroy(PQUEUE *qp)
+{
+    det_queue_destroy(&qp->q);
+}
+
+#else
+
 int
 pqueue_init(PQUEUE *qp,
 	   int qsize)
@@ -125,3 +162,5 @@ pqueue_destroy(PQUEUE *qp)
     pthread_cond_destroy(&qp->less);
     free(qp->buf);
 }
+
+#endif
@@ -15,6 +15,16 @@
 #ifndef PLIB_PQUEUE_H
 #define PLIB_PQUEUE_H
 
+#ifndef DET_QUEUE
+#define DET_QUEUE 1	/* det_queue_t: one turn per put/get */
+#endif
+
+#if DET_QUEUE
+typedef struct
+{
+    det_queue_t q;
+} PQUEUE;
+#else
 typedef struct
 {
     void **buf;
@@ -27,6 +37,7 @@ typedef struct
     pthread_cond_t more;
     pthread_cond_t less;
 } PQUEUE;
+#endif
 
 
 extern int
@@ -0,0 +1,856 @@
+/**
+ * Deterministic OpenMP runtime
+ *
+ * A subset of the libgomp ABI implemented on dpthread. Compile OpenMP
+ * code with -fopenmp -fno-inline-atomics but link with -ldetgomp -ldpthread
+ * instead of libgomp.
+ *
+ * - parallel regions run on a pool of det_create()d threads.
+ * - barriers, critical, atomic and single are det_barrier/det_lock.
+ * - dynamic/guided chunks are handed out under a det_lock, that is, in
+ *   logical clock order.
+ * - threads leave a dynamic/guided/runtime loop in thread number order, so
+ *   the reduction code the compiler puts between the loop and
+ *   GOMP_loop_end() combines in a fixed order. loops with an inlined static
+ *   schedule don't call the runtime at the end; gcc combines their
+ *   reductions with __atomic builtins, which -fno-inline-atomics turns into
+ *   the libatomic calls at the end of this file, taken in logical clock
+ *   order like det_atomic_*().
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+
+#include <sys/time.h>
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include <dpthread.h>
+
+#define GOMP_MAX_THR  (MAX_THR - 1) // the master is not in the pool
+#define WS_RING       16            // work shares a nowait loop can run ahead
+
+// schedule of GOMP_loop_start() and OMP_SCHEDULE
+enum { GFS_RUNTIME, GFS_STATIC, GFS_DYNAMIC, GFS_GUIDED, GFS_AUTO };
+#define GFS_MONOTONIC 0x80000000U
+
+// a work share: loop or single
+struct gomp_ws {
+	volatile int gen;  // work share number in the region. -1 - free
+	int sched;
+	long start, next, end, incr, chunk;
+	volatile int exit_turn; // thread allowed to leave the loop
+	int refs;          // threads not done with it. the slot is reused at 0
+};
+
+static struct {
+	void (*fn)(void *);
+	void *data;
+	int nthreads;
+	int prestarted;        // GOMP_parallel_loop_*() set up ws[0]
+
+	det_barrier_t dock;    // the pool waits here for a region
+	det_barrier_t barrier; // implicit and explicit barriers
+	det_mutex_t lock;      // work shares
+	det_cond_t exit_cond;
+
+	struct gomp_ws ws[WS_RING];
+
+	pthread_t pool[GOMP_MAX_THR];
+	int pool_size;         // including the master
+} team;
+
+static det_mutex_t critical_lock;
+static det_mutex_t atomic_lock;
+static det_mutex_t name_lock;   // named critical sections
+
+static int gomp_initialized = 0;
+static int max_threads;
+static int run_sched = GFS_DYNAMIC;
+static long run_chunk = 1;
+
+static __thread int omp_tid = 0;
+static __thread int team_size = 1;
+static __thread int omp_level = 0;
+static __thread int ws_count;
+static __thread struct gomp_ws *cur_ws;
+static __thread struct gomp_ws serial_ws; // team of one
+static __thread long static_trip;
+
+///////////////////////////////////////////////////////////////////////////////////
+// internal function
+///////////////////////////////////////////////////////////////////////////////////
+
+static void gomp_init(void)
+{
+	/*
+	   Environment variables:
+	   OMP_NUM_THREADS <number>    # team size (default: number of cpus)
+	   OMP_SCHEDULE <kind[,chunk]> # schedule(runtime). static, dynamic or guided
+	*/
+	char *ptr;
+
+	if ( gomp_initialized ) return;
+	gomp_initialized = 1;
+
+	max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if ( (ptr = getenv("OMP_NUM_THREADS")) )
+		max_threads = atoi(ptr);
+	if ( max_threads < 1 ) max_threads = 1;
+	if ( max_threads > GOMP_MAX_THR ) max_threads = GOMP_MAX_THR;
+
+	if ( (ptr = getenv("OMP_SCHEDULE")) ) {
+		if ( !strncasecmp(ptr, "static", 6) )
+			run_sched = GFS_STATIC;
+		else if ( !strncasecmp(ptr, "guided", 6) )
+			run_sched = GFS_GUIDED;
+		else
+			run_sched = GFS_DYNAMIC;
+		if ( (ptr = strchr(ptr, ',')) )
+			run_chunk = atol(ptr + 1);
+		if ( run_chunk < 1 && run_sched != GFS_STATIC )
+			run_chunk = 1;
+	}
+
+	det_lock_init(&critical_lock);
+	det_lock_init(&atomic_lock);
+	det_lock_init(&name_lock);
+}
+
+static void region_begin(int tid)
+{
+	omp_tid = tid;
+	team_size = team.nthreads;
+	omp_level = 1;
+	ws_count = team.prestarted;
+	cur_ws = team.prestarted ? &team.ws[0] : NULL;
+	static_trip = 0;
+}
+
+static void region_end(void)
+{
+	omp_tid = 0;
+	team_size = 1;
+	omp_level = 0;
+}
+
+static void *pool_worker(void *v)
+{
+	int tid = (long)v;
+
+	while ( 1 ) {
+		det_barrier_wait(&team.dock);
+		if ( !team.fn )
+			break; // pool is resized
+		region_begin(tid);
+		team.fn(team.data);
+		det_barrier_wait(&team.barrier);
+		region_end();
+	}
+	return NULL;
+}
+
+/**
+ * threads are kept between regions of the same size.
+ */
+static void pool_resize(int n)
+{
+	long i;
+
+	if ( team.pool_size == n )
+		return;
+
+	if ( team.pool_size > 1 ) {
+		team.fn = NULL;
+		det_barrier_wait(&team.dock);
+		for ( i = 1; i < team.pool_size; i++ )
+			det_join(team.pool[i], NULL);
+	}
+	if ( team.pool_size > 0 ) {
+		det_barrier_destroy(&team.dock);
+		det_barrier_destroy(&team.barrier);
+		det_lock_destroy(&team.lock);
+		det_cond_destroy(&team.exit_cond);
+	}
+
+	team.pool_size = n;
+	det_barrier_init(&team.dock, n);
+	det_barrier_init(&team.barrier, n);
+	det_lock_init(&team.lock);
+	det_cond_init(&team.exit_cond);
+
+	for ( i = 1; i < n; i++ )
+		det_create(&team.pool[i], NULL, pool_worker, (void *)i);
+}
+
+static void ws_setup(struct gomp_ws *ws, int gen, long start, long end,
+		     long incr, int sched, long chunk)
+{
+	sched &= ~GFS_MONOTONIC;
+	if ( sched == GFS_RUNTIME ) {
+		sched = run_sched;
+		chunk = run_chunk;
+	} else if ( sched == GFS_AUTO ) {
+		sched = GFS_STATIC;
+		chunk = 0;
+	}
+	if ( sched != GFS_STATIC && chunk < 1 )
+		chunk = 1;
+
+	ws->sched = sched;
+	ws->start = ws->next = start;
+	ws->end   = end;
+	ws->incr  = incr;
+	ws->chunk = chunk;
+	ws->exit_turn = 0;
+	ws->refs  = team.nthreads;
+	ws->gen   = gen;
+}
+
+static void parallel_start(void (*fn)(void *), void *data, unsigned num_threads)
+{
+	int i, n;
+
+	gomp_init();
+
+	n = num_threads ? num_threads : max_threads;
+	if ( n > GOMP_MAX_THR ) n = GOMP_MAX_THR;
+
+	pool_resize(n);
+
+	team.fn = fn;
+	team.data = data;
+	team.nthreads = n;
+	for ( i = 0; i < WS_RING; i++ ) {
+		team.ws[i].gen = -1;
+		team.ws[i].refs = 0;
+	}
+	team.prestarted = 0;
+}
+
+static void parallel_run(void)
+{
+	if ( team.nthreads > 1 )
+		det_barrier_wait(&team.dock);
+	region_begin(0);
+}
+
+static void parallel_end(void)
+{
+	if ( team.nthreads > 1 )
+		det_barrier_wait(&team.barrier);
+	region_end();
+}
+
+/**
+ * nested regions are run by a team of one.
+ */
+static void parallel_serial(void (*fn)(void *), void *data, struct gomp_ws *ws)
+{
+	int tid = omp_tid, size = team_size, count = ws_count;
+	struct gomp_ws *saved_ws = cur_ws, saved_serial = serial_ws;
+	long trip = static_trip;
+
+	omp_tid = 0;
+	team_size = 1;
+	omp_level ++;
+	ws_count = ws ? 1 : 0;
+	cur_ws = ws ? &serial_ws : NULL;
+	if ( ws ) serial_ws = *ws;
+	static_trip = 0;
+
+	fn(data);
+
+	omp_tid = tid;
+	team_size = size;
+	omp_level --;
+	ws_count = count;
+	cur_ws = saved_ws;
+	serial_ws = saved_serial;
+	static_trip = trip;
+}
+
+static void parallel_loop(void (*fn)(void *), void *data, unsigned num_threads,
+			  long start, long end, long incr, int sched, long chunk)
+{
+	if ( omp_level > 0 ) {
+		struct gomp_ws ws;
+		ws_setup(&ws, 0, start, end, incr, sched, chunk);
+		parallel_serial(fn, data, &ws);
+		return;
+	}
+	parallel_start(fn, data, num_threads);
+	ws_setup(&team.ws[0], 0, start, end, incr, sched, chunk);
+	team.prestarted = 1;
+	parallel_run();
+	fn(data);
+	parallel_end();
+}
+
+/**
+ * the first thread to arrive sets up the work share. returns true for it.
+ * a thread that ran WS_RING work shares ahead waits until the last one is
+ * done with the slot. a single is done here; a loop in loop_done().
+ */
+static bool ws_start(long start, long end, long incr, int sched, long chunk,
+		     bool single)
+{
+	int idx = ws_count++;
+	struct gomp_ws *ws;
+	bool first = false;
+
+	static_trip = 0;
+	if ( team_size == 1 ) {
+		cur_ws = &serial_ws;
+		ws_setup(cur_ws, idx, start, end, incr, sched, chunk);
+		return true;
+	}
+
+	ws = &team.ws[idx % WS_RING];
+	det_lock(&team.lock);
+	while ( ws->gen != idx && ws->refs > 0 )
+		det_cond_wait(&team.exit_cond, &team.lock);
+	if ( ws->gen != idx ) {
+		ws_setup(ws, idx, start, end, incr, sched, chunk);
+		first = true;
+	}
+	if ( single && --ws->refs == 0 )
+		det_cond_broadcast(&team.exit_cond);
+	det_unlock(&team.lock);
+
+	cur_ws = ws;
+	return first;
+}
+
+static long ws_iterations(struct gomp_ws *ws, long from)
+{
+	if ( ws->incr > 0 )
+		return from >= ws->end ? 0 : (ws->end - from + ws->incr - 1) / ws->incr;
+	else
+		return from <= ws->end ? 0 : (ws->end - from + ws->incr + 1) / ws->incr;
+}
+
+static bool static_next(struct gomp_ws *ws, long *istart, long *iend)
+{
+	long n = ws_iterations(ws, ws->start);
+	long s, e;
+
+	if ( ws->chunk <= 0 ) {
+		// one block per thread
+		long q = n / team_size, r = n % team_size;
+		if ( static_trip > 0 )
+			return false;
+		s = omp_tid * q + (omp_tid < r ? omp_tid : r);
+		e = s + q + (omp_tid < r ? 1 : 0);
+	} else {
+		// round robin chunks
+		s = (static_trip * team_size + omp_tid) * ws->chunk;
+		e = s + ws->chunk;
+		if ( e > n ) e = n;
+	}
+	static_trip ++;
+	if ( s >= e )
+		return false;
+
+	*istart = ws->start + s * ws->incr;
+	*iend   = ws->start + e * ws->incr;
+	return true;
+}
+
+static bool dynamic_next(struct gomp_ws *ws, long *istart, long *iend)
+{
+	long n = ws_iterations(ws, ws->next);
+	long q = ws->chunk;
+
+	if ( n == 0 )
+		return false;
+
+	if ( ws->sched == GFS_GUIDED ) {
+		q = (n + team_size - 1) / team_size;
+		if ( q < ws->chunk ) q = ws->chunk;
+	}
+	if ( q > n ) q = n;
+
+	*istart = ws->next;
+	*iend   = ws->next + q * ws->incr;
+	ws->next = *iend;
+	return true;
+}
+
+/**
+ * leave the loop after the thread before me did.
+ */
+static void loop_exit(struct gomp_ws *ws)
+{
+	det_lock(&team.lock);
+	while ( ws->exit_turn != omp_tid )
+		det_cond_wait(&team.exit_cond, &team.lock);
+	det_unlock(&team.lock);
+}
+
+static bool loop_next(long *istart, long *iend)
+{
+	struct gomp_ws *ws = cur_ws;
+	bool ret;
+
+	if ( team_size == 1 ) {
+		return ws->sched == GFS_STATIC ?
+			static_next(ws, istart, iend) :
+			dynamic_next(ws, istart, iend);
+	}
+
+	if ( ws->sched == GFS_STATIC ) {
+		ret = static_next(ws, istart, iend);
+	} else {
+		// chunks are handed out in logical clock order
+		det_lock(&team.lock);
+		ret = dynamic_next(ws, istart, iend);
+		det_unlock(&team.lock);
+	}
+	if ( !ret )
+		loop_exit(ws);
+	return ret;
+}
+
+static void loop_done(void)
+{
+	struct gomp_ws *ws = cur_ws;
+
+	if ( team_size == 1 )
+		return;
+
+	det_lock(&team.lock);
+	ws->exit_turn ++;
+	ws->refs --;
+	det_cond_broadcast(&team.exit_cond);
+	det_unlock(&team.lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// libgomp ABI: parallel, barrier, critical, atomic, single
+///////////////////////////////////////////////////////////////////////////////////
+
+void GOMP_parallel_start(void (*fn)(void *), void *data, unsigned num_threads)
+{
+	parallel_start(fn, data, num_threads);
+	parallel_run();
+}
+
+void GOMP_parallel_end(void)
+{
+	parallel_end();
+}
+
+void GOMP_parallel(void (*fn)(void *), void *data, unsigned num_threads,
+		   unsigned flags)
+{
+	if ( omp_level > 0 ) {
+		parallel_serial(fn, data, NULL);
+		return;
+	}
+	GOMP_parallel_start(fn, data, num_threads);
+	fn(data);
+	GOMP_parallel_end();
+}
+
+void GOMP_barrier(void)
+{
+	if ( team_size > 1 )
+		det_barrier_wait(&team.barrier);
+}
+
+bool GOMP_barrier_cancel(void)
+{
+	GOMP_barrier();
+	return false;
+}
+
+void GOMP_critical_start(void)
+{
+	gomp_init();
+	det_lock(&critical_lock);
+}
+
+void GOMP_critical_end(void)
+{
+	det_unlock(&critical_lock);
+}
+
+void GOMP_critical_name_start(void **pptr)
+{
+	det_mutex_t *mutex;
+
+	gomp_init();
+
+	// always taken, so that the number of sync operations is the same.
+	det_lock(&name_lock);
+	if ( !(mutex = *pptr) ) {
+		if ( !(mutex = malloc(sizeof(det_mutex_t))) )
+			err(1, "GOMP_critical_name_start");
+		det_lock_init(mutex);
+		*pptr = mutex;
+	}
+	det_unlock(&name_lock);
+
+	det_lock(mutex);
+}
+
+void GOMP_critical_name_end(void **pptr)
+{
+	det_unlock((det_mutex_t *)*pptr);
+}
+
+void GOMP_atomic_start(void)
+{
+	gomp_init();
+	det_lock(&atomic_lock);
+}
+
+void GOMP_atomic_end(void)
+{
+	det_unlock(&atomic_lock);
+}
+
+bool GOMP_single_start(void)
+{
+	return ws_start(0, 0, 1, GFS_STATIC, 0, true);
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// libgomp ABI: loops
+///////////////////////////////////////////////////////////////////////////////////
+
+bool GOMP_loop_static_start(long start, long end, long incr, long chunk_size,
+			    long *istart, long *iend)
+{
+	ws_start(start, end, incr, GFS_STATIC, chunk_size, false);
+	return loop_next(istart, iend);
+}
+
+bool GOMP_loop_dynamic_start(long start, long end, long incr, long chunk_size,
+			     long *istart, long *iend)
+{
+	ws_start(start, end, incr, GFS_DYNAMIC, chunk_size, false);
+	return loop_next(istart, iend);
+}
+
+bool GOMP_loop_guided_start(long start, long end, long incr, long chunk_size,
+			    long *istart, long *iend)
+{
+	ws_start(start, end, incr, GFS_GUIDED, chunk_size, false);
+	return loop_next(istart, iend);
+}
+
+bool GOMP_loop_runtime_start(long start, long end, long incr,
+			     long *istart, long *iend)
+{
+	ws_start(start, end, incr, GFS_RUNTIME, 0, false);
+	return loop_next(istart, iend);
+}
+
+bool GOMP_loop_start(long start, long end, long incr, long sched,
+		     long chunk_size, long *istart, long *iend,
+		     uintptr_t *reductions, void **mem)
+{
+	if ( reductions || mem )
+		errx(1, "GOMP_loop_start: task reductions are not supported");
+	ws_start(start, end, incr, sched, chunk_size, false);
+	return loop_next(istart, iend);
+}
+
+bool GOMP_loop_static_next(long *istart, long *iend)
+{
+	return loop_next(istart, iend);
+}
+
+bool GOMP_loop_dynamic_next(long *istart, long *iend)
+{
+	return loop_next(istart, iend);
+}
+
+bool GOMP_loop_guided_next(long *istart, long *iend)
+{
+	return loop_next(istart, iend);
+}
+
+bool GOMP_loop_runtime_next(long *istart, long *iend)
+{
+	return loop_next(istart, iend);
+}
+
+// OpenMP 5.0 names emitted by gcc 9 and later
+bool GOMP_loop_nonmonotonic_dynamic_start(long start, long end, long incr,
+					  long chunk_size, long *istart, long *iend)
+	__attribute__((alias("GOMP_loop_dynamic_start")));
+bool GOMP_loop_nonmonotonic_guided_start(long start, long end, long incr,
+					 long chunk_size, long *istart, long *iend)
+	__attribute__((alias("GOMP_loop_guided_start")));
+bool GOMP_loop_maybe_nonmonotonic_runtime_start(long start, long end, long incr,
+						long *istart, long *iend)
+	__attribute__((alias("GOMP_loop_runtime_start")));
+bool GOMP_loop_nonmonotonic_runtime_start(long start, long end, long incr,
+					  long *istart, long *iend)
+	__attribute__((alias("GOMP_loop_runtime_start")));
+bool GOMP_loop_nonmonotonic_dynamic_next(long *istart, long *iend)
+	__attribute__((alias("GOMP_loop_dynamic_next")));
+bool GOMP_loop_nonmonotonic_guided_next(long *istart, long *iend)
+	__attribute__((alias("GOMP_loop_guided_next")));
+bool GOMP_loop_maybe_nonmonotonic_runtime_next(long *istart, long *iend)
+	__attribute__((alias("GOMP_loop_runtime_next")));
+bool GOMP_loop_nonmonotonic_runtime_next(long *istart, long *iend)
+	__attribute__((alias("GOMP_loop_runtime_next")));
+
+void GOMP_loop_end(void)
+{
+	loop_done();
+	GOMP_barrier();
+}
+
+void GOMP_loop_end_nowait(void)
+{
+	loop_done();
+}
+
+bool GOMP_loop_end_cancel(void)
+{
+	GOMP_loop_end();
+	return false;
+}
+
+void GOMP_parallel_loop_static(void (*fn)(void *), void *data,
+			       unsigned num_threads, long start, long end,
+			       long incr, long chunk_size, unsigned flags)
+{
+	parallel_loop(fn, data, num_threads, start, end, incr, GFS_STATIC, chunk_size);
+}
+
+void GOMP_parallel_loop_dynamic(void (*fn)(void *), void *data,
+				unsigned num_threads, long start, long end,
+				long incr, long chunk_size, unsigned flags)
+{
+	parallel_loop(fn, data, num_threads, start, end, incr, GFS_DYNAMIC, chunk_size);
+}
+
+void GOMP_parallel_loop_guided(void (*fn)(void *), void *data,
+			       unsigned num_threads, long start, long end,
+			       long incr, long chunk_size, unsigned flags)
+{
+	parallel_loop(fn, data, num_threads, start, end, incr, GFS_GUIDED, chunk_size);
+}
+
+void GOMP_parallel_loop_runtime(void (*fn)(void *), void *data,
+				unsigned num_threads, long start, long end,
+				long incr, unsigned flags)
+{
+	parallel_loop(fn, data, num_threads, start, end, incr, GFS_RUNTIME, 0);
+}
+
+void GOMP_parallel_loop_nonmonotonic_dynamic(void (*fn)(void *), void *data,
+					     unsigned num_threads, long start, long end,
+					     long incr, long chunk_size, unsigned flags)
+	__attribute__((alias("GOMP_parallel_loop_dynamic")));
+void GOMP_parallel_loop_nonmonotonic_guided(void (*fn)(void *), void *data,
+					    unsigned num_threads, long start, long end,
+					    long incr, long chunk_size, unsigned flags)
+	__attribute__((alias("GOMP_parallel_loop_guided")));
+void GOMP_parallel_loop_maybe_nonmonotonic_runtime(void (*fn)(void *), void *data,
+						   unsigned num_threads, long start,
+						   long end, long incr, unsigned flags)
+	__attribute__((alias("GOMP_parallel_loop_runtime")));
+void GOMP_parallel_loop_nonmonotonic_runtime(void (*fn)(void *), void *data,
+					     unsigned num_threads, long start,
+					     long end, long incr, unsigned flags)
+	__attribute__((alias("GOMP_parallel_loop_runtime")));
+
+///////////////////////////////////////////////////////////////////////////////////
+// OpenMP API
+///////////////////////////////////////////////////////////////////////////////////
+
+int omp_get_thread_num(void)
+{
+	return omp_tid;
+}
+
+int omp_get_num_threads(void)
+{
+	return team_size;
+}
+
+int omp_get_max_threads(void)
+{
+	gomp_init();
+	return max_threads;
+}
+
+void omp_set_num_threads(int n)
+{
+	gomp_init();
+	max_threads = n < 1 ? 1 : (n > GOMP_MAX_THR ? GOMP_MAX_THR : n);
+}
+
+int omp_get_num_procs(void)
+{
+	return sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+int omp_in_parallel(void)
+{
+	return team_size > 1;
+}
+
+int omp_get_level(void)
+{
+	return omp_level;
+}
+
+void omp_set_dynamic(int val) { }
+int  omp_get_dynamic(void) { return 0; }
+void omp_set_nested(int val) { }
+int  omp_get_nested(void) { return 0; }
+
+double omp_get_wtime(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+double omp_get_wtick(void)
+{
+	return 1e-6;
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// libatomic ABI (build OpenMP code with -fno-inline-atomics)
+///////////////////////////////////////////////////////////////////////////////////
+
+// gcc declares the __atomic_* names as builtins, so the functions get them
+// through asm labels.
+#define GOMP_ATOMIC_FN(ret, name, n, args)				\
+	ret gomp_atomic_##name##_##n args __asm__("__atomic_" #name "_" #n); \
+	ret gomp_atomic_##name##_##n args
+
+#define GOMP_ATOMIC(n, bits)						\
+GOMP_ATOMIC_FN(uint##bits##_t, load, n, (volatile void *p, int mo))	\
+{									\
+	return det_atomic_load_##bits(p);				\
+}									\
+GOMP_ATOMIC_FN(void, store, n, (volatile void *p, uint##bits##_t v, int mo)) \
+{									\
+	det_atomic_exchange_##bits(p, v);				\
+}									\
+GOMP_ATOMIC_FN(uint##bits##_t, exchange, n,				\
+	       (volatile void *p, uint##bits##_t v, int mo))		\
+{									\
+	return det_atomic_exchange_##bits(p, v);			\
+}									\
+GOMP_ATOMIC_FN(bool, compare_exchange, n,				\
+	       (volatile void *p, void *e, uint##bits##_t v, int smo, int fmo)) \
+{									\
+	int##bits##_t old = *(int##bits##_t *)e;			\
+	int##bits##_t cur = det_atomic_cas_##bits(p, old, v);		\
+	if ( cur == old )						\
+		return true;						\
+	*(int##bits##_t *)e = cur;					\
+	return false;							\
+}									\
+GOMP_ATOMIC_FN(uint##bits##_t, fetch_add, n,				\
+	       (volatile void *p, uint##bits##_t v, int mo))		\
+{									\
+	return det_atomic_fetch_add_##bits(p, v);			\
+}									\
+GOMP_ATOMIC_FN(uint##bits##_t, fetch_sub, n,				\
+	       (volatile void *p, uint##bits##_t v, int mo))		\
+{									\
+	return det_atomic_fetch_add_##bits(p, -v);			\
+}									\
+GOMP_ATOMIC_FN(uint##bits##_t, fetch_and, n,				\
+	       (volatile void *p, uint##bits##_t v, int mo))		\
+{									\
+	return det_atomic_fetch_and_##bits(p, v);			\
+}									\
+GOMP_ATOMIC_FN(uint##bits##_t, fetch_or, n,				\
+	       (volatile void *p, uint##bits##_t v, int mo))		\
+{									\
+	return det_atomic_fetch_or_##bits(p, v);			\
+}									\
+GOMP_ATOMIC_FN(uint##bits##_t, fetch_xor, n,				\
+	       (volatile void *p, uint##bits##_t v, int mo))		\
+{									\
+	int##bits##_t old = det_atomic_load_##bits(p), cur;		\
+	while ( (cur = det_atomic_cas_##bits(p, old, old ^ v)) != old )	\
+		old = cur;						\
+	return old;							\
+}									\
+GOMP_ATOMIC_FN(uint##bits##_t, add_fetch, n,				\
+	       (volatile void *p, uint##bits##_t v, int mo))		\
+{									\
+	return det_atomic_fetch_add_##bits(p, v) + v;			\
+}									\
+GOMP_ATOMIC_FN(uint##bits##_t, sub_fetch, n,				\
+	       (volatile void *p, uint##bits##_t v, int mo))		\
+{									\
+	return det_atomic_fetch_add_##bits(p, -v) - v;			\
+}									\
+GOMP_ATOMIC_FN(uint##bits##_t, and_fetch, n,				\
+	       (volatile void *p, uint##bits##_t v, int mo))		\
+{									\
+	return det_atomic_fetch_and_##bits(p, v) & v;			\
+}									\
+GOMP_ATOMIC_FN(uint##bits##_t, or_fetch, n,				\
+	       (volatile void *p, uint##bits##_t v, int mo))		\
+{									\
+	return det_atomic_fetch_or_##bits(p, v) | v;			\
+}
+
+// the sized names for 1 and 2 byte words, on top of the *_n() calls. 
+#define GOMP_ATOMIC_N(n, bits)						\
+static inline int##bits##_t det_atomic_load_##bits(volatile void *p)	\
+{									\
+	return det_atomic_load_n(p, n);					\
+}									\
+static inline int##bits##_t det_atomic_fetch_add_##bits(volatile void *p, \
+							int##bits##_t v) \
+{									\
+	return det_atomic_fetch_add_n(p, n, v);				\
+}									\
+static inline int##bits##_t det_atomic_fetch_and_##bits(volatile void *p, \
+							int##bits##_t v) \
+{									\
+	return det_atomic_fetch_and_n(p, n, v);				\
+}									\
+static inline int##bits##_t det_atomic_fetch_or_##bits(volatile void *p, \
+						       int##bits##_t v)	\
+{									\
+	return det_atomic_fetch_or_n(p, n, v);				\
+}									\
+static inline int##bits##_t det_atomic_exchange_##bits(volatile void *p, \
+						       int##bits##_t v)	\
+{									\
+	return det_atomic_exchange_n(p, n, v);				\
+}									\
+static inline int##bits##_t det_atomic_cas_##bits(volatile void *p,	\
+						  int##bits##_t o,	\
+						  int##bits##_t v)	\
+{									\
+	return det_atomic_cas_n(p, n, o, v);				\
+}
+
+GOMP_ATOMIC_N(1, 8)
+GOMP_ATOMIC_N(2, 16)
+
+// there is no 16 byte det_atomic call, so __atomic_*_16 stay with 
+// libatomic: a kernel that uses them does not link. 
+GOMP_ATOMIC(1, 8)
+GOMP_ATOMIC(2, 16)
+GOMP_ATOMIC(4, 32)
+GOMP_ATOMIC(8, 64)
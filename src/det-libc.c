@@ -46,8 +46,9 @@ extern uint64_t det_get_clock();
 
 #include <sys/socket.h>
 
+#include <dpthread-io.h> // EVENTS_PER_USEC 
+
 #define USE_DET_TIME_OPT 0
-#define EVENTS_PER_USEC 122 // average store events per 1 usec. 
 
 #if USE_DET_TIME_OPT
   #define EVENTS_read 106272 // (761*EVENTS_PER_USEC)
@@ -0,0 +1,371 @@
+/**
+ * Deterministic task pool
+ *
+ * Each worker has a deque of tasks in two parts. The owner pushes and pops
+ * at the bottom, the private part, with no turn and no lock. The top part
+ * is public: thieves take from it and it changes only under the pool lock,
+ * i.e. at turns.
+ *
+ * - when the private part reaches DET_POOL_BATCH tasks, the owner publishes
+ *   the older half of it in one turn.
+ * - det_sync() publishes the older half of what is left below a batch, and
+ *   det_pool_publish() all of it, so a short private part is not kept from
+ *   idle workers.
+ * - a worker whose private part is empty takes one turn to reclaim half of
+ *   its own public part or, if that is empty, to steal half of the public
+ *   part of the first victim in the order w+1, w+2, ... that has any.
+ *
+ * The public parts change only at turns, so which task runs on which
+ * worker is the same on every run.
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <dpthread.h>
+
+#define DET_POOL_BATCH  8   // private tasks that make the owner publish
+#define DET_POOL_SLOTS  64  // initial deque size. doubles when full
+
+#define SLOT(d, i) ((d)->task[(i) % (d)->size])
+
+static det_deque_t *my_deque(det_pool_t *pool)
+{
+	int w = pool->worker[det_get_pid()] - 1;
+
+	return w < 0 ? NULL : &pool->deque[w];
+}
+
+/**
+ * under the pool lock: the public part may be in use by thieves.
+ */
+static int deque_grow(det_deque_t *d)
+{
+	det_task_t *task;
+	long i, size = d->size * 2;
+
+	if ( !(task = calloc(size, sizeof(det_task_t))) )
+		return ENOMEM;
+	for ( i = d->top; i < d->bottom; i++ )
+		task[i % size] = SLOT(d, i);
+	free(d->task);
+	d->task = task;
+	d->size = size;
+	return 0;
+}
+
+/**
+ * under the pool lock: make the n oldest private tasks public.
+ */
+static void publish_locked(det_pool_t *pool, det_deque_t *d, long n)
+{
+	d->split += n;
+	d->top_seen = d->top;
+	if ( pool->idle > 0 )
+		det_cond_broadcast(&pool->work);
+}
+
+static void publish(det_pool_t *pool, det_deque_t *d)
+{
+	det_lock(&pool->lock);
+	publish_locked(pool, d, (d->bottom - d->split) / 2);
+	det_unlock(&pool->lock);
+}
+
+static int push(det_pool_t *pool, det_deque_t *d, det_task_t *t)
+{
+	int ret = 0;
+
+	if ( d->bottom - d->top_seen >= d->size ) {
+		// full as of my last turn. see what the thieves took since.
+		det_lock(&pool->lock);
+		d->top_seen = d->top;
+		if ( d->bottom - d->top >= d->size )
+			ret = deque_grow(d);
+		det_unlock(&pool->lock);
+		if ( ret )
+			return ret;
+	}
+	SLOT(d, d->bottom) = *t;
+	d->bottom++;
+
+	if ( d->bottom - d->split >= DET_POOL_BATCH )
+		publish(pool, d);
+	return 0;
+}
+
+static int pop_private(det_deque_t *d, det_task_t *t)
+{
+	if ( d->bottom <= d->split )
+		return 0;
+	d->bottom--;
+	*t = SLOT(d, d->bottom);
+	return 1;
+}
+
+/**
+ * in my turn: reclaim or steal half of a public part into my private part
+ * and pop one of them.
+ */
+static int take_locked(det_pool_t *pool, int w, det_task_t *t)
+{
+	det_deque_t *d = &pool->deque[w], *v;
+	long n;
+	int i;
+
+	d->top_seen = d->top;
+	if ( d->split > d->top ) {
+		d->split -= (d->split - d->top + 1) / 2;
+		return pop_private(d, t);
+	}
+
+	for ( i = 1; i < pool->nworkers; i++ ) {
+		v = &pool->deque[(w + i) % pool->nworkers];
+		if ( v->split <= v->top )
+			continue;
+		// oldest first; my deque is empty.
+		for ( n = (v->split - v->top + 1) / 2; n > 0; n-- ) {
+			if ( d->bottom - d->top >= d->size && deque_grow(d) )
+				break;
+			SLOT(d, d->bottom) = SLOT(v, v->top);
+			d->bottom++;
+			v->top++;
+		}
+		return pop_private(d, t);
+	}
+	return 0;
+}
+
+static void run_task(det_pool_t *pool, det_deque_t *d, det_task_t *t)
+{
+	det_task_t right;
+	long lo = t->lo, hi = t->hi;
+
+	if ( t->fn ) {
+		t->fn(t->arg);
+		return;
+	}
+	if ( !t->body )
+		return; // an item for det_pool_take()
+
+	// a parallel_for range: leave the right halves to others.
+	right = *t;
+	while ( hi - lo > t->grain ) {
+		right.lo = lo + (hi - lo) / 2;
+		right.hi = hi;
+		if ( push(pool, d, &right) )
+			break;
+		hi = right.lo;
+	}
+	if ( d->bottom - d->split >= 2 )
+		publish(pool, d); // ranges are few; don't wait for a batch
+	t->body(lo, hi, t->arg);
+}
+
+/**
+ * run tasks until there are none. a pool thread waits for more and returns
+ * at det_pool_destroy(). det_sync() returns when the other workers are
+ * idle as well, i.e. when every task has run.
+ */
+static void pool_loop(det_pool_t *pool, int w, int sync)
+{
+	det_deque_t *d = &pool->deque[w];
+	det_task_t t;
+
+	while ( 1 ) {
+		if ( pop_private(d, &t) ) {
+			run_task(pool, d, &t);
+			continue;
+		}
+
+		det_lock(&pool->lock);
+		while ( !take_locked(pool, w, &t) ) {
+			if ( (sync && pool->idle == pool->nworkers - 1) ||
+			     (!sync && pool->quit) ) {
+				det_unlock(&pool->lock);
+				return;
+			}
+			pool->idle++;
+			if ( pool->syncing && pool->idle == pool->nworkers )
+				det_cond_broadcast(&pool->work); // let det_sync() see it
+			det_cond_wait(&pool->work, &pool->lock);
+			pool->idle--;
+		}
+		det_unlock(&pool->lock);
+
+		run_task(pool, d, &t);
+	}
+}
+
+static void *pool_worker(void *arg)
+{
+	det_pool_t *pool = arg;
+	int w;
+
+	det_lock(&pool->lock);
+	w = ++pool->started;
+	det_unlock(&pool->lock);
+
+	det_pool_attach(pool, w);
+	pool_loop(pool, w, 0);
+	return NULL;
+}
+
+int det_pool_init(det_pool_t *pool, int nworkers)
+{
+	int i;
+
+	if ( nworkers < 1 || nworkers > MAX_THR )
+		return EINVAL;
+
+	memset(pool, 0, sizeof(*pool));
+	pool->nworkers = nworkers;
+	if ( !(pool->deque = calloc(nworkers, sizeof(det_deque_t))) )
+		return ENOMEM;
+	for ( i = 0; i < nworkers; i++ ) {
+		pool->deque[i].size = DET_POOL_SLOTS;
+		pool->deque[i].task = calloc(DET_POOL_SLOTS, sizeof(det_task_t));
+		if ( !pool->deque[i].task )
+			return ENOMEM;
+	}
+	det_lock_init(&pool->lock);
+	det_cond_init(&pool->work);
+	return 0;
+}
+
+int det_pool_create(det_pool_t *pool, int nworkers)
+{
+	int i, ret;
+
+	if ( (ret = det_pool_init(pool, nworkers)) )
+		return ret;
+	det_pool_attach(pool, 0);
+	for ( i = 1; i < nworkers; i++ ) {
+		if ( (ret = det_create(&pool->thread[i], NULL, pool_worker, pool)) )
+			return ret;
+	}
+	return 0;
+}
+
+int det_pool_attach(det_pool_t *pool, int worker)
+{
+	if ( worker < 0 || worker >= pool->nworkers )
+		return EINVAL;
+	pool->worker[det_get_pid()] = worker + 1;
+	return 0;
+}
+
+int det_pool_destroy(det_pool_t *pool)
+{
+	int i;
+
+	det_lock(&pool->lock);
+	pool->quit = 1;
+	det_cond_broadcast(&pool->work);
+	det_unlock(&pool->lock);
+
+	for ( i = 1; i < pool->nworkers; i++ ) {
+		if ( pool->thread[i] ) // det_pool_create()d
+			det_join(pool->thread[i], NULL);
+	}
+
+	for ( i = 0; i < pool->nworkers; i++ )
+		free(pool->deque[i].task);
+	free(pool->deque);
+	pool->deque = NULL;
+	return 0;
+}
+
+int det_spawn(det_pool_t *pool, det_task_fn fn, void *arg)
+{
+	det_deque_t *d = my_deque(pool);
+	det_task_t t;
+
+	if ( !d )
+		return EPERM;
+	memset(&t, 0, sizeof(t));
+	t.fn = fn;
+	t.arg = arg;
+	return push(pool, d, &t);
+}
+
+int det_pool_take(det_pool_t *pool, det_task_t *task)
+{
+	det_deque_t *d = my_deque(pool);
+	int ret;
+
+	if ( !d )
+		return 0;
+	if ( pop_private(d, task) )
+		return 1;
+
+	det_lock(&pool->lock);
+	ret = take_locked(pool, d - pool->deque, task);
+	det_unlock(&pool->lock);
+	return ret;
+}
+
+int det_pool_publish(det_pool_t *pool)
+{
+	det_deque_t *d = my_deque(pool);
+
+	if ( !d )
+		return EPERM;
+	if ( d->bottom > d->split ) {
+		det_lock(&pool->lock);
+		publish_locked(pool, d, d->bottom - d->split);
+		det_unlock(&pool->lock);
+	}
+	return 0;
+}
+
+int det_sync(det_pool_t *pool)
+{
+	det_deque_t *d = my_deque(pool);
+
+	if ( !d )
+		return EPERM;
+
+	det_lock(&pool->lock);
+	pool->syncing = 1;
+	publish_locked(pool, d, (d->bottom - d->split) / 2);
+	det_unlock(&pool->lock);
+
+	pool_loop(pool, d - pool->deque, 1);
+
+	det_lock(&pool->lock);
+	pool->syncing = 0;
+	det_unlock(&pool->lock);
+	return 0;
+}
+
+int det_parallel_for(det_pool_t *pool, long lo, long hi, long grain,
+		     det_for_fn body, void *arg)
+{
+	det_deque_t *d = my_deque(pool);
+	det_task_t t;
+	int ret;
+
+	if ( !d )
+		return EPERM;
+	if ( lo >= hi )
+		return 0;
+
+	memset(&t, 0, sizeof(t));
+	t.body = body;
+	t.arg = arg;
+	t.lo = lo;
+	t.hi = hi;
+	t.grain = grain < 1 ? 1 : grain;
+	if ( (ret = push(pool, d, &t)) )
+		return ret;
+	return det_sync(pool);
+}
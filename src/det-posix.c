@@ -39,6 +39,7 @@ extern uint64_t det_get_clock();
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 #include <stdarg.h> // va_
 
 // syscalls 
@@ -48,9 +49,9 @@ extern uint64_t det_get_clock();
 
 #include <sys/socket.h>
 
-#define USE_DET_TIME_OPT 0
+#include <dpthread-io.h> // EVENTS_PER_USEC 
 
-#define EVENTS_PER_USEC 122 // average store events per 1 usec. 
+#define USE_DET_TIME_OPT 0
 
 #if USE_DET_TIME_OPT
   #define EVENTS_read 106272 // (761*EVENTS_PER_USEC)
@@ -194,6 +195,21 @@ int detio_gettimeofday(struct timeval *tv, void *tz)
 	return 0; 
 }
 
+// same time as detio_gettimeofday() for the wall and monotonic clocks. 
+int detio_clock_gettime(clockid_t clk_id, struct timespec *tp)
+{
+	uint64_t clock, usecs; 
+
+	if ( clk_id != CLOCK_REALTIME && clk_id != CLOCK_MONOTONIC ) 
+		return clock_gettime(clk_id, tp); 
+
+	clock = det_get_clock(); 
+	usecs = (clock / EVENTS_PER_USEC); 
+	tp->tv_sec  = usecs / 1000000; 
+	tp->tv_nsec = (usecs % 1000000) * 1000; 
+	return 0; 
+}
+
 // socket.h 
 
 /* non-deterministic network packet reception. */ 
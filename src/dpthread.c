@@ -27,10 +27,19 @@
 #include <assert.h>
 #include <stdarg.h>
 #include <sched.h>
+#include <setjmp.h>
+#include <ucontext.h>
+#include <link.h>
+#include <execinfo.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <perfmon/pfmlib_perf_event.h>
 #include "perf_util.h"
 
 #include <dpthread.h>
+#include <dpthread-trace.h>
+#include <dpthread-io.h> // EVENTS_PER_USEC 
+#include <dpthread-top.h>
 // #include <atomic.h>
 
 #include "config.h"
@@ -41,10 +50,10 @@
 #define USE_NESTED_LOCK     1 // allow nested lock
 #define USE_MUTEX_RECURSIVE 1 // allow recursive lock 
 #define USE_PERF_COUNTER    1 // 0 - read_count() always return 0. 
-#define USE_TIMING          0 // measure timing 
 #define USE_FAKE_DISABLE    0 // not using ioc_enable/disable, but read_count
 #define USE_INST_COUNT      0 // use 'inst_retired-intr-pagefault' - not working 
 #define USE_DET_FASTFORWARD 0 // use deterministic fast forward 
+#define USE_CHECKPOINT      1 // fork-based checkpoint at barriers (DPTHREAD_CKPT_*)
 
 #define PROFILE_KERNEL_EVENTS 0 
 
@@ -68,6 +77,18 @@ static int __thread myid = 0;
 static int num_processors = 0; // set in det_init() 
 static int debug_level = 0; 
 static char *debug_log_file = NULL; 
+static char *trace_file = NULL;   // DPTHREAD_TRACE 
+static uint64_t trace_size = 1 << 20; 
+static uint64_t tsc_base; 
+static double tsc_per_usec; 
+static char *fingerprint_file = NULL; // DPTHREAD_FINGERPRINT 
+static char *stats_file = NULL; // DPTHREAD_STATS 
+static char *blame_file = NULL; // DPTHREAD_BLAME 
+static char *prof_file = NULL; // DPTHREAD_PROFILE 
+static char *timing_file = NULL; // DPTHREAD_TIMING 
+static char *top_prefix = NULL; // DPTHREAD_TOP 
+static int wd_interval = 0; // DPTHREAD_WATCHDOG. seconds, 0 - off 
+static int wd_abort = 0; // DPTHREAD_WATCHDOG_ABORT 
 
 struct worker_args {
 	// worker function and arg 
@@ -77,9 +98,11 @@ struct worker_args {
 	// id 
 	int  id; 
 	pthread_t tid; 
+	pid_t pid; // process. differs from my_pid for det_fork()ed workers 
 
 	// performance counter handles 
 	perf_event_desc_t *fds;
+	int nevts; 
 
 	// clock (=performance counter)
 	volatile int64_t hw_clock; // hw clock reading 
@@ -93,21 +116,94 @@ struct worker_args {
 	// thread status 
 	volatile int finished; 
 	volatile int started; 
+	volatile int parked; // in det_cond_wait(). 1 - releasing the mutex, 2 - blocked 
+	                     // 3 - blocked in det_sem_wait() (no checkpoint) 
+	int domain; // determinism domain 
+
+	// timed wait. the clock of a blocked waiter is its deadline 
+	volatile int timed_state; // 1 - waiting, 2 - timed out, 3 - woken 
+	int64_t timed_deadline; 
+	int timed_domain; 
+	pthread_mutex_t *timed_mutex; // the waiter blocks on this 
+
+	// det_chan_select(). parked on several queues, woken by the first 
+	volatile int select_state; // 1 - waiting, 2 - woken or cancelled 
+	det_queue_t *select_queue; // the queue that woke it 
+
+	// process-wide mode switch 
+	volatile int mode_arrived; // waiting at the switch 
+	int64_t mode_clock;        // clock at arrival 
+	int64_t last_release_logical_time; 
 
 	// misc 
 	int64_t last_exit_logical_time; 
 
 	// debug 
 	FILE *log_file; 
+	det_trace_hdr_t *trace_hdr; // binary trace. NULL - off 
+	det_trace_rec_t *trace; 
+	uint64_t fingerprint; // rolling hash of the sync events and their clocks 
+	uint64_t fingerprint_order; // of the sync events only 
+	int64_t fingerprint_events; 
+	volatile uint64_t wake_tsc; // DPTHREAD_TIMING: when the waker released me 
 	int nondet_count; // non-deterministic event count 
+
+#if USE_CHECKPOINT
+	// checkpoint: context saved when parked in det_cond_wait() 
+	ucontext_t ckpt_ctx; 
+	volatile int ckpt_resumed; // re-created from a checkpoint snapshot 
+	int ckpt_lock_count;       // TLS statistics at park time 
+	int ckpt_barrier_count; 
+	volatile int ckpt_orphan;  // exited before the snapshot was taken 
+	void *ckpt_stack;          // stack owned by the runtime, not by glibc 
+	size_t ckpt_stack_size; 
+	pthread_t ckpt_tid;        // physical thread after resume 
+	jmp_buf ckpt_exit_jmp;     // det_exit() of a resumed thread returns here 
+	void *ckpt_retval; 
+#endif
 };
 
-// shared data structure for workers 
-static struct worker_args wa[MAX_THR]; 
-static volatile uint32_t max_thr = 0; // created thread. 
-static volatile uint32_t num_thr = 0; // active threads. 
+// state shared by the threads of the deterministic group. it is private to 
+// the process unless DPTHREAD_SHM places it in a shared mapping, in which 
+// case the processes forked by det_fork() take turns with each other. 
+struct det_group {
+	volatile uint32_t max_thr; // created thread. 
+	volatile uint32_t num_thr; // active threads. 
+	volatile int64_t last_sync_logical_time; // update at every sync ops. 
+
+	// sync counts 
+	pthread_mutex_t count_mutex; 
+	volatile unsigned int g_lock_count; 
+	volatile unsigned int g_barr_count; 
+	volatile unsigned int g_cond_count; 
+	volatile unsigned int g_rwlock_count; 
+	volatile unsigned int g_sem_count; 
+	volatile unsigned int g_reduce_count; 
+	volatile unsigned int g_queue_count; 
+	volatile unsigned int g_promise_count; 
+
+	// process-wide mode. DET_MODE_DET or DET_MODE_NATIVE 
+	volatile int mode; 
+	volatile int mode_request; // differs from mode while a switch is pending 
+	volatile unsigned int mode_epoch; 
+	volatile int mode_switching; 
+
+	volatile int timed_waiters; // blocked in timed_block() 
+
+	// shared mapping. 0 - private 
+	size_t shm_size; 
+	volatile size_t shm_used; // queues of process-shared objects follow wa[] 
+	pid_t shm_leader; 
+
+	// shared data structure for workers 
+	struct worker_args wa[MAX_THR]; 
+}; 
+static struct det_group det_local = { .count_mutex = PTHREAD_MUTEX_INITIALIZER }; 
+static struct det_group *grp = &det_local; 
+static struct worker_args *wa = det_local.wa; 
+static pid_t my_pid; // process of this thread 
+static char shm_name[256]; 
 
-static volatile int64_t last_sync_logical_time; // update at every sync ops. 
 static int64_t __thread my_det_clock; // clock is paused at this 
 
 static int __thread my_det_enabled = 0;   // enabled/disabled 
@@ -118,21 +214,24 @@ static int __thread cache_read;
 static int __thread barrier_count; 
 static int __thread lock_count; 
 
-// sync counts 
-pthread_mutex_t count_mutex = PTHREAD_MUTEX_INITIALIZER; 
-static volatile unsigned int g_lock_count = 0; 
-static volatile unsigned int g_barr_count = 0; 
-static volatile unsigned int g_cond_count = 0; 
-
-// performance
-struct perf_mon {
-	uint64_t min, max, tot, cnt; /* in CPU cycles. */ 
+#if USE_CHECKPOINT
+// checkpoints 
+#define CKPT_MAX_ENTRIES 64 
+struct ckpt_entry {
+	pid_t pid;      // suspended snapshot process 
+	int64_t clock;  // logical time of the snapshot 
+	long mem_kb;    // private (copied-on-write) memory held by the snapshot 
 }; 
-static struct perf_mon __thread perf_wait_turn; 
-static struct perf_mon __thread perf_logical; 
-static struct perf_mon __thread perf_enable; 
-static struct perf_mon __thread perf_disable; 
-
+static int64_t ckpt_interval = 0;   // 0 - disabled 
+static int64_t ckpt_next_clock = 0; 
+static int ckpt_max = 4; 
+static long ckpt_mem_limit = 0;     // KB. 0 - unlimited 
+static int ckpt_keep = 0;           // keep snapshots after normal exit 
+static char ckpt_file[256];         // index of snapshots for ckpt-resume.sh 
+static struct ckpt_entry ckpt[CKPT_MAX_ENTRIES]; 
+static int ckpt_count = 0; 
+static int ckpt_seq = 0; 
+#endif 
 
 ///////////////////////////////////////////////////////////////////////////////////
 // dpthread internal function 
@@ -143,9 +242,9 @@ static pid_t gettid(void)
 	return (pid_t)syscall(__NR_gettid);
 }
 
+#if SELF_TEST
 static unsigned int get_usecs()
 {
-#if USE_TIMING 
 	static struct timeval  base;
 	struct timeval         time;
 	
@@ -155,10 +254,8 @@ static unsigned int get_usecs()
 	}
 	return ((time.tv_sec - base.tv_sec) * 1000000 +
 		(time.tv_usec - base.tv_usec));
-#else 
-	return 0; 
-#endif 
 }
+#endif 
 
 static pthread_mutex_t dbg_mutex = PTHREAD_MUTEX_INITIALIZER; 
 
@@ -172,14 +269,7 @@ static void DBG(int level, char *format, ...)
 	if ( level <= debug_level ) {
 		va_list ap;
 		pthread_mutex_lock(&dbg_mutex); 
-#if USE_TIMING
-		fprintf(out, "[RT:%08u]", get_usecs()); 
-		fprintf(out, "[LT:%08lld](%08lld,%08lld)", 
-			GET_CLOCK(myid), 
-			wa[myid].hw_clock, wa[myid].sw_clock);
-#else 
 		fprintf(out, "[LT:%08lld]", GET_CLOCK(myid)); 
-#endif 
 		fprintf(out, "[%2d]", myid); 
 		va_start(ap, format);
 		vfprintf(out, format, ap);
@@ -189,870 +279,4836 @@ static void DBG(int level, char *format, ...)
 	}
 }
 
+#define TRACE_TEXT(name, ph, text) text, 
+#define TRACE_NAME(name, ph, text) #name, 
+#define TRACE_PHASE(name, ph, text) ph, 
+static const char *trace_text[] = { DET_TRACE_OPS(TRACE_TEXT) }; 
+static const char *trace_name[] = { DET_TRACE_OPS(TRACE_NAME) }; 
+static const char trace_phase[] = { DET_TRACE_OPS(TRACE_PHASE) }; 
 
-/**
- * read performance counter data 
- */ 
-static uint64_t __read_count(perf_event_desc_t *fds)
+static inline uint64_t read_tsc(void)
 {
-#if USE_PERF_COUNTER
-	int ret; 
-	uint64_t values[3]; /* [0] - raw, [1] - time_enabled, [2] - time_running */ 
-	ret = read(fds->fd, values, sizeof(values));
-	// assert(values[1] == values[2]); // owise. incorrect 
-	if ( values[1] != values[2] ) { 
-		DBG(0, "%s: values[]=%lld,%lld,%lld\n", 
-			__FUNCTION__, values[0], values[1], values[2]); 
-	}
-	return values[0]; 
+#if defined(__i386__) || defined(__x86_64__)
+	uint32_t lo, hi; 
+	__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi)); 
+	return ((uint64_t)hi << 32) | lo; 
 #else 
-	return 0; 
-#endif
+	struct timespec ts; 
+	clock_gettime(CLOCK_MONOTONIC, &ts); 
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec; 
+#endif 
 }
 
-static uint64_t read_count(perf_event_desc_t *fds)
+static inline uint64_t fingerprint_fold(uint64_t h, uint64_t v)
 {
-	int64_t count; 
-#if USE_INST_COUNT
-	count =  __read_count(&fds[0]) - // inst
-		__read_count(&fds[1]) - // intr
-		__read_count(&fds[2]);  // page fault 
-#else /* store count only */ 
-	count = __read_count(&fds[0]); 
-#endif 
-	return count; 
+	return h ^ (v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)); 
 }
 
+///////////////////////////////////////////////////////////////////////////////////
+// live status page (DPTHREAD_TOP) 
+///////////////////////////////////////////////////////////////////////////////////
+
+static det_top_page_t *top; // NULL - off 
+static char top_name[256]; 
+static char top_blocks[DET_TRACE_NR_OPS]; // the op waits for another thread 
 
-static int64_t get_logical_clock(int id)
+static void top_init(det_top_page_t *page)
 {
-	int64_t ret, hw_clock; 
+	int i; 
 
+	for ( i = 0; i < DET_TRACE_NR_OPS; i++ ) 
+		top_blocks[i] = trace_phase[i] == 'B' || strstr(trace_name[i], "_BLOCK") != NULL; 
+	for ( i = 0; i < DET_TOP_MAX_THR; i++ ) 
+		page->thread[i].blocker = -1; 
+	for ( i = 0; i < DET_TOP_MAX_MUTEX; i++ ) 
+		page->mutex_owner[i] = -1; 
+	page->size = sizeof(*page); 
+	page->pid = getpid(); 
 	__sync_synchronize(); 
-	if ( !wa[id].hw_clock_enabled ) {
-		// hw counter of remote processor is currently disabled. 
-		ret = GET_CLOCK(id); 
-		DBG(4, "clock %d is disabled.\n", id); 
-		cache_read ++; 
-	} else {
-		// hw counter of remote processor is currently enabled 
-		// read counter value of remote processor directly from the hw counter. 
-		hw_clock = read_count(wa[id].fds); 
-		ret = hw_clock + wa[id].sw_clock; 
-		hw_read ++; 
-		// DBG(4, "clock %d is enabled. so read from hw = %lld\n", id, hw_clock); 
+	memcpy(page->magic, DET_TOP_MAGIC, sizeof(page->magic)); 
+	top = page; 
+}
+
+/**
+ * (re)create /<DPTHREAD_TOP>.<pid>. a det_fork()ed child gets its own. 
+ */
+static void top_open(void)
+{
+	det_top_page_t *page; 
+	int fd; 
+
+	if ( top ) 
+		munmap(top, sizeof(*top)); 
+	top = NULL; 
+
+	snprintf(top_name, sizeof(top_name), "/%s.%d", top_prefix, (int)getpid()); 
+	if ( (fd = shm_open(top_name, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0 ) { 
+		warn("DPTHREAD_TOP %s", top_name); 
+		return; 
 	}
-	__sync_synchronize(); 
+	if ( ftruncate(fd, sizeof(*page)) < 0 || 
+	     (page = mmap(NULL, sizeof(*page), PROT_READ|PROT_WRITE, 
+			  MAP_SHARED, fd, 0)) == MAP_FAILED ) { 
+		warn("DPTHREAD_TOP %s", top_name); 
+		close(fd); 
+		shm_unlink(top_name); 
+		return; 
+	}
+	close(fd); 
+	top_init(page); 
+}
 
-	return ret; 
+static void top_close(void)
+{
+	if ( top && top_name[0] ) 
+		shm_unlink(top_name); 
 }
 
-static int enable_performance_counter()
+static void top_event(int op, int obj)
 {
-	if ( wa[myid].fds ) { 
-#if USE_INST_COUNT
-		ioctl(wa[myid].fds[0].fd, PERF_EVENT_IOC_ENABLE, 0);  	
-		ioctl(wa[myid].fds[1].fd, PERF_EVENT_IOC_ENABLE, 0);  	
-		ioctl(wa[myid].fds[2].fd, PERF_EVENT_IOC_ENABLE, 0);  	
-#else 
-		ioctl(wa[myid].fds[0].fd, PERF_EVENT_IOC_ENABLE, 0);  	
-#endif 
+	det_top_thread_t *t = &top->thread[myid]; 
+
+	t->clock = GET_CLOCK(myid); 
+	t->events++; 
+	t->domain = wa[myid].domain; 
+	if ( top_blocks[op] ) { 
+		t->wait_op = op; 
+		t->wait_obj = obj; 
+		t->state = DET_TOP_BLOCKED; 
+	} else if ( op != DET_TRACE_SPINNING && op != DET_TRACE_REL ) { 
+		// cond wait releases the mutex on the way to park 
+		t->state = DET_TOP_RUNNING; 
 	}
-	return 0; 
+	if ( obj > 0 && obj < DET_TOP_MAX_MUTEX ) { 
+		if ( op == DET_TRACE_ACQ || op == DET_TRACE_TRYLOCK_ACQ ) 
+			top->mutex_owner[obj] = myid; 
+		else if ( op == DET_TRACE_REL ) 
+			top->mutex_owner[obj] = -1; 
+	}
+	top->max_thr = grp->max_thr; 
+	top->mode = grp->mode; 
+	top->last_sync_clock = grp->last_sync_logical_time; 
 }
 
-static int disable_performance_counter()
+/**
+ * a sync event: folded into the fingerprint of the thread, and a record in 
+ * the trace with DPTHREAD_TRACE or a DBG(1) line. 
+ */
+static inline void TRACE(int op, int obj, int64_t arg)
 {
-	if ( wa[myid].fds ) { 
-#if USE_INST_COUNT
-		ioctl(wa[myid].fds[0].fd, PERF_EVENT_IOC_DISABLE, 0);  	
-		ioctl(wa[myid].fds[1].fd, PERF_EVENT_IOC_DISABLE, 0);  	
-		ioctl(wa[myid].fds[2].fd, PERF_EVENT_IOC_DISABLE, 0);  	
-#else 
-		ioctl(wa[myid].fds[0].fd, PERF_EVENT_IOC_DISABLE, 0);  	
-#endif 
+	struct worker_args *w = &wa[myid]; 
+	det_trace_rec_t *r; 
+	uint64_t v; 
+
+	v = fingerprint_fold(((uint64_t)op << 32) | (uint32_t)obj, arg); 
+	w->fingerprint_order = fingerprint_fold(w->fingerprint_order, v); 
+	w->fingerprint = fingerprint_fold(fingerprint_fold(w->fingerprint, v), 
+					  GET_CLOCK(myid)); 
+	w->fingerprint_events++; 
+	if ( top ) 
+		top_event(op, obj); 
+
+	if ( w->trace_hdr ) { 
+		r = &w->trace[w->trace_hdr->count & (w->trace_hdr->size - 1)]; 
+		r->tsc = read_tsc(); 
+		r->clock = GET_CLOCK(myid); 
+		r->arg = arg; 
+		r->obj = obj; 
+		r->op = op; 
+		r->tid = myid; 
+		w->trace_hdr->count++; 
+	} else if ( debug_level >= 1 ) { 
+		DBG(1, (char *)trace_text[op], obj, arg); 
 	}
-	return 0; 
 }
 
+static double tsc_calibrate(void)
+{
+	struct timespec t0, t1; 
+	uint64_t c0, c1; 
+	int64_t ns; 
+
+	clock_gettime(CLOCK_MONOTONIC, &t0); 
+	c0 = read_tsc(); 
+	do { 
+		clock_gettime(CLOCK_MONOTONIC, &t1); 
+		ns = (t1.tv_sec - t0.tv_sec) * 1000000000LL + t1.tv_nsec - t0.tv_nsec; 
+	} while ( ns < 10000000 ); // 10 ms 
+	c1 = read_tsc(); 
+	return (c1 - c0) * 1000.0 / ns; 
+}
 
-static int enable_logical_clock()
+/**
+ * map <DPTHREAD_TRACE>.p<id>.trace. tracing stays off for the thread if 
+ * it fails. 
+ */
+static void trace_open(struct worker_args *w)
 {
-#if USE_TIMING
-	unsigned start, dur; 
-	start = get_usecs(); 
-#endif 
-	if ( !wa[myid].fds ) return -1; // not initialized 
+	det_trace_hdr_t *hdr; 
+	char name[PATH_MAX]; 
+	size_t len; 
+	void *p; 
+	int fd; 
+
+	w->trace_hdr = NULL; 
+	len = sizeof(det_trace_hdr_t) + trace_size * sizeof(det_trace_rec_t); 
+	snprintf(name, sizeof(name), "%s.p%d.trace", trace_file, w->id); 
+	if ( (fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0 ) { 
+		warn("%s", name); 
+		return; 
+	}
+	p = MAP_FAILED; 
+	if ( ftruncate(fd, len) == 0 ) 
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0); 
+	close(fd); 
+	if ( p == MAP_FAILED ) { 
+		warn("%s", name); 
+		return; 
+	}
 
-	__sync_synchronize(); 
-	if ( wa[myid].hw_clock_enabled) return -1; // already enabled. 
+	hdr = p; 
+	memcpy(hdr->magic, DET_TRACE_MAGIC, sizeof(hdr->magic)); 
+	hdr->rec_size = sizeof(det_trace_rec_t); 
+	hdr->tid = w->id; 
+	hdr->size = trace_size; 
+	hdr->count = 0; 
+	hdr->tsc_base = tsc_base; 
+	hdr->tsc_per_usec = tsc_per_usec; 
+	w->trace = (det_trace_rec_t *)(hdr + 1); 
+	w->trace_hdr = hdr; 
+}
 
-	DBG(4, "%s: hw_clock = %lld, enabled=%d\n", 
-	    __FUNCTION__, wa[myid].hw_clock, wa[myid].hw_clock_enabled); 
+/**
+ * DPTHREAD_FINGERPRINT: "thread <id> <hash> <order hash> <events>" per 
+ * thread and "all <hash> <order hash>". the same hash means the same sync 
+ * order at the same clocks; the same order hash, the same sync order. 
+ * the threads of det_fork()ed processes are in the shared group, so only 
+ * the leader writes the file. 
+ */
+static void fingerprint_write(void)
+{
+	uint64_t all = 0, all_order = 0; 
+	FILE *fp; 
+	int i; 
 
-#if USE_FAKE_DISABLE
-	clock_diff = read_count(wa[myid].fds) - wa[myid].hw_clock; 
-	wa[myid].sw_clock -= clock_diff;  // FIXME
-	// DBG(1, "enable: diff = %lld\n", clock_diff); 
-	wa[myid].hw_clock  += clock_diff; 
-	// DBG(1, "enable: curr = %lld\n", GET_CLOCK(myid));
-	wa[myid].hw_clock_enabled = 1; 
-	__sync_synchronize(); 
-#else /* !USE_FAKE_DISABLE */ 
-	__sync_synchronize(); 
-	wa[myid].hw_clock_enabled = 1; 
-	enable_performance_counter();
-#endif /* USE_FAKE_DISABLE */ 
+	if ( grp->shm_size > 0 && grp->shm_leader != getpid() ) 
+		return; 
+	if ( !(fp = fopen(fingerprint_file, "w")) ) { 
+		warn("%s", fingerprint_file); 
+		return; 
+	}
+	for ( i = 0; i < grp->max_thr; i++ ) { 
+		fprintf(fp, "thread %d %016llx %016llx %lld\n", i, 
+			(unsigned long long)wa[i].fingerprint, 
+			(unsigned long long)wa[i].fingerprint_order, 
+			(long long)wa[i].fingerprint_events); 
+		all = fingerprint_fold(all, wa[i].fingerprint); 
+		all_order = fingerprint_fold(all_order, wa[i].fingerprint_order); 
+	}
+	fprintf(fp, "all %016llx %016llx\n", 
+		(unsigned long long)all, (unsigned long long)all_order); 
+	fclose(fp); 
+}
 
-#if USE_TIMING 
-	dur = get_usecs() - start; 
-	perf_enable.tot += dur; 
-	perf_enable.min = min(perf_enable.min, dur); 
-	perf_enable.max = max(perf_enable.max, dur); 
-#endif 
-	perf_enable.cnt ++; 
+/**
+ * per thread debug output: DPTHREAD_LOG_FILE and DPTHREAD_TRACE. 
+ */
+static void log_open(struct worker_args *w)
+{
+	if ( debug_log_file ) {
+		char name[40]; 
+		sprintf(name, "%s.p%d", debug_log_file, w->id); 
+		w->log_file = fopen(name, "w+"); 
+	} else {
+		w->log_file = stderr; 
+	}
+	if ( trace_file ) 
+		trace_open(w); 
+}
 
-	return 0; 
 
-}
+///////////////////////////////////////////////////////////////////////////////////
+// per object statistics (DPTHREAD_STATS) 
+///////////////////////////////////////////////////////////////////////////////////
 
-static int disable_logical_clock()
-{
-#if USE_TIMING 
-	unsigned start, dur; 
-	start = get_usecs(); 
-#endif 
-	if ( !wa[myid].fds ) return -1; // not initialized 
-	if ( !wa[myid].hw_clock_enabled ) return -1; // already disabled. 
+#define STAT_MAX_OBJ 4096 // per kind. objects of higher ids are not counted 
 
-#if USE_FAKE_DISABLE 
-	__sync_synchronize(); 
-	wa[myid].hw_clock_enabled = 0; 
-	__sync_synchronize(); 
-	wa[myid].hw_clock = read_count(wa[myid].fds); 
-	__sync_synchronize(); 
-#else /* !USE_FAKE_DISABLE */ 
-	disable_performance_counter(); 
-	wa[myid].hw_clock = read_count(wa[myid].fds); 
-	__sync_synchronize(); 
-	wa[myid].hw_clock_enabled = 0;
-	__sync_synchronize(); 
-#endif /* USE_FAKE_DISABLE */ 
+enum { STAT_MUTEX, STAT_COND, STAT_BARRIER, STAT_NR_KINDS }; 
 
-	DBG(4, "%s: hw_clock = %lld, enabled=%d\n", 
-	    __FUNCTION__, wa[myid].hw_clock, wa[myid].hw_clock_enabled); 
+static const char *stat_kind[STAT_NR_KINDS] = { "mutex", "cond", "barrier" }; 
 
-#if USE_TIMING
-	dur = get_usecs() - start; 
-	perf_disable.tot += dur; 
-	perf_disable.min = min(perf_disable.min, dur); 
-	perf_disable.max = max(perf_disable.max, dur); 
-#endif 
-	perf_disable.cnt ++; 
+struct obj_stat { 
+	void *site;              // init call site 
+	int64_t count;           // acquisitions, waits 
+	int64_t retries;         // turns lost in the nested lock loop 
+	int64_t case2;           // free at the turn, but released at a later clock 
+	int64_t signals;         // cond: waiters woken 
+	uint64_t turn_tsc;       // in wait_for_turn() 
+	uint64_t wait_tsc;       // until acquired, woken or released 
+	uint64_t hold_tsc;       // mutex: acquired to released 
+	uint64_t acquired_tsc;   // mutex: set by the owner 
+}; 
 
-	return 0; 
+// an operation in progress 
+struct stat_op { 
+	struct obj_stat *st; 
+	uint64_t tsc; 
+	uint64_t turn_tsc; 
+}; 
+
+static struct obj_stat *obj_stats; // [kind][id]. NULL - off 
+static uint64_t __thread turn_tsc; // total in wait_for_turn() 
+
+#define STAT_ADD(st, field, v) __sync_fetch_and_add(&(st)->field, (v)) 
+#define STAT_COUNT(kind, id, field) do { \
+	struct obj_stat *_st = obj_stat(kind, id); \
+	if ( _st ) STAT_ADD(_st, field, 1); \
+} while (0)
+
+static inline struct obj_stat *obj_stat(int kind, int id)
+{
+	if ( !obj_stats || id <= 0 || id >= STAT_MAX_OBJ ) 
+		return NULL; 
+	return &obj_stats[kind * STAT_MAX_OBJ + id]; 
+}
+
+static void stat_site(int kind, int id, void *site)
+{
+	struct obj_stat *st = obj_stat(kind, id); 
+
+	if ( st ) 
+		st->site = site; 
+}
+
+static inline void stat_begin(struct stat_op *op, int kind, int id)
+{
+	if ( (op->st = obj_stat(kind, id)) ) { 
+		op->tsc = read_tsc(); 
+		op->turn_tsc = turn_tsc; 
+	}
 }
 
 /**
- * wait until my logical time is global minima. 
+ * count the operation. returns the time it ended. 
  */
-static int64_t wait_for_turn()
+static inline uint64_t stat_end(struct stat_op *op)
 {
-	int i; 
-	int64_t my_clock, other_clock; 
-	int nthreads; 
+	uint64_t now = read_tsc(); 
 
-#if USE_TIMING
-	unsigned start, dur; 
-	start = get_usecs();
-#endif 
-	if ( max_thr == 0 ) return 0; // nothing 
+	STAT_ADD(op->st, count, 1); 
+	STAT_ADD(op->st, wait_tsc, now - op->tsc); 
+	STAT_ADD(op->st, turn_tsc, turn_tsc - op->turn_tsc); 
+	return now; 
+}
 
-	assert( !wa[myid].hw_clock_enabled); 
+static void stat_release(det_mutex_t *mutex)
+{
+	struct obj_stat *st = obj_stat(STAT_MUTEX, mutex->id); 
 
-	my_clock = get_logical_clock(myid); 
-retry:
-	nthreads = max_thr; 
-	for ( i = 1; i < nthreads; i++ ) { 
-		int id = (myid + i) % nthreads; 
-		// try with phyiscal clock value
+	if ( st && st->acquired_tsc ) 
+		st->hold_tsc += read_tsc() - st->acquired_tsc; 
+}
 
-		other_clock = get_logical_clock(id);
+struct site_module { 
+	uintptr_t addr; 
+	const char *name; 
+	uintptr_t base; 
+}; 
 
-		if ( other_clock < my_clock ||  // i'm not the minimum  
-		     ( other_clock == my_clock && myid > id) ) {
-			pthread_yield(); 
-			goto retry; 
+static int site_find_module(struct dl_phdr_info *info, size_t size, void *data)
+{
+	struct site_module *m = data; 
+	uintptr_t lo; 
+	int i; 
+
+	for ( i = 0; i < info->dlpi_phnum; i++ ) { 
+		if ( info->dlpi_phdr[i].p_type != PT_LOAD ) 
+			continue; 
+		lo = info->dlpi_addr + info->dlpi_phdr[i].p_vaddr; 
+		if ( m->addr >= lo && m->addr < lo + info->dlpi_phdr[i].p_memsz ) { 
+			m->name = info->dlpi_name[0] ? info->dlpi_name : program_invocation_name; 
+			m->base = info->dlpi_addr; 
+			return 1; 
 		}
 	}
-	
-	__sync_synchronize(); 
-	if ( max_thr != nthreads ) {
-		DBG(3, "thread are changed to %d\n", max_thr); 
-		goto retry; 
-	}
+	return 0; 
+}
 
-	DBG(2, "return from wait_for_turn\n");
+/**
+ * a code address as <module>+<offset>, for addr2line. 0 if it is unknown. 
+ */
+static int site_lookup(void *addr, const char **module, unsigned long *offset)
+{
+	struct site_module m; 
 
-#if USE_TIMING 
-	dur = get_usecs() - start; 
-	perf_wait_turn.tot += dur; 
-	perf_wait_turn.min = min(perf_wait_turn.min, dur); 
-	perf_wait_turn.max = max(perf_wait_turn.max, dur); 
-#endif 
-	perf_wait_turn.cnt ++; 
-	return my_clock; 
+	m.addr = (uintptr_t)addr; 
+	if ( !addr || !dl_iterate_phdr(site_find_module, &m) ) 
+		return 0; 
+	*module = m.name; 
+	*offset = m.addr - m.base; 
+	return 1; 
 }
 
-static int open_pfm_counter( struct worker_args *w ) 
+/**
+ * DPTHREAD_STATS: the objects that were used, by kind. sites are 
+ * <module>+<offset> for addr2line. times are in usec. 
+ */
+static void stats_write(void)
 {
-	int nevts, i; 
-	size_t pgsz;
-	pgsz = sysconf(_SC_PAGESIZE);
+	struct obj_stat *st; 
+	const char *sep, *module; 
+	unsigned long offset; 
+	FILE *fp; 
+	int k, id; 
+
+	if ( !(fp = fopen(stats_file, "w")) ) { 
+		warn("%s", stats_file); 
+		return; 
+	}
+	fprintf(fp, "{\n"); 
+	for ( k = 0; k < STAT_NR_KINDS; k++ ) { 
+		fprintf(fp, "  \"%s\": [", stat_kind[k]); 
+		sep = "\n"; 
+		for ( id = 1; id < STAT_MAX_OBJ; id++ ) { 
+			st = obj_stat(k, id); 
+			if ( st->count == 0 && st->signals == 0 ) 
+				continue; 
+			fprintf(fp, "%s    {\"id\": %d, \"site\": ", sep, id); 
+			if ( site_lookup(st->site, &module, &offset) ) 
+				fprintf(fp, "\"%s+0x%lx\"", module, offset); 
+			else 
+				fprintf(fp, "null"); 
+			fprintf(fp, ", \"count\": %lld, \"retries\": %lld, \"case2\": %lld, " 
+				"\"signals\": %lld, \"turn_wait_us\": %.3f, \"wait_us\": %.3f, " 
+				"\"hold_us\": %.3f}", 
+				(long long)st->count, (long long)st->retries, 
+				(long long)st->case2, (long long)st->signals, 
+				st->turn_tsc / tsc_per_usec, st->wait_tsc / tsc_per_usec, 
+				st->hold_tsc / tsc_per_usec); 
+			sep = ",\n"; 
+		}
+		fprintf(fp, "\n  ]%s\n", k < STAT_NR_KINDS - 1 ? "," : ""); 
+	}
+	fprintf(fp, "}\n"); 
+	fclose(fp); 
+}
 
-	DBG(2, "open pfm counter\n"); 
-	/* open performance counter */ 
-#if USE_INST_COUNT
-	nevts = perf_setup_list_events("INST_RETIRED,HW_INT_RCV,PERF_COUNT_SW_PAGE_FAULTS,PERF_COUNT_SW_CONTEXT_SWITCHES", &w->fds); 
-#else /* store count */ 
-  #if USE_INTEL_CORE2
-	nevts = perf_setup_list_events("INST_RETIRED:STORES,PERF_COUNT_SW_CONTEXT_SWITCHES", &w->fds); 
-  #elif USE_INTEL_NEHALEM 
-	nevts = perf_setup_list_events("INST_RETIRED,PERF_COUNT_SW_CONTEXT_SWITCHES", &w->fds); 
-  #else 
-	#error "Unsupported Architecture" 
-  #endif 
-#endif 
-	if (nevts < 1)
-		errx(1, "cannot monitor event");
-	w->fds[0].fd = -1; 
-	for ( i = 0; i < nevts; i++ ) { 
-		w->fds[i].hw.disabled = 1; /* do not enable now */
+///////////////////////////////////////////////////////////////////////////////////
+// turn-wait blame (DPTHREAD_BLAME) 
+///////////////////////////////////////////////////////////////////////////////////
 
-		w->fds[i].hw.exclusive = 1; 
-		w->fds[i].hw.pinned = 1; 
+#define BLAME_SKEW_BUCKETS 64 // 0, then [2^(i-1), 2^i) 
+
+// a row per waiter, written only by the waiter 
+struct blame_row { 
+	uint64_t retries[MAX_THR]; // by blocker 
+	uint64_t tsc[MAX_THR];     // by blocker 
+	uint64_t skew[BLAME_SKEW_BUCKETS]; // my clock - blocker's, at each retry 
+}; 
+
+static struct blame_row *blame; // [MAX_THR]. NULL - off 
+
+static inline int blame_bucket(int64_t skew)
+{
+	int b = 0; 
+
+	while ( skew > 0 && b < BLAME_SKEW_BUCKETS - 1 ) { 
+		skew >>= 1; 
+		b++; 
+	}
+	return b; 
+}
+
+/**
+ * a retry of wait_for_turn(): the time since the last sample goes to the 
+ * blocker then, *blocker becomes id. id -1 closes the wait. 
+ */
+static void blame_sample(int *blocker, uint64_t *last, int id, int64_t skew)
+{
+	struct blame_row *row = &blame[myid]; 
+	uint64_t now = read_tsc(); 
+
+	if ( *blocker >= 0 ) 
+		row->tsc[*blocker] += now - *last; 
+	if ( id >= 0 ) { 
+		row->retries[id]++; 
+		row->skew[blame_bucket(skew)]++; 
+	}
+	*blocker = id; 
+	*last = now; 
+}
+
+/**
+ * DPTHREAD_BLAME: usec and retries each waiter (row) spent in 
+ * wait_for_turn() behind each blocker (column), the thread holding the 
+ * minimum clock, then a histogram per waiter of how far behind the 
+ * blocker was. 
+ */
+static void blame_write(void)
+{
+	struct blame_row *row; 
+	uint64_t tot; 
+	FILE *fp; 
+	int n = 0, i, j, b; 
+
+	if ( !(fp = fopen(blame_file, "w")) ) { 
+		warn("%s", blame_file); 
+		return; 
+	}
+	for ( i = 0; i < MAX_THR; i++ ) { 
+		for ( j = 0; j < MAX_THR; j++ ) { 
+			if ( blame[i].retries[j] && n <= max(i, j) ) 
+				n = max(i, j) + 1; 
+		}
+	}
+
+	fprintf(fp, "# usec waited, waiter by blocker\nwaiter"); 
+	for ( j = 0; j < n; j++ ) 
+		fprintf(fp, " %10d", j); 
+	fprintf(fp, " %12s\n", "total"); 
+	for ( i = 0; i < n; i++ ) { 
+		row = &blame[i]; 
+		fprintf(fp, "%6d", i); 
+		for ( j = tot = 0; j < n; j++ ) { 
+			fprintf(fp, " %10.0f", row->tsc[j] / tsc_per_usec); 
+			tot += row->tsc[j]; 
+		}
+		fprintf(fp, " %12.0f\n", tot / tsc_per_usec); 
+	}
+	fprintf(fp, "%6s", "total"); 
+	for ( j = 0; j < n; j++ ) { 
+		for ( i = tot = 0; i < n; i++ ) 
+			tot += blame[i].tsc[j]; 
+		fprintf(fp, " %10.0f", tot / tsc_per_usec); 
+	}
+	fprintf(fp, "\n"); 
+
+	fprintf(fp, "\n# retries, waiter by blocker\nwaiter"); 
+	for ( j = 0; j < n; j++ ) 
+		fprintf(fp, " %10d", j); 
+	fprintf(fp, "\n"); 
+	for ( i = 0; i < n; i++ ) { 
+		fprintf(fp, "%6d", i); 
+		for ( j = 0; j < n; j++ ) 
+			fprintf(fp, " %10llu", (unsigned long long)blame[i].retries[j]); 
+		fprintf(fp, "\n"); 
+	}
+
+	fprintf(fp, "\n# clock skew to the blocker at a retry: from, retries\n"); 
+	for ( i = 0; i < n; i++ ) { 
+		for ( b = BLAME_SKEW_BUCKETS - 1; b >= 0 && !blame[i].skew[b]; b-- ); 
+		if ( b < 0 ) 
+			continue; 
+		fprintf(fp, "waiter %d\n", i); 
+		for ( j = 0; j <= b; j++ ) { 
+			fprintf(fp, "  %20llu %12llu\n", 
+				j ? 1ULL << (j - 1) : 0ULL, 
+				(unsigned long long)blame[i].skew[j]); 
+		}
+	}
+	fclose(fp); 
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// call site profile (DPTHREAD_PROFILE) 
+///////////////////////////////////////////////////////////////////////////////////
+
+#define PROF_MAX_DEPTH 16 
+#define PROF_TABLE_SIZE 1024 // stacks per thread. a power of 2 
+
+struct prof_entry { 
+	uint64_t hash;         // 0 - free 
+	int depth; 
+	void *pc[PROF_MAX_DEPTH]; // [0] - innermost 
+	uint64_t samples; 
+	uint64_t turn_tsc;     // in wait_for_turn() 
+	uint64_t toggle_tsc;   // disabling the logical clock; enabling is the ioctl, not timed 
+}; 
+
+static int prof_period;  // sample every Nth op. 0 - off 
+static int prof_depth = 8; 
+static struct prof_entry *prof_table[MAX_THR]; // by thread, allocated at the first sample 
+static int64_t prof_dropped; // a table was full 
+
+// the op in progress, from disable_logical_clock() to enable_logical_clock() 
+static int __thread prof_ops; 
+static int __thread prof_on; 
+static uint64_t __thread prof_tsc; 
+static uint64_t __thread prof_turn_tsc; 
+static uint64_t __thread prof_toggle_tsc; 
+static void __thread *prof_pc[PROF_MAX_DEPTH]; // the stack of the op, by prof_stack() 
+static int __thread prof_npc; 
+
+static int prof_insert(struct prof_entry *table, int size, struct prof_entry *e)
+{
+	int i, k; 
+
+	for ( i = 0; i < size; i++ ) { 
+		struct prof_entry *t = &table[(e->hash + i) & (size - 1)]; 
+
+		if ( t->hash == 0 ) { 
+			*t = *e; 
+			return 0; 
+		}
+		if ( t->hash != e->hash || t->depth != e->depth ) 
+			continue; 
+		for ( k = 0; k < e->depth && t->pc[k] == e->pc[k]; k++ ); 
+		if ( k < e->depth ) 
+			continue; 
+		t->samples += e->samples; 
+		t->turn_tsc += e->turn_tsc; 
+		t->toggle_tsc += e->toggle_tsc; 
+		return 0; 
+	}
+	return -1; 
+}
+
+/**
+ * called from disable_logical_clock(): is this op sampled? 
+ */
+static inline void prof_begin(void)
+{
+	if ( ++prof_ops < prof_period ) { 
+		prof_on = 0; 
+		return; 
+	}
+	prof_ops = 0; 
+	prof_on = 1; 
+	prof_turn_tsc = 0; 
+	prof_tsc = read_tsc(); 
+}
+
+/**
+ * called from disable_logical_clock() of a sampled op, with the counter 
+ * stopped. the stack starts at the caller of the runtime function that 
+ * disabled the clock, i.e. at the det_* call or the code that made it; 
+ * this, disable_logical_clock() and that function are skipped. 
+ */
+static void __attribute__((noinline)) prof_stack(void)
+{
+	void *pc[PROF_MAX_DEPTH + 3]; 
+	int n; 
+
+	n = backtrace(pc, prof_depth + 3); 
+	prof_npc = max(0, n - 3); 
+	memcpy(prof_pc, pc + 3, prof_npc * sizeof(void *)); 
+}
+
+/**
+ * called from enable_logical_clock() at the end of a sampled op, before 
+ * the counter runs again. 
+ */
+static void prof_sample(void)
+{
+	struct prof_entry e; 
+	int i; 
+
+	prof_on = 0; 
+	if ( !prof_table[myid] && 
+	     !(prof_table[myid] = calloc(PROF_TABLE_SIZE, sizeof(struct prof_entry))) ) 
+		return; 
+
+	e.hash = 0; 
+	e.depth = prof_npc; 
+	for ( i = 0; i < prof_npc; i++ ) { 
+		e.pc[i] = prof_pc[i]; 
+		e.hash = fingerprint_fold(e.hash, (uintptr_t)prof_pc[i]); 
+	}
+	e.hash |= 1; 
+	e.samples = 1; 
+	e.turn_tsc = prof_turn_tsc; 
+	e.toggle_tsc = prof_toggle_tsc; 
+	if ( prof_insert(prof_table[myid], PROF_TABLE_SIZE, &e) < 0 ) 
+		__sync_fetch_and_add(&prof_dropped, 1); 
+}
+
+/**
+ * DPTHREAD_PROFILE: the threads' stacks merged into collapsed stack files 
+ * for flamegraph.pl, scaled by the sampling period: 
+ * <prefix>.turn.folded (ns in wait_for_turn()), <prefix>.toggle.folded 
+ * (ns disabling the clock) and <prefix>.ops.folded (ops). 
+ * frames are <module>+<offset> for addr2line, outermost first. 
+ */
+static void prof_write(void)
+{
+	static const char *metric[] = { "turn", "toggle", "ops" }; 
+	int size = PROF_TABLE_SIZE * 4; 
+	struct prof_entry *merged, *e; 
+	const char *module, *base; 
+	unsigned long offset; 
+	char name[PATH_MAX]; 
+	double v; 
+	FILE *fp; 
+	int i, j, k; 
+
+	if ( !(merged = calloc(size, sizeof(struct prof_entry))) ) 
+		return; 
+	for ( i = 0; i < MAX_THR; i++ ) { 
+		for ( j = 0; prof_table[i] && j < PROF_TABLE_SIZE; j++ ) { 
+			if ( prof_table[i][j].hash && prof_insert(merged, size, &prof_table[i][j]) < 0 ) 
+				prof_dropped++; 
+		}
+	}
+	if ( prof_dropped ) 
+		warnx("%s: %lld samples dropped, too many stacks", prof_file, (long long)prof_dropped); 
+
+	for ( k = 0; k < 3; k++ ) { 
+		snprintf(name, sizeof(name), "%s.%s.folded", prof_file, metric[k]); 
+		if ( !(fp = fopen(name, "w")) ) { 
+			warn("%s", name); 
+			continue; 
+		}
+		for ( j = 0; j < size; j++ ) { 
+			e = &merged[j]; 
+			if ( !e->hash ) 
+				continue; 
+			if ( k == 0 ) 
+				v = e->turn_tsc * 1000.0 / tsc_per_usec; 
+			else if ( k == 1 ) 
+				v = e->toggle_tsc * 1000.0 / tsc_per_usec; 
+			else 
+				v = e->samples; 
+			if ( (v *= prof_period) < 1 ) 
+				continue; 
+			for ( i = e->depth - 1; i >= 0; i-- ) { 
+				if ( site_lookup(e->pc[i], &module, &offset) ) { 
+					base = strrchr(module, '/'); 
+					fprintf(fp, "%s+0x%lx", base ? base + 1 : module, offset); 
+				} else { 
+					fprintf(fp, "%p", e->pc[i]); 
+				}
+				fputc(i ? ';' : ' ', fp); 
+			}
+			fprintf(fp, "%.0f\n", v); 
+		}
+		fclose(fp); 
+	}
+	free(merged); 
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// timing of the runtime internals (DPTHREAD_TIMING) 
+///////////////////////////////////////////////////////////////////////////////////
+
+enum { 
+	TIME_TURN,          // wait_for_turn() 
+	TIME_TURN_SCAN,     // a pass over the other clocks 
+	TIME_COUNTER_READ,  // read_count() 
+	TIME_IOCTL_ENABLE,  // enable_performance_counter() 
+	TIME_IOCTL_DISABLE, // disable_performance_counter() 
+	TIME_CLOCK_ENABLE,  // enable_logical_clock() 
+	TIME_CLOCK_DISABLE, // disable_logical_clock() 
+	TIME_QUEUE,         // waiter queue ops 
+	TIME_MUTEX,         // pthread_mutex_trylock/unlock() 
+	TIME_WAKEUP,        // waker's release to the waiter running 
+	TIME_NR_PHASES 
+}; 
+
+static const char *time_phase[TIME_NR_PHASES] = { 
+	"wait_for_turn", "turn_scan", "counter_read", "ioctl_enable", 
+	"ioctl_disable", "clock_enable", "clock_disable", "queue", 
+	"pthread_mutex", "wakeup", 
+}; 
+
+#define TIME_BUCKETS 48 // 0, then [2^(i-1), 2^i) tsc ticks 
+
+struct time_hist { 
+	uint64_t cnt, tot, min, max; 
+	uint64_t bucket[TIME_BUCKETS]; 
+}; 
+
+static int use_timing; 
+static struct time_hist (*time_hists)[TIME_NR_PHASES]; // [MAX_THR] 
+static uint64_t __thread time_ioctl_enable; // ticks, added at the next disable 
+
+static inline uint64_t time_begin(void)
+{
+	return use_timing ? read_tsc() : 0; 
+}
+
+/**
+ * the same stores whatever ticks is: where the counter is on, e.g. a 
+ * read_count() of my own clock, the clock does not depend on the timing. 
+ */
+static void time_add(int phase, uint64_t ticks)
+{
+	struct time_hist *h = &time_hists[myid][phase]; 
+	int b = 64 - __builtin_clzll(ticks | 1) - (ticks == 0); 
+
+	b = min(b, TIME_BUCKETS - 1); 
+	h->min = ( h->cnt == 0 || ticks < h->min ) ? ticks : h->min; 
+	h->max = max(h->max, ticks); 
+	h->cnt++; 
+	h->tot += ticks; 
+	h->bucket[b]++; 
+}
+
+static inline void time_end(int phase, uint64_t start)
+{
+	if ( use_timing ) 
+		time_add(phase, read_tsc() - start); 
+}
+
+/**
+ * back from parking at lock->mutex. 
+ */
+static inline void time_woken(void)
+{
+	if ( use_timing && wa[myid].wake_tsc ) { 
+		time_add(TIME_WAKEUP, read_tsc() - wa[myid].wake_tsc); 
+		wa[myid].wake_tsc = 0; 
+	}
+}
+
+#define TIMED(phase, call) ({ \
+	uint64_t _start = time_begin(); \
+	__typeof__(call) _ret = (call); \
+	time_end(phase, _start); \
+	_ret; \
+})
+
+// below here, the queue and the non-blocking mutex ops are timed 
+#define AddQ(q, item)            TIMED(TIME_QUEUE, AddQ(q, item)) 
+#define DelQ(q)                  TIMED(TIME_QUEUE, DelQ(q)) 
+#define DelItemQ(q, item)        TIMED(TIME_QUEUE, DelItemQ(q, item)) 
+#define GetHeadQ(q)              TIMED(TIME_QUEUE, GetHeadQ(q)) 
+#define pthread_mutex_trylock(m) TIMED(TIME_MUTEX, pthread_mutex_trylock(m)) 
+#define pthread_mutex_unlock(m)  TIMED(TIME_MUTEX, pthread_mutex_unlock(m)) 
+
+/**
+ * DPTHREAD_TIMING: per phase the count, average, min and max in ns over 
+ * all threads, then the latency histogram by the lower bound of each 
+ * log2 bucket. 
+ */
+static void timing_write(void)
+{
+	struct time_hist all; 
+	FILE *fp; 
+	int i, k, b, first, last; 
+
+	if ( !(fp = fopen(timing_file, "w")) ) { 
+		warn("%s", timing_file); 
+		return; 
+	}
+	for ( k = 0; k < TIME_NR_PHASES; k++ ) { 
+		memset(&all, 0, sizeof(all)); 
+		for ( i = 0; i < MAX_THR; i++ ) { 
+			struct time_hist *h = &time_hists[i][k]; 
+
+			if ( h->cnt == 0 ) 
+				continue; 
+			if ( all.cnt == 0 || h->min < all.min ) 
+				all.min = h->min; 
+			all.max = max(all.max, h->max); 
+			all.cnt += h->cnt; 
+			all.tot += h->tot; 
+			for ( b = 0; b < TIME_BUCKETS; b++ ) 
+				all.bucket[b] += h->bucket[b]; 
+		}
+		if ( all.cnt == 0 ) 
+			continue; 
+		fprintf(fp, "%-14s count %llu avg %.1f min %.1f max %.1f ns\n", 
+			time_phase[k], (unsigned long long)all.cnt, 
+			all.tot * 1000.0 / tsc_per_usec / all.cnt, 
+			all.min * 1000.0 / tsc_per_usec, all.max * 1000.0 / tsc_per_usec); 
+		for ( first = 0; !all.bucket[first]; first++ ); 
+		for ( last = TIME_BUCKETS - 1; !all.bucket[last]; last-- ); 
+		for ( b = first; b <= last; b++ ) { 
+			fprintf(fp, "  %14.1f %12llu\n", 
+				(b ? (double)(1ULL << (b - 1)) : 0.0) * 1000.0 / tsc_per_usec, 
+				(unsigned long long)all.bucket[b]); 
+		}
+	}
+	fclose(fp); 
+}
+
+/**
+ * read performance counter data 
+ */ 
+static uint64_t __read_count(perf_event_desc_t *fds)
+{
+#if USE_PERF_COUNTER
+	int ret; 
+	uint64_t values[3]; /* [0] - raw, [1] - time_enabled, [2] - time_running */ 
+	ret = read(fds->fd, values, sizeof(values));
+	// assert(values[1] == values[2]); // owise. incorrect 
+	if ( values[1] != values[2] ) { 
+		DBG(0, "%s: values[]=%lld,%lld,%lld\n", 
+			__FUNCTION__, values[0], values[1], values[2]); 
+	}
+	return values[0]; 
+#else 
+	return 0; 
+#endif
+}
+
+static uint64_t read_count(perf_event_desc_t *fds)
+{
+	uint64_t start = time_begin(); 
+	int64_t count; 
+#if USE_INST_COUNT
+	count =  __read_count(&fds[0]) - // inst
+		__read_count(&fds[1]) - // intr
+		__read_count(&fds[2]);  // page fault 
+#else /* store count only */ 
+	count = __read_count(&fds[0]); 
+#endif 
+	time_end(TIME_COUNTER_READ, start); 
+	return count; 
+}
+
+
+static int64_t get_logical_clock(int id)
+{
+	int64_t ret, hw_clock; 
+
+	__sync_synchronize(); 
+	if ( !wa[id].hw_clock_enabled ) {
+		// hw counter of remote processor is currently disabled. 
+		ret = GET_CLOCK(id); 
+		DBG(4, "clock %d is disabled.\n", id); 
+		cache_read ++; 
+	} else if ( wa[id].pid != my_pid ) {
+		// counter of another process of the group can't be read. 
+		// the clock published at its last sync op is a lower bound. 
+		ret = GET_CLOCK(id); 
+		cache_read ++; 
+	} else {
+		// hw counter of remote processor is currently enabled 
+		// read counter value of remote processor directly from the hw counter. 
+		hw_clock = read_count(wa[id].fds); 
+		ret = hw_clock + wa[id].sw_clock; 
+		hw_read ++; 
+		// DBG(4, "clock %d is enabled. so read from hw = %lld\n", id, hw_clock); 
+	}
+	__sync_synchronize(); 
+
+	return ret; 
+}
+
+static int enable_performance_counter()
+{
+	if ( grp->mode == DET_MODE_NATIVE ) return 0; // stays stopped 
+
+	if ( wa[myid].fds ) { 
+		uint64_t start = time_begin(); 
+#if USE_INST_COUNT
+		ioctl(wa[myid].fds[0].fd, PERF_EVENT_IOC_ENABLE, 0);  	
+		ioctl(wa[myid].fds[1].fd, PERF_EVENT_IOC_ENABLE, 0);  	
+		ioctl(wa[myid].fds[2].fd, PERF_EVENT_IOC_ENABLE, 0);  	
+#else 
+		ioctl(wa[myid].fds[0].fd, PERF_EVENT_IOC_ENABLE, 0);  	
+#endif 
+		// the counter is on: keep it for disable_logical_clock() 
+		if ( use_timing ) time_ioctl_enable = read_tsc() - start; 
+	}
+	return 0; 
+}
+
+static int disable_performance_counter()
+{
+	if ( wa[myid].fds ) { 
+		uint64_t start = time_begin(); 
+#if USE_INST_COUNT
+		ioctl(wa[myid].fds[0].fd, PERF_EVENT_IOC_DISABLE, 0);  	
+		ioctl(wa[myid].fds[1].fd, PERF_EVENT_IOC_DISABLE, 0);  	
+		ioctl(wa[myid].fds[2].fd, PERF_EVENT_IOC_DISABLE, 0);  	
+#else 
+		ioctl(wa[myid].fds[0].fd, PERF_EVENT_IOC_DISABLE, 0);  	
+#endif 
+		time_end(TIME_IOCTL_DISABLE, start); 
+	}
+	return 0; 
+}
+
+
+static int enable_logical_clock()
+{
+	uint64_t start = time_begin(); 
+
+	if ( !wa[myid].fds ) return -1; // not initialized 
+
+	__sync_synchronize(); 
+	if ( wa[myid].hw_clock_enabled) return -1; // already enabled. 
+	// before the counter runs, so the clock is the same with or w/o the 
+	// profile. toggle_tsc is the disabling; what is left here is the ioctl. 
+	if ( prof_on ) prof_sample(); 
+
+	DBG(4, "%s: hw_clock = %lld, enabled=%d\n", 
+	    __FUNCTION__, wa[myid].hw_clock, wa[myid].hw_clock_enabled); 
+
+#if USE_FAKE_DISABLE
+	clock_diff = read_count(wa[myid].fds) - wa[myid].hw_clock; 
+	wa[myid].sw_clock -= clock_diff;  // FIXME
+	// DBG(1, "enable: diff = %lld\n", clock_diff); 
+	wa[myid].hw_clock  += clock_diff; 
+	// DBG(1, "enable: curr = %lld\n", GET_CLOCK(myid));
+	wa[myid].hw_clock_enabled = 1; 
+	__sync_synchronize(); 
+	time_end(TIME_CLOCK_ENABLE, start); // the counter never stops 
+#else /* !USE_FAKE_DISABLE */ 
+	time_end(TIME_CLOCK_ENABLE, start); // up to the ioctl, before it counts 
+	__sync_synchronize(); 
+	wa[myid].hw_clock_enabled = 1; 
+	enable_performance_counter();
+#endif /* USE_FAKE_DISABLE */ 
+
+	return 0; 
+
+}
+
+/**
+ * not inlined: prof_stack() skips its frame. 
+ */
+static int __attribute__((noinline)) disable_logical_clock()
+{
+	uint64_t start = time_begin(); 
+
+	if ( !wa[myid].fds ) return -1; // not initialized 
+	if ( !wa[myid].hw_clock_enabled ) return -1; // already disabled. 
+	if ( prof_period ) prof_begin(); 
+
+#if USE_FAKE_DISABLE 
+	__sync_synchronize(); 
+	wa[myid].hw_clock_enabled = 0; 
+	__sync_synchronize(); 
+	wa[myid].hw_clock = read_count(wa[myid].fds); 
+	__sync_synchronize(); 
+#else /* !USE_FAKE_DISABLE */ 
+	if ( grp->mode != DET_MODE_NATIVE ) { // stopped at the switch 
+		disable_performance_counter(); 
+		wa[myid].hw_clock = read_count(wa[myid].fds); 
+	}
+	__sync_synchronize(); 
+	wa[myid].hw_clock_enabled = 0;
+	__sync_synchronize(); 
+#endif /* USE_FAKE_DISABLE */ 
+
+	DBG(4, "%s: hw_clock = %lld, enabled=%d\n", 
+	    __FUNCTION__, wa[myid].hw_clock, wa[myid].hw_clock_enabled); 
+
+	time_end(TIME_CLOCK_DISABLE, start); 
+	if ( time_ioctl_enable ) { 
+		time_add(TIME_IOCTL_ENABLE, time_ioctl_enable); 
+		time_ioctl_enable = 0; 
+	}
+	if ( prof_on ) { 
+		prof_toggle_tsc = read_tsc() - prof_tsc; 
+		prof_stack(); 
+	}
+
+	return 0; 
+}
+
+/**
+ * use of an object of another domain is not ordered. refuse it. 
+ */
+static int check_domain(int domain, const char *op, int id)
+{
+	int lret; 
+
+	if ( domain == DET_DOMAIN_GLOBAL || domain == wa[myid].domain ) 
+		return 0; 
+
+	lret = disable_logical_clock(); 
+	DBG(0, "%s(%d): object of domain %d is used in domain %d\n", 
+	    op, id, domain, wa[myid].domain); 
+	if ( lret == 0 ) enable_logical_clock(); 
+	return EPERM; 
+}
+
+/**
+ * a blocked timed waiter times out when its deadline is the minimum clock 
+ * of its domain, i.e. when its turn comes. 
+ */
+static void timed_expire(int id)
+{
+	int i, pass; 
+	int64_t deadline, other_clock; 
+	int domain = wa[id].timed_domain; 
+
+	if ( wa[id].timed_state != 1 || wa[id].parked != 3 ) 
+		return; 
+	deadline = GET_CLOCK(id); 
+
+	for ( pass = 0; pass < 2; pass++ ) { 
+		for ( i = 0; i < grp->max_thr; i++ ) { 
+			if ( i == id ) continue; 
+			if ( domain != DET_DOMAIN_GLOBAL && wa[i].domain != domain ) 
+				continue; 
+			other_clock = get_logical_clock(i); 
+			if ( other_clock < deadline || 
+			     ( other_clock == deadline && i < id ) ) 
+				return; 
+		}
+	}
+
+	if ( __sync_bool_compare_and_swap(&wa[id].timed_state, 1, 2) ) { 
+		DBG(2, "timed wait of %d expired at %lld\n", id, deadline); 
+		pthread_mutex_unlock(wa[id].timed_mutex); 
+	}
+}
+
+/**
+ * a thread that parks, exits or moves its clock far ahead may leave the 
+ * deadline of a blocked timed waiter as the minimum, with nobody left in 
+ * wait_for_turn() to notice. it checks the timed waiters on its way. 
+ */
+static void timed_kick(void)
+{
+	int i; 
+
+	__sync_synchronize(); 
+	if ( grp->timed_waiters == 0 ) 
+		return; 
+	for ( i = 0; i < grp->max_thr; i++ ) 
+		if ( wa[i].timed_state == 1 ) 
+			timed_expire(i); 
+}
+
+/**
+ * wait until my logical time is minima among the threads of the domain. 
+ * DET_DOMAIN_GLOBAL waits for all threads. 
+ */
+static int64_t wait_for_turn(int domain)
+{
+	int i; 
+	int64_t my_clock, other_clock; 
+	int nthreads; 
+	uint64_t tsc = 0, scan; 
+	uint64_t blame_tsc = 0; 
+	int blocker = -1; 
+
+	if ( grp->max_thr == 0 ) return 0; // nothing 
+	if ( grp->mode == DET_MODE_NATIVE ) return GET_CLOCK(myid); 
+	if ( obj_stats || prof_on || use_timing ) tsc = read_tsc(); 
+	if ( top ) top->thread[myid].turn = 1; 
+
+	assert( !wa[myid].hw_clock_enabled); 
+
+	my_clock = get_logical_clock(myid); 
+retry:
+	scan = time_begin(); 
+	nthreads = grp->max_thr; 
+	for ( i = 1; i < nthreads; i++ ) { 
+		int id = (myid + i) % nthreads; 
+
+		if ( domain != DET_DOMAIN_GLOBAL && wa[id].domain != domain ) 
+			continue; // independent turn order 
+
+		// try with phyiscal clock value
+		other_clock = get_logical_clock(id);
+
+		if ( other_clock < my_clock ||  // i'm not the minimum  
+		     ( other_clock == my_clock && myid > id) ) {
+			if ( blame || top ) { 
+				// blame the least clock, whose turn comes first, 
+				// not the first one found behind. 
+				int min_id = id, j; 
+				int64_t min_clock = other_clock; 
+
+				for ( j = i + 1; j < nthreads; j++ ) { 
+					int k = (myid + j) % nthreads; 
+					int64_t c; 
+
+					if ( domain != DET_DOMAIN_GLOBAL && wa[k].domain != domain ) 
+						continue; 
+					c = get_logical_clock(k); 
+					if ( c < min_clock || ( c == min_clock && k < min_id ) ) { 
+						min_id = k; 
+						min_clock = c; 
+					}
+				}
+				if ( blame ) 
+					blame_sample(&blocker, &blame_tsc, min_id, my_clock - min_clock); 
+				if ( top ) { 
+					top->thread[myid].blocker = min_id; 
+					top->thread[myid].retries++; 
+				}
+			}
+			if ( wa[id].timed_state == 1 ) 
+				timed_expire(id); 
+			time_end(TIME_TURN_SCAN, scan); 
+			pthread_yield(); 
+			goto retry; 
+		}
+	}
+	time_end(TIME_TURN_SCAN, scan); 
+	
+	__sync_synchronize(); 
+	if ( grp->max_thr != nthreads ) {
+		DBG(3, "thread are changed to %d\n", grp->max_thr); 
+		goto retry; 
+	}
+
+	DBG(2, "return from wait_for_turn\n");
+
+	if ( obj_stats || prof_on || use_timing ) { 
+		uint64_t dur = read_tsc() - tsc; 
+		if ( obj_stats ) turn_tsc += dur; 
+		if ( prof_on ) prof_turn_tsc += dur; 
+		if ( use_timing ) time_add(TIME_TURN, dur); 
+	}
+	if ( blocker >= 0 ) blame_sample(&blocker, &blame_tsc, -1, 0); 
+	if ( top ) top->thread[myid].turn = 0; 
+	return my_clock; 
+}
+
+static int open_pfm_counter( struct worker_args *w ) 
+{
+	int nevts, i; 
+	size_t pgsz;
+	pgsz = sysconf(_SC_PAGESIZE);
+
+	DBG(2, "open pfm counter\n"); 
+	/* open performance counter */ 
+#if USE_INST_COUNT
+	nevts = perf_setup_list_events("INST_RETIRED,HW_INT_RCV,PERF_COUNT_SW_PAGE_FAULTS,PERF_COUNT_SW_CONTEXT_SWITCHES", &w->fds); 
+#else /* store count */ 
+  #if USE_INTEL_CORE2
+	nevts = perf_setup_list_events("INST_RETIRED:STORES,PERF_COUNT_SW_CONTEXT_SWITCHES", &w->fds); 
+  #elif USE_INTEL_NEHALEM 
+	nevts = perf_setup_list_events("INST_RETIRED,PERF_COUNT_SW_CONTEXT_SWITCHES", &w->fds); 
+  #else 
+	#error "Unsupported Architecture" 
+  #endif 
+#endif 
+	if (nevts < 1)
+		errx(1, "cannot monitor event");
+	w->nevts = nevts; 
+	w->fds[0].fd = -1; 
+	for ( i = 0; i < nevts; i++ ) { 
+		w->fds[i].hw.disabled = 1; /* do not enable now */
+
+		w->fds[i].hw.exclusive = 1; 
+		w->fds[i].hw.pinned = 1; 
 
 #if PROFILE_KERNEL_EVENTS
 		w->fds[i].hw.exclude_kernel = 0;  /* include kernel event */ 
 #endif 
-		w->fds[i].hw.read_format = PERF_FORMAT_SCALE; 
-		w->fds[i].fd = 
-			perf_event_open(&w->fds[i].hw, gettid(), -1, -1, 0);
-		if (w->fds[i].fd == -1)	
-			err(1, "cannot attach event %s", w->fds[i].name);
-		w->fds[i].buf = 
-			mmap(NULL, 2* pgsz, PROT_READ|PROT_WRITE, MAP_SHARED, w->fds[i].fd, 0);
-		if (w->fds[i].buf == MAP_FAILED) 
-			err(1, "cannot mmap buffer");
-		w->fds[i].pgmsk = (pgsz) - 1;
+		w->fds[i].hw.read_format = PERF_FORMAT_SCALE; 
+		w->fds[i].fd = 
+			perf_event_open(&w->fds[i].hw, gettid(), -1, -1, 0);
+		if (w->fds[i].fd == -1)	
+			err(1, "cannot attach event %s", w->fds[i].name);
+		w->fds[i].buf = 
+			mmap(NULL, 2* pgsz, PROT_READ|PROT_WRITE, MAP_SHARED, w->fds[i].fd, 0);
+		if (w->fds[i].buf == MAP_FAILED) 
+			err(1, "cannot mmap buffer");
+		w->fds[i].pgmsk = (pgsz) - 1;
+	}
+	return 0; 
+}
+
+static void *worker_thread(void *v)
+{
+	struct worker_args *w = (struct worker_args *)v; 
+	int ret; 
+	char *ptr; 
+	
+	/* assign myid (TLS) */ 
+	myid = w->id; 
+	my_det_enabled = 1; 
+	my_det_clock = 0; 
+
+	cpu_set_t cmask;
+
+	assert(num_processors > 0 ); 
+
+	CPU_ZERO(&cmask);
+	CPU_SET(myid % num_processors, &cmask);
+	sched_setaffinity(0, num_processors, &cmask); 
+
+	if ( (ptr = getenv("DPTHREAD_RT") ) ) { 
+		struct sched_param param;
+		param.sched_priority = 1; 
+		if(sched_setscheduler(0, SCHED_FIFO, &param) == -1) {
+			perror("sched_setscheduler failed");
+		}
+	}
+
+	/* open counter */ 
+	open_pfm_counter(w); 
+
+	enable_logical_clock(); 
+	
+	// physically enable performance counter 
+	enable_performance_counter();
+
+	det_lock(&w->thread_lock); 
+	w->started = 1; 
+	det_cond_signal(&w->thread_cond); 
+	det_unlock(&w->thread_lock); 
+
+	/* execute user supplied function */ 
+	w->func(w->arg); 
+
+	/* cleanup and finish */ 
+	det_exit((void *)&ret); // do not return 
+
+	assert(0); // should not reach here. 
+	return NULL; 
+}
+
+#if USE_CHECKPOINT
+///////////////////////////////////////////////////////////////////////////////////
+// deterministic checkpoint 
+///////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A checkpoint is a fork()ed copy of the process taken when every other live 
+ * thread is parked in det_cond_wait(). The copy stays suspended while the 
+ * original keeps running. When resumed (SIGUSR2, see ckpt-resume.sh), the 
+ * parked threads are re-created from the contexts saved in det_cond_wait(). 
+ */
+
+static void close_pfm_counter(struct worker_args *w)
+{
+	int i; 
+	size_t pgsz = sysconf(_SC_PAGESIZE);
+
+	if ( !w->fds ) return; 
+	for ( i = 0; i < w->nevts; i++ ) { 
+		munmap(w->fds[i].buf, 2 * pgsz); 
+		close(w->fds[i].fd); 
+	}
+	free(w->fds); 
+	w->fds = NULL; 
+}
+
+static void ckpt_stack_attr(struct worker_args *w, pthread_attr_t *ckpt_attr, 
+			    const pthread_attr_t *attr)
+{
+	size_t size = 8 << 20; 
+	int state; 
+
+	pthread_attr_init(ckpt_attr); 
+	if ( attr ) { 
+		pthread_attr_getstacksize(attr, &size); 
+		pthread_attr_getdetachstate(attr, &state); 
+		pthread_attr_setdetachstate(ckpt_attr, state); 
+	}
+	w->ckpt_stack = mmap(NULL, size, PROT_READ|PROT_WRITE, 
+			     MAP_PRIVATE|MAP_ANONYMOUS|MAP_STACK, -1, 0); 
+	if ( w->ckpt_stack == MAP_FAILED ) 
+		err(1, "cannot allocate stack"); 
+	w->ckpt_stack_size = size; 
+	pthread_attr_setstack(ckpt_attr, w->ckpt_stack, size); 
+}
+
+/**
+ * all the other threads are parked (or exited) with their context saved. 
+ */ 
+static int ckpt_is_quiescent()
+{
+	int i, pass; 
+
+	for ( pass = 0; pass < 2; pass++ ) { 
+		for ( i = 0; i < grp->max_thr; i++ ) { 
+			if ( i == myid || wa[i].finished ) continue; 
+			while ( 1 ) { 
+				__sync_synchronize(); 
+				if ( !wa[i].parked || wa[i].parked == 3 ) 
+					return 0; // running, signaled or no context 
+				if ( GET_CLOCK(i) >= MAX_LOGICAL_CLOCK ) 
+					break;    // parked 
+				sched_yield(); // still releasing its mutex 
+			}
+		}
+	}
+	return 1; 
+}
+
+/**
+ * private dirty memory of a snapshot. it grows as the original process 
+ * writes to pages shared copy-on-write with the snapshot. 
+ */
+static long ckpt_mem_kb(pid_t pid)
+{
+	char path[64], line[256]; 
+	long kb, total = 0; 
+	FILE *fp; 
+
+	sprintf(path, "/proc/%d/smaps_rollup", pid); 
+	if ( !(fp = fopen(path, "r")) ) { 
+		sprintf(path, "/proc/%d/smaps", pid); 
+		if ( !(fp = fopen(path, "r")) ) return 0; 
+	}
+	while ( fgets(line, sizeof(line), fp) ) { 
+		if ( sscanf(line, "Private_Dirty: %ld kB", &kb) == 1 ) 
+			total += kb; 
+	}
+	fclose(fp); 
+	return total; 
+}
+
+static void ckpt_evict(int idx)
+{
+	DBG(1, "CKPT: discard pid=%d clock=%lld\n", ckpt[idx].pid, ckpt[idx].clock); 
+	kill(ckpt[idx].pid, SIGTERM); 
+	waitpid(ckpt[idx].pid, NULL, 0); 
+	ckpt_count--; 
+	memmove(&ckpt[idx], &ckpt[idx+1], (ckpt_count - idx) * sizeof(ckpt[0])); 
+}
+
+static void ckpt_cleanup(void)
+{
+	if ( ckpt_keep ) return; 
+	while ( ckpt_count > 0 ) 
+		ckpt_evict(0); 
+}
+
+static void *ckpt_resume_thread(void *v)
+{
+	struct worker_args *w = (struct worker_args *)v; 
+	cpu_set_t cmask;
+
+	myid = w->id; 
+	my_det_enabled = 1; 
+	lock_count = w->ckpt_lock_count; 
+	barrier_count = w->ckpt_barrier_count; 
+
+	CPU_ZERO(&cmask);
+	CPU_SET(myid % num_processors, &cmask);
+	sched_setaffinity(0, num_processors, &cmask); 
+
+	/* counters are per physical thread */ 
+	close_pfm_counter(w); 
+	open_pfm_counter(w); 
+
+	if ( setjmp(w->ckpt_exit_jmp) == 0 ) { 
+		w->ckpt_resumed = 1; 
+		setcontext(&w->ckpt_ctx); // continue in det_cond_wait() 
+	}
+	return w->ckpt_retval; // det_exit() 
+}
+
+/**
+ * snapshot side of the fork. returns only when resumed. 
+ */
+static void ckpt_snapshot(int64_t clock)
+{
+	sigset_t set, oset; 
+	int i, sig; 
+
+	ckpt_count = 0; // the other snapshots are not my children 
+
+	sigemptyset(&set); 
+	sigaddset(&set, SIGUSR2); 
+	sigaddset(&set, SIGTERM); 
+	sigaddset(&set, SIGINT); 
+	pthread_sigmask(SIG_BLOCK, &set, &oset); 
+	if ( sigwait(&set, &sig) != 0 || sig != SIGUSR2 ) 
+		_exit(0); 
+	pthread_sigmask(SIG_SETMASK, &oset, NULL); 
+
+	DBG(0, "CKPT: resume pid=%d from clock %lld\n", getpid(), clock); 
+
+	// new counters start from zero. rebase the logical clocks. 
+	for ( i = 0; i < grp->max_thr; i++ ) { 
+		int64_t logical = GET_CLOCK(i); 
+		wa[i].hw_clock = 0; 
+		wa[i].sw_clock = logical; 
+	}
+	close_pfm_counter(&wa[myid]); 
+	open_pfm_counter(&wa[myid]); 
+
+	for ( i = 0; i < grp->max_thr; i++ ) { 
+		if ( i == myid ) continue; 
+		if ( wa[i].finished ) { 
+			wa[i].ckpt_orphan = 1; 
+			continue; 
+		}
+		wa[i].parked = 0; 
+		pthread_create(&wa[i].ckpt_tid, NULL, ckpt_resume_thread, &wa[i]); 
+	}
+}
+
+/**
+ * take a checkpoint. called by the last thread arriving at a barrier. 
+ */
+static void ckpt_take(int64_t clock)
+{
+	pid_t pid; 
+	long total = 0; 
+	FILE *fp; 
+	int i; 
+
+	if ( !ckpt_is_quiescent() ) { 
+		DBG(2, "CKPT: not quiescent at %lld\n", clock); 
+		return; 
+	}
+
+	if ( ckpt_count == ckpt_max || ckpt_count == CKPT_MAX_ENTRIES ) 
+		ckpt_evict(0); 
+
+	fflush(NULL); // do not duplicate buffered output 
+	pid = fork(); 
+	if ( pid < 0 ) { 
+		DBG(0, "CKPT: fork failed (%s)\n", strerror(errno)); 
+		return; 
+	} else if ( pid == 0 ) { 
+		ckpt_snapshot(clock); 
+		return; 
+	}
+
+	ckpt[ckpt_count].pid = pid; 
+	ckpt[ckpt_count].clock = clock; 
+	ckpt[ckpt_count].mem_kb = 0; 
+	ckpt_count++; 
+	ckpt_seq++; 
+
+	// memory accounting. the oldest snapshot goes first. 
+	for ( i = 0; i < ckpt_count; i++ ) { 
+		ckpt[i].mem_kb = ckpt_mem_kb(ckpt[i].pid); 
+		total += ckpt[i].mem_kb; 
+	}
+	while ( ckpt_mem_limit > 0 && total > ckpt_mem_limit && ckpt_count > 1 ) { 
+		total -= ckpt[0].mem_kb; 
+		ckpt_evict(0); 
+	}
+
+	if ( (fp = fopen(ckpt_file, "a")) ) { 
+		fprintf(fp, "%d %lld %d\n", pid, (long long)clock, ckpt_seq); 
+		fclose(fp); 
+	}
+
+	DBG(1, "CKPT(%d): pid=%d clock=%lld, %d held (%ld KB)\n", 
+	    ckpt_seq, pid, clock, ckpt_count, total); 
+}
+#endif /* USE_CHECKPOINT */ 
+
+///////////////////////////////////////////////////////////////////////////////////
+// multi-process group 
+///////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * move the group to a shared mapping. a name with a '/' after the first 
+ * character is a file, otherwise a POSIX shm object. det_fork()ed processes 
+ * inherit the mapping at the same address, so the pointers kept in the 
+ * queues of process-shared objects are valid in all of them. 
+ */ 
+static void shm_attach(const char *name, size_t queue_size)
+{
+	struct det_group *g; 
+	pthread_mutexattr_t attr; 
+	size_t size; 
+	int fd; 
+
+	size = sizeof(struct det_group) + queue_size; 
+	snprintf(shm_name, sizeof(shm_name), "%s", name); 
+
+	if ( strchr(name + 1, '/') ) 
+		fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0600); 
+	else 
+		fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600); 
+	if ( fd < 0 ) 
+		err(1, "cannot open DPTHREAD_SHM %s", name); 
+	if ( ftruncate(fd, size) < 0 ) 
+		err(1, "cannot resize DPTHREAD_SHM %s", name); 
+
+	g = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0); 
+	if ( g == MAP_FAILED ) 
+		err(1, "cannot mmap DPTHREAD_SHM %s", name); 
+	close(fd); 
+
+	pthread_mutexattr_init(&attr); 
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED); 
+	pthread_mutex_init(&g->count_mutex, &attr); 
+	pthread_mutexattr_destroy(&attr); 
+
+	g->shm_size = size; 
+	g->shm_used = sizeof(struct det_group); 
+	g->shm_leader = getpid(); 
+
+	grp = g; 
+	wa = g->wa; 
+}
+
+/**
+ * queue storage of process-shared objects. never freed. 
+ */ 
+static void *shm_alloc(size_t size)
+{
+	size_t off; 
+
+	off = __sync_fetch_and_add(&grp->shm_used, size); 
+	if ( off + size > grp->shm_size ) 
+		errx(1, "DPTHREAD_SHM is full. increase DPTHREAD_SHM_SIZE"); 
+	return (char *)grp + off; 
+}
+
+static void sync_mutex_init(pthread_mutex_t *mutex, int pshared)
+{
+	pthread_mutexattr_t attr; 
+
+	pthread_mutexattr_init(&attr); 
+	if ( pshared ) 
+		pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED); 
+	pthread_mutex_init(mutex, &attr); 
+	pthread_mutexattr_destroy(&attr); 
+}
+
+static void sync_queue_init(TQueue *queue, int pshared)
+{
+	if ( pshared && grp->shm_size > 0 ) 
+		InitQBuf(queue, shm_alloc(MAX_THR * sizeof(void *)), MAX_THR); 
+	else 
+		InitQ(queue, MAX_THR); 
+}
+
+static void sync_queue_destroy(TQueue *queue)
+{
+	// shm_alloc()ed storage of process-shared objects stays 
+	if ( (char *)queue->array >= (char *)grp && 
+	     (char *)queue->array < (char *)grp + grp->shm_size ) 
+		return; 
+	DestroyQ(queue); 
+}
+
+static void group_exit(void); 
+
+///////////////////////////////////////////////////////////////////////////////////
+// process-wide det/native mode 
+///////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * every thread is at the switch, blocked in det_cond_wait(), det_disable()d 
+ * or exited. 
+ */ 
+static int mode_quiescent(void)
+{
+	int i; 
+
+	for ( i = 0; i < grp->max_thr; i++ ) { 
+		__sync_synchronize(); 
+		if ( wa[i].finished || wa[i].mode_arrived || wa[i].parked >= 2 ) 
+			continue; 
+		if ( !wa[i].parked && GET_CLOCK(i) >= MAX_LOGICAL_CLOCK ) 
+			continue; 
+		return 0; 
+	}
+	return 1; 
+}
+
+/**
+ * a deterministic window starts with all the threads at the same clock, 
+ * above any release time of the previous windows. 
+ */ 
+static void mode_switch(void)
+{
+	int i; 
+	int64_t base = 0; 
+
+	for ( i = 0; i < grp->max_thr; i++ ) { 
+		base = max(base, wa[i].last_release_logical_time); 
+		if ( wa[i].mode_arrived ) 
+			base = max(base, wa[i].mode_clock); 
+	}
+	base ++; 
+
+	for ( i = 0; i < grp->max_thr; i++ ) { 
+		if ( wa[i].mode_arrived ) { 
+			SET_CLOCK(i, base); 
+		} else if ( wa[i].timed_state == 1 && !wa[i].finished ) { 
+			// times out in its turn, but not before the window 
+			SET_CLOCK(i, max(base, wa[i].timed_deadline)); 
+		} else if ( wa[i].parked >= 2 || wa[i].finished ) { 
+			// native cond_wait and exit don't set it. 
+			SET_CLOCK(i, MAX_LOGICAL_CLOCK); 
+		}
+	}
+
+	grp->mode = grp->mode_request; 
+
+	// logical time stands still in native mode. a timed wait blocked for 
+	// its logical deadline times out at the switch. 
+	if ( grp->mode == DET_MODE_NATIVE ) 
+		for ( i = 0; i < grp->max_thr; i++ ) 
+			if ( __sync_bool_compare_and_swap(&wa[i].timed_state, 1, 2) ) 
+				pthread_mutex_unlock(wa[i].timed_mutex); 
+
+	__sync_synchronize(); 
+	grp->mode_epoch ++; 
+
+	DBG(0, "MODE: %s from clock %lld (epoch %u)\n", 
+	    grp->mode == DET_MODE_DET ? "det" : "native", base, grp->mode_epoch); 
+}
+
+/**
+ * wait at the switch until the last thread arriving switches the mode. 
+ * the logical clock must be disabled. 
+ */ 
+static void mode_arrive(void)
+{
+	unsigned int epoch = grp->mode_epoch; 
+	struct worker_args *w = &wa[myid]; 
+
+	w->mode_clock = GET_CLOCK(myid); 
+	SET_CLOCK(myid, MAX_LOGICAL_CLOCK); // others finish their turns 
+	w->mode_arrived = 1; 
+	__sync_synchronize(); 
+
+	DBG(2, "MODE: arrived\n"); 
+
+	while ( grp->mode_epoch == epoch ) { 
+		if ( mode_quiescent() && 
+		     __sync_bool_compare_and_swap(&grp->mode_switching, 0, 1) ) { 
+			if ( grp->mode_epoch == epoch && mode_quiescent() ) 
+				mode_switch(); 
+			grp->mode_switching = 0; 
+		} else { 
+			sched_yield(); 
+		}
+	}
+
+	w->mode_arrived = 0; 
+	__sync_synchronize(); 
+}
+
+/**
+ * called at the entry of sync operations. 
+ */ 
+static void mode_check(void)
+{
+	int lret; 
+
+	if ( grp->mode_request == grp->mode || !my_det_enabled ) 
+		return; 
+
+	lret = disable_logical_clock(); 
+	mode_arrive(); 
+	if ( lret == 0 ) enable_logical_clock(); 
+}
+
+static void mode_signal_handler(int sig)
+{
+	int mode = grp->mode; 
+
+	// toggle unless a switch is pending. 
+	__sync_bool_compare_and_swap(&grp->mode_request, mode, !mode); 
+}
+
+/**
+ * passthrough to pthread. owner and ref are kept for the det mode. 
+ */ 
+static int native_trylock(det_mutex_t *mutex)
+{
+	int ret; 
+
+#if USE_MUTEX_RECURSIVE 
+	if ( mutex->ref > 0 && mutex->owner == myid ) { 
+		mutex->ref++; 
+		return 0; 
+	} 
+#endif 
+	if ( (ret = pthread_mutex_trylock(&mutex->mutex)) == 0 ) { 
+		mutex->owner = myid; 
+		mutex->ref = 1; 
+	}
+	return ret; 
+}
+
+static int lock_acquire(det_mutex_t *mutex, int64_t deadline, void *site); 
+static int64_t real_usecs(void); 
+
+/**
+ * deadline is in logical time. in native mode the clock stands still, so 
+ * it is the logical time left that is waited for in real time. 
+ */ 
+static int native_lock(det_mutex_t *mutex, int64_t deadline)
+{
+	struct timespec ts; 
+	int64_t timeout = -1; 
+	int ret; 
+
+	if ( deadline < MAX_LOGICAL_CLOCK ) 
+		timeout = real_usecs() + 
+			(deadline - GET_CLOCK(myid)) / EVENTS_PER_USEC; 
+
+	while ( (ret = native_trylock(mutex)) == EBUSY ) { 
+		if ( grp->mode_request != grp->mode && my_det_enabled ) { 
+			// the owner may be waiting at the switch. 
+			mode_check(); 
+			if ( det_is_enabled() ) 
+				return lock_acquire(mutex, deadline, NULL); 
+			continue; 
+		}
+		if ( timeout >= 0 && real_usecs() >= timeout ) 
+			return ETIMEDOUT; 
+		// block, but come back to see a switch request. 
+		clock_gettime(CLOCK_REALTIME, &ts); 
+		ts.tv_nsec += 10000000; 
+		if ( ts.tv_nsec >= 1000000000 ) { 
+			ts.tv_sec ++; 
+			ts.tv_nsec -= 1000000000; 
+		}
+		if ( (ret = pthread_mutex_timedlock(&mutex->mutex, &ts)) == 0 ) { 
+			mutex->owner = myid; 
+			mutex->ref = 1; 
+			break; 
+		}
+		if ( ret != ETIMEDOUT ) 
+			break; 
+	}
+	return ret; 
+}
+
+static int native_unlock(det_mutex_t *mutex)
+{
+#if USE_MUTEX_RECURSIVE 
+	if ( --mutex->ref > 0 ) 
+		return 0; 
+	mutex->owner = -1; 
+#endif 
+	return pthread_mutex_unlock(&mutex->mutex); 
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// timed waits 
+///////////////////////////////////////////////////////////////////////////////////
+
+static int64_t real_usecs(void)
+{
+	struct timespec ts; 
+
+	clock_gettime(CLOCK_MONOTONIC, &ts); 
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000; 
+}
+
+/**
+ * absolute time of detio_gettimeofday()/detio_clock_gettime() to logical 
+ * time. 
+ */ 
+static int64_t timed_deadline(const struct timespec *abstime)
+{
+	int64_t usecs = (int64_t)abstime->tv_sec * 1000000 + abstime->tv_nsec / 1000; 
+
+	if ( usecs < 0 ) 
+		return 0; 
+	if ( usecs >= (MAX_LOGICAL_CLOCK - 1) / EVENTS_PER_USEC ) 
+		return MAX_LOGICAL_CLOCK - 1; 
+	return usecs * EVENTS_PER_USEC; 
+}
+
+/**
+ * the caller has queued lock and, still in its turn, moves its clock to 
+ * the deadline and parks (3). 
+ */ 
+static void timed_begin(det_mutex_t *lock, int domain, int64_t deadline)
+{
+	struct worker_args *w = &wa[myid]; 
+
+	w->timed_deadline = deadline; 
+	w->timed_domain = domain; 
+	w->timed_mutex = &lock->mutex; 
+	__sync_synchronize(); 
+	w->timed_state = 1; 
+}
+
+/**
+ * block until woken or timed out. the wait ends in logical time: 
+ * timed_expire(), by a thread in wait_for_turn() or timed_kick(), or by 
+ * me if my deadline is the minimum already. in native mode the logical 
+ * time left is waited for in real time. returns ETIMEDOUT or 0. 
+ * lock->mutex is locked again in both cases. timed_end() must follow. 
+ */ 
+static int timed_block(det_mutex_t *lock, int64_t span)
+{
+	struct worker_args *w = &wa[myid]; 
+	struct timespec ts; 
+	int64_t end; 
+	int ret; 
+
+	clock_gettime(CLOCK_REALTIME, &ts); 
+	end = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + span / EVENTS_PER_USEC; 
+	ts.tv_sec = end / 1000000; 
+	ts.tv_nsec = (end % 1000000) * 1000; 
+
+	__sync_fetch_and_add(&grp->timed_waiters, 1); 
+	while ( 1 ) { 
+		if ( grp->mode != DET_MODE_NATIVE ) { 
+			timed_expire(myid); 
+			pthread_mutex_lock(&lock->mutex); 
+			break; 
+		}
+		if ( pthread_mutex_timedlock(&lock->mutex, &ts) == 0 ) 
+			break; 
+		if ( grp->mode != DET_MODE_NATIVE ) 
+			continue; // the switch to det set my clock to the deadline 
+		if ( !__sync_bool_compare_and_swap(&w->timed_state, 1, 2) ) 
+			pthread_mutex_lock(&lock->mutex); // woken meanwhile 
+		break; 
+	}
+	__sync_fetch_and_sub(&grp->timed_waiters, 1); 
+
+	ret = (w->timed_state == 2) ? ETIMEDOUT : 0; 
+	w->parked = 0; 
+	if ( ret == 0 ) time_woken(); 
+	return ret; 
+}
+
+/**
+ * a timed out waiter clears its state after leaving the queue; until then 
+ * wake_waiter() skips it. 
+ */ 
+static void timed_end(void)
+{
+	__sync_synchronize(); 
+	wa[myid].timed_state = 0; 
+}
+
+/**
+ * hand over to a queued waiter unless its timed wait is over. 
+ */ 
+static int wake_waiter(det_mutex_t *lock, int64_t clock)
+{
+	if ( wa[lock->id].timed_state && 
+	     !__sync_bool_compare_and_swap(&wa[lock->id].timed_state, 1, 3) ) 
+		return -1; // timed out. it leaves the queue itself. 
+
+	wa[lock->id].parked = 0; 
+	SET_CLOCK(lock->id, clock); 
+	if ( use_timing ) wa[lock->id].wake_tsc = read_tsc(); 
+	pthread_mutex_unlock(&lock->mutex); 
+	return 0; 
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// dpthread core  
+///////////////////////////////////////////////////////////////////////////////////
+
+int det_increase_logical_clock(int incr)
+{
+	if ( !det_is_enabled() ) return -1; 
+	wa[myid].sw_clock +=incr; 
+	return 0; 
+}
+
+int det_enable_logical_clock(int incr)
+{
+	if (!det_is_enabled() ) return -1; 
+
+	wa[myid].sw_clock +=incr; 
+	return enable_logical_clock(); 
+}
+
+int det_disable_logical_clock()
+{
+	if ( !det_is_enabled() ) return -1; 
+
+	return disable_logical_clock(); 
+}
+
+int det_exit_logical_clock()
+{
+	if ( !det_is_enabled() ) return -1; 
+
+	wa[myid].last_exit_logical_time = GET_CLOCK(myid); 
+	SET_CLOCK(myid, MAX_LOGICAL_CLOCK); 
+	timed_kick(); 
+
+	return 0; 
+}
+
+/**
+ * @brief asynchronously wokeup by external event. 
+ * I catch up time progress up to last sync time. 
+ * use this function only for waiting for external events. 
+ */ 
+int det_adjust_logical_clock()
+{
+	if ( !det_is_enabled() ) return -1; 
+
+	if ( grp->last_sync_logical_time > wa[myid].last_exit_logical_time ) {
+		int lret = disable_logical_clock();
+		SET_CLOCK(myid, grp->last_sync_logical_time); 
+		wa[myid].nondet_count++; 
+		DBG(2, "got alarm\n"); 
+		if ( lret == 0 ) enable_logical_clock(); 
+	} else {
+		SET_CLOCK(myid, wa[myid].last_exit_logical_time); 
+	}
+
+	return 0; 
+}
+
+void det_set_debug(int level)
+{
+	debug_level = level; 
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// stall watchdog (DPTHREAD_WATCHDOG) 
+///////////////////////////////////////////////////////////////////////////////////
+
+#define WD_MAX_OBJ DET_TOP_MAX_MUTEX // objects of higher ids are not dumped 
+
+// by id, registered at init. there is no destroy; a dumped object is 
+// checked to still carry its id. 
+static det_mutex_t **wd_mutex; 
+static det_cond_t **wd_cond; 
+
+/**
+ * the clock of thread id as of now. the watchdog is not a dpthread thread: 
+ * its myid is 0, so no get_logical_clock() or read_count(), which time 
+ * into thread 0's histograms, and no DBG(). *running is set for a thread 
+ * of another process with its counter on, whose clock moves unseen. 
+ */
+static int64_t wd_clock(int id, int *running)
+{
+	if ( wa[id].hw_clock_enabled && wa[id].pid == my_pid && wa[id].fds ) { 
+		uint64_t values[3] = { 0 }; // raw, time_enabled, time_running 
+		int64_t count = 0; 
+#if USE_PERF_COUNTER
+		int k; 
+
+		for ( k = 0; k < (USE_INST_COUNT ? 3 : 1); k++ ) { 
+			if ( read(wa[id].fds[k].fd, values, sizeof(values)) != sizeof(values) ) 
+				values[0] = 0; 
+			count += k ? -(int64_t)values[0] : (int64_t)values[0]; 
+		}
+#endif 
+		return count + wa[id].sw_clock; 
+	}
+	if ( wa[id].hw_clock_enabled && wa[id].pid != my_pid && running ) 
+		*running = 1; 
+	return GET_CLOCK(id); 
+}
+
+static void wd_print_clock(int64_t clock)
+{
+	if ( clock >= MAX_LOGICAL_CLOCK ) 
+		fprintf(stderr, "MAX+%lld", (long long)(clock - MAX_LOGICAL_CLOCK)); 
+	else 
+		fprintf(stderr, "%lld", (long long)clock); 
+}
+
+static void wd_print_queue(TQueue *q, int of_locks)
+{
+	int k; 
+
+	for ( k = q->head; k != q->tail; k = (k + 1) % q->size ) { 
+		if ( of_locks ) 
+			fprintf(stderr, " %d", ((det_mutex_t *)q->array[k])->id); 
+		else 
+			fprintf(stderr, " %d", (int)(intptr_t)q->array[k]); 
+	}
+}
+
+/**
+ * the waits-for graph: threads, held or waited for mutexes and conds 
+ * with waiters, as queued in logical order. 
+ */
+static void wd_dump(int64_t min_clock)
+{
+	det_top_thread_t *t; 
+	int i, n; 
+
+	fprintf(stderr, "dpthread watchdog: pid %d, no clock has advanced in %d s, " 
+		"the minimum is ", (int)my_pid, wd_interval); 
+	wd_print_clock(min_clock); 
+	fprintf(stderr, "\n"); 
+	for ( i = 0; i < grp->max_thr; i++ ) { 
+		int64_t clock = wd_clock(i, NULL); 
+
+		t = &top->thread[i]; 
+		fprintf(stderr, "  thread %d: clock ", i); 
+		wd_print_clock(clock); 
+		if ( clock == min_clock ) 
+			fprintf(stderr, " (min)"); 
+		if ( wa[i].finished ) 
+			fprintf(stderr, ", exited"); 
+		else if ( wa[i].pid != my_pid ) 
+			fprintf(stderr, ", pid %d", (int)wa[i].pid); 
+		if ( t->turn ) 
+			fprintf(stderr, ", waiting for the turn behind thread %d", t->blocker); 
+		else if ( t->state == DET_TOP_BLOCKED ) 
+			fprintf(stderr, ", blocked at %s(%d)", trace_name[t->wait_op], t->wait_obj); 
+		else if ( !wa[i].finished ) 
+			fprintf(stderr, ", running since clock %lld", (long long)t->clock); 
+		if ( wa[i].parked ) 
+			fprintf(stderr, ", parked"); 
+		fprintf(stderr, "\n"); 
+	}
+
+	n = min(grp->g_lock_count + 1, WD_MAX_OBJ); 
+	for ( i = 1; i < n; i++ ) { 
+		det_mutex_t *m = wd_mutex[i]; 
+
+		if ( !m || m->id != i || (m->owner < 0 && m->queue.head == m->queue.tail) ) 
+			continue; 
+		fprintf(stderr, "  mutex %d: owner %d, released at %lld, queue:", 
+			i, m->owner, (long long)m->released_logical_time); 
+		wd_print_queue(&m->queue, 0); 
+		fprintf(stderr, "\n"); 
+	}
+	n = min(grp->g_cond_count + 1, WD_MAX_OBJ); 
+	for ( i = 1; i < n; i++ ) { 
+		det_cond_t *c = wd_cond[i]; 
+
+		if ( !c || c->id != i || c->queue.head == c->queue.tail ) 
+			continue; 
+		fprintf(stderr, "  cond %d: waiters:", i); 
+		wd_print_queue(&c->queue, 1); 
+		fprintf(stderr, "\n"); 
+	}
+	fflush(stderr); 
+}
+
+/**
+ * a thread outside of the deterministic set. it reports a stall once, when 
+ * the clocks of two or more threads all stand still for wd_interval 
+ * samples a second apart, and aborts then with DPTHREAD_WATCHDOG_ABORT. 
+ * a thread of another process running with its counter on is not stalled, 
+ * although its published clock stands still. 
+ */
+static void *watchdog_thread(void *v)
+{
+	uint64_t last = 0, clocks; 
+	int64_t min_clock, clock; 
+	int stalled = 0, running, live, i; 
+
+	while ( 1 ) { 
+		sleep(1); 
+		min_clock = INT64_MAX; 
+		clocks = 0; 
+		running = 0; 
+		for ( i = live = 0; i < grp->max_thr; i++ ) { 
+			if ( wa[i].finished ) 
+				continue; 
+			live++; 
+			clock = wd_clock(i, &running); 
+			min_clock = min(min_clock, clock); 
+			clocks = fingerprint_fold(clocks, clock); 
+		}
+		if ( grp->mode == DET_MODE_NATIVE || live < 2 || running || clocks != last ) { 
+			last = clocks; 
+			stalled = 0; 
+			continue; 
+		}
+		if ( ++stalled == wd_interval ) { 
+			wd_dump(min_clock); 
+			if ( wd_abort ) 
+				abort(); 
+		}
+	}
+	return NULL; 
+}
+
+/**
+ * initialize dpthread 
+ */
+int det_init(int argc, char *argv[])
+{
+	struct worker_args *w; 
+
+	/* 
+	   Environment variables: 
+	   DPTHREAD_DEBUG <number>     # enable debug. 0 - none, 1 - basic, 2 - verbose, 3 - all.
+	   DPTHREAD_CKPT_INTERVAL <clock> # checkpoint at a barrier every <clock> logical time
+	   DPTHREAD_CKPT_MAX <number>  # number of checkpoints to keep (default: 4)
+	   DPTHREAD_CKPT_MEM <KB>      # memory the checkpoints may hold (default: unlimited)
+	   DPTHREAD_CKPT_FILE <path>   # checkpoint index (default: ckpt.<pid>)
+	   DPTHREAD_CKPT_KEEP 1        # keep checkpoints after normal exit
+	   DPTHREAD_SHM <name|path>    # share the group with det_fork()ed processes
+	   DPTHREAD_SHM_SIZE <KB>      # storage for process-shared objects (default: 16384)
+	   DPTHREAD_MODE native        # start in native (pthread passthrough) mode
+	   DPTHREAD_MODE_SIGNAL <num>  # the signal toggles det/native mode
+	   DPTHREAD_TRACE <prefix>     # binary event trace to <prefix>.p<id>.trace (see tools/dptrace)
+	   DPTHREAD_TRACE_SIZE <number> # records per thread, the last ones are kept (default: 1048576)
+	   DPTHREAD_FINGERPRINT <path> # hash of the sync order of each thread, written at exit
+	   DPTHREAD_STATS <path>       # per mutex/cond/barrier contention as JSON, written at exit
+	   DPTHREAD_BLAME <path>       # turn-wait time by waiter and blocking thread, written at exit
+	   DPTHREAD_PROFILE <prefix>   # sync costs by call stack, <prefix>.*.folded for flame graphs
+	   DPTHREAD_PROFILE_PERIOD <number> # sample every Nth op (default: 64)
+	   DPTHREAD_PROFILE_DEPTH <number>  # frames per stack, up to 16 (default: 8)
+	   DPTHREAD_TIMING <path>      # latency histograms of the runtime internals, written at exit
+	   DPTHREAD_TOP <name>         # live status in shm /<name>.<pid> (see tools/dptop)
+	   DPTHREAD_WATCHDOG <seconds> # dump the waits-for graph when the clocks stall
+	   DPTHREAD_WATCHDOG_ABORT 1   # and abort() for a core dump
+	*/ 
+	char *ptr; 
+	cpu_set_t cmask;
+
+	num_processors = sysconf(_SC_NPROCESSORS_CONF); 
+	assert(num_processors > 0 ); 
+
+	CPU_ZERO(&cmask);
+	sched_setaffinity(0, num_processors, &cmask); 
+
+	if ( (ptr = getenv("DPTHREAD_DEBUG")) ) { 
+		debug_level = atoi(ptr); 
+	}
+	if ( (ptr = getenv("DPTHREAD_LOG_FILE")) ) { 
+		debug_log_file = ptr; 
+	}
+	if ( (ptr = getenv("DPTHREAD_FINGERPRINT")) ) { 
+		fingerprint_file = ptr; 
+	}
+	if ( (ptr = getenv("DPTHREAD_TRACE_SIZE")) ) { 
+		for ( trace_size = 1; trace_size < (uint64_t)atoll(ptr); ) 
+			trace_size <<= 1; 
+	}
+	if ( (ptr = getenv("DPTHREAD_TRACE")) ) { 
+		trace_file = ptr; 
+	}
+	if ( (ptr = getenv("DPTHREAD_STATS")) ) { 
+		stats_file = ptr; 
+		obj_stats = calloc(STAT_NR_KINDS * STAT_MAX_OBJ, sizeof(struct obj_stat)); 
+		assert(obj_stats); 
+	}
+	if ( (ptr = getenv("DPTHREAD_BLAME")) ) { 
+		blame_file = ptr; 
+		blame = calloc(MAX_THR, sizeof(struct blame_row)); 
+		assert(blame); 
+	}
+	if ( (ptr = getenv("DPTHREAD_PROFILE")) ) { 
+		prof_file = ptr; 
+		prof_period = 64; 
+		if ( (ptr = getenv("DPTHREAD_PROFILE_PERIOD")) && atoi(ptr) > 0 ) 
+			prof_period = atoi(ptr); 
+		if ( (ptr = getenv("DPTHREAD_PROFILE_DEPTH")) ) 
+			prof_depth = max(1, min(PROF_MAX_DEPTH, atoi(ptr))); 
+		{ // the first backtrace() loads the unwinder. not in a sync op. 
+			void *pc[1]; 
+			backtrace(pc, 1); 
+		}
+	}
+	if ( (ptr = getenv("DPTHREAD_TOP")) ) { 
+		top_prefix = ptr; 
+		top_open(); 
+	}
+	if ( (ptr = getenv("DPTHREAD_WATCHDOG")) && atoi(ptr) > 0 ) { 
+		wd_interval = atoi(ptr); 
+		wd_abort = (ptr = getenv("DPTHREAD_WATCHDOG_ABORT")) && atoi(ptr); 
+		wd_mutex = calloc(WD_MAX_OBJ, sizeof(*wd_mutex)); 
+		wd_cond = calloc(WD_MAX_OBJ, sizeof(*wd_cond)); 
+		assert(wd_mutex && wd_cond); 
+		if ( !top ) { // thread states, kept in private memory 
+			det_top_page_t *page = calloc(1, sizeof(*page)); 
+			assert(page); 
+			top_init(page); 
+		}
+	}
+	if ( (ptr = getenv("DPTHREAD_TIMING")) ) { 
+		timing_file = ptr; 
+		time_hists = calloc(MAX_THR, sizeof(*time_hists)); 
+		assert(time_hists); 
+	}
+	if ( trace_file || stats_file || blame_file || prof_file || timing_file ) { 
+		tsc_per_usec = tsc_calibrate(); 
+		tsc_base = read_tsc(); 
+	}
+	use_timing = timing_file != NULL; // from here on 
+
+	if ( (ptr = getenv("DPTHREAD_RT") ) ) { 
+		struct sched_param param;
+		param.sched_priority = 1; 
+		if(sched_setscheduler(0, SCHED_FIFO, &param) == -1) {
+			perror("sched_setscheduler failed");
+		}
+	}
+
+	// if ( (ptr = getenv("LD_PRELOAD")) && strstr(ptr, "libdetio.so") )
+
+	my_pid = getpid(); 
+	if ( (ptr = getenv("DPTHREAD_SHM")) ) { 
+		size_t queue_size = 16384; 
+		char *size_ptr; 
+		if ( (size_ptr = getenv("DPTHREAD_SHM_SIZE")) ) 
+			queue_size = atol(size_ptr); 
+		shm_attach(ptr, queue_size << 10); 
+	}
+
+#if USE_CHECKPOINT
+	if ( (ptr = getenv("DPTHREAD_CKPT_INTERVAL")) ) { 
+		ckpt_interval = atoll(ptr); 
+	}
+	if ( (ptr = getenv("DPTHREAD_CKPT_MAX")) ) { 
+		ckpt_max = min(max(atoi(ptr), 1), CKPT_MAX_ENTRIES); 
+	}
+	if ( (ptr = getenv("DPTHREAD_CKPT_MEM")) ) { 
+		ckpt_mem_limit = atol(ptr); 
+	}
+	if ( (ptr = getenv("DPTHREAD_CKPT_KEEP")) ) { 
+		ckpt_keep = atoi(ptr); 
+	}
+	if ( ckpt_interval > 0 && grp->shm_size > 0 ) { 
+		warnx("DPTHREAD_CKPT_INTERVAL is ignored with DPTHREAD_SHM"); 
+		ckpt_interval = 0; // a snapshot would share the group's mapping 
+	}
+	if ( ckpt_interval > 0 ) { 
+		FILE *fp; 
+		if ( (ptr = getenv("DPTHREAD_CKPT_FILE")) ) 
+			snprintf(ckpt_file, sizeof(ckpt_file), "%s", ptr); 
+		else 
+			snprintf(ckpt_file, sizeof(ckpt_file), "ckpt.%d", getpid()); 
+		if ( (fp = fopen(ckpt_file, "w")) ) fclose(fp); 
+		ckpt_next_clock = ckpt_interval; 
+		atexit(ckpt_cleanup); 
+	}
+#endif 
+
+	if (pfm_initialize() != PFM_SUCCESS)
+		errx(1, "pfm_initialize failed");
+	
+	// initialize structure
+	memset(wa, 0, MAX_THR * sizeof(struct worker_args)); 
+
+	// setup master thread 
+	assert(grp->max_thr == 0 ); 
+
+	myid = 0; 
+	my_det_enabled = 1; 
+	my_det_clock = 0; 
+	grp->max_thr = grp->num_thr = 1; 
+
+	w = &wa[0]; 
+	w->id = myid; 
+	w->pid = my_pid; 
+	w->func = NULL; 
+	w->arg  = NULL; 
+	w->sw_clock = 0; 
+	w->hw_clock  = 0; 
+	w->hw_clock_enabled = 0; 
+
+	log_open(w); 
+
+	// open performance counter
+	open_pfm_counter(w); 
+
+	if ( grp->shm_size > 0 ) 
+		atexit(group_exit); 
+	if ( fingerprint_file ) 
+		atexit(fingerprint_write); 
+	if ( stats_file ) 
+		atexit(stats_write); 
+	if ( blame_file ) 
+		atexit(blame_write); 
+	if ( prof_file ) 
+		atexit(prof_write); 
+	if ( timing_file ) 
+		atexit(timing_write); 
+	if ( top ) 
+		atexit(top_close); 
+
+	if ( (ptr = getenv("DPTHREAD_MODE")) && !strcmp(ptr, "native") ) { 
+		grp->mode = grp->mode_request = DET_MODE_NATIVE; 
+	}
+	if ( (ptr = getenv("DPTHREAD_MODE_SIGNAL")) ) { 
+		struct sigaction sa; 
+		memset(&sa, 0, sizeof(sa)); 
+		sa.sa_handler = mode_signal_handler; 
+		sa.sa_flags = SA_RESTART; 
+		sigaction(atoi(ptr), &sa, NULL); 
+	}
+
+	if ( wd_interval > 0 ) { 
+		pthread_t tid; 
+		pthread_attr_t attr; 
+		pthread_attr_init(&attr); 
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED); 
+		pthread_create(&tid, &attr, watchdog_thread, NULL); 
+		pthread_attr_destroy(&attr); 
+	}
+
+	DBG(1, "INIT: debug_level=%d. event begin \n", debug_level); 
+
+
+	return 0; 
+}
+
+static int lock_init(det_mutex_t *mutex, int domain, int pshared)
+{
+	int lret;
+
+	// if not initialized, initialize. 
+	if ( grp->max_thr == 0 ) det_init(0, NULL);
+	lret = disable_logical_clock(); 
+
+	sync_queue_init(&mutex->queue, pshared); 
+
+	pthread_mutex_lock(&grp->count_mutex); 
+	mutex->id = ++grp->g_lock_count; 
+	pthread_mutex_unlock(&grp->count_mutex); 
+	if ( wd_mutex && mutex->id < WD_MAX_OBJ ) 
+		wd_mutex[mutex->id] = mutex; 
+	mutex->released_logical_time = 0; 
+	mutex->owner = -1; 
+	mutex->ref = 0; 
+	mutex->domain = domain; 
+
+	TRACE(DET_TRACE_MUTEX_INIT, mutex->id, 0); 
+
+	sync_mutex_init(&mutex->mutex, pshared); 
+
+	if ( lret == 0 ) enable_logical_clock(); 
+
+	return 0; 
+}
+
+int det_lock_init(det_mutex_t *mutex)
+{
+	lock_init(mutex, wa[myid].domain, 0); 
+	stat_site(STAT_MUTEX, mutex->id, __builtin_return_address(0)); 
+	return 0; 
+}
+
+int det_lock_init_domain(det_mutex_t *mutex, int domain)
+{
+	lock_init(mutex, domain, 0); 
+	stat_site(STAT_MUTEX, mutex->id, __builtin_return_address(0)); 
+	return 0; 
+}
+
+int det_lock_init_shared(det_mutex_t *mutex)
+{
+	lock_init(mutex, wa[myid].domain, 1); 
+	stat_site(STAT_MUTEX, mutex->id, __builtin_return_address(0)); 
+	return 0; 
+}
+
+int det_lock_destroy(det_mutex_t *mutex)
+{
+	if ( wd_mutex && mutex->id < WD_MAX_OBJ && wd_mutex[mutex->id] == mutex ) 
+		wd_mutex[mutex->id] = NULL; 
+	sync_queue_destroy(&mutex->queue); 
+	pthread_mutex_destroy(&mutex->mutex); 
+	return 0; 
+}
+
+int det_trylock(det_mutex_t *mutex)
+{
+	int ret = 0; 
+	int lret; 
+	int64_t clock; 
+	struct stat_op op; 
+
+	assert(mutex->id > 0 ); 
+
+	mode_check(); 
+
+	// if det is disabled simply same as pthread. 
+	if ( !det_is_enabled() ) 
+		return native_trylock(mutex);
+
+	if ( check_domain(mutex->domain, "trylock", mutex->id) ) 
+		return EPERM; 
+
+	// disable count       
+	lret = disable_logical_clock(); 
+
+	TRACE(DET_TRACE_TRYLOCK, mutex->id, 0);
+	stat_begin(&op, STAT_MUTEX, mutex->id); 
+
+#if USE_MUTEX_RECURSIVE 
+	if ( mutex->ref > 0 && mutex->owner == myid ) { 
+		mutex->ref++; 
+		goto out; 
+	} 
+#endif 
+
+	clock = wait_for_turn(mutex->domain); 
+	AddQ(&mutex->queue, (void *)myid);
+
+	if ( (int)GetHeadQ(&mutex->queue) == myid && 
+	     (ret = pthread_mutex_trylock(&mutex->mutex)) == 0 ) 
+	{ // success. 
+		int64_t last_release = mutex->released_logical_time; 
+		DBG(3, "--trylock");
+		if ( last_release >= clock ) 
+		{ // physically ok but logically not. 
+			DBG(3, "--case2: released at %lld\n", last_release); 
+			if ( op.st ) STAT_ADD(op.st, case2, 1); 
+			pthread_mutex_unlock(&mutex->mutex); 
+#if USE_DET_FASTFORWARD
+			// deterministic fast forward. 
+			wa[myid].sw_clock += (last_release - clock); 
+#endif 
+			ret = EBUSY; 
+		}
+		else 
+		{ // logically and physically ok. 
+			mutex->owner = myid;
+			mutex->ref = 1; 
+		}
+	} 
+	assert(GET_CLOCK(myid) < MAX_LOGICAL_CLOCK); 
+
+	// update last sync logical time 
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
+	
+	if ( ret == 0 ) {
+		TRACE(DET_TRACE_TRYLOCK_ACQ, mutex->id, 0);
+		// statistic 
+		lock_count ++; 
+		if ( op.st ) 
+			op.st->acquired_tsc = stat_end(&op); 
+
+		// remove from the queue. 
+		DelQ(&mutex->queue); 
+	} else {
+		TRACE(DET_TRACE_TRYLOCK_FAIL, mutex->id, 0); 
+	}
+
+out:
+	// increase logical clock 
+	wa[myid].sw_clock++; 
+
+	// resume logical clock 
+	if ( lret == 0 ) enable_logical_clock(); 
+
+	return ret; 
+}
+
+/**
+ * deadline is in logical time. MAX_LOGICAL_CLOCK - no timeout. 
+ */
+static int lock_acquire(det_mutex_t *mutex, int64_t deadline, void *site)
+{
+	int ret = 0; 
+	int lret; 
+	int64_t clock; 
+	struct stat_op op; 
+
+	if ( mutex->id < 0 ) { 
+		// statically initialized. domain is in the initializer (0). 
+		lock_init(mutex, mutex->domain, 0); 
+		stat_site(STAT_MUTEX, mutex->id, site); 
+	}
+
+	assert(mutex->id > 0 ); 
+
+	mode_check(); 
+
+	// if det is disabled simply same as pthread. 
+	if ( !det_is_enabled() ) 
+		return native_lock(mutex, deadline);
+
+	if ( check_domain(mutex->domain, "acq", mutex->id) ) 
+		return EPERM; 
+
+	// disable count       
+	lret = disable_logical_clock(); 
+	stat_begin(&op, STAT_MUTEX, mutex->id); 
+
+#if USE_MUTEX_RECURSIVE 
+	if ( mutex->ref > 0 && mutex->owner == myid ) { 
+		mutex->ref++; 
+		goto out; 
+	} 
+#endif 
+
+#if !USE_NESTED_LOCK
+	DBG(2, "acq(%d) enter\n", mutex->id);
+
+	// wait for turn 
+	clock = wait_for_turn(mutex->domain);
+
+	ret = pthread_mutex_lock(&mutex->mutex);
+
+#else // USE_NESTED_LOCK
+
+	TRACE(DET_TRACE_ACQ_ENTER, mutex->id, 0);
+
+	clock = wait_for_turn(mutex->domain); 
+	AddQ(&mutex->queue, (void *)myid);
+
+	while ( 1 ) {
+		if ( (int)GetHeadQ(&mutex->queue) == myid && 
+		     pthread_mutex_trylock(&mutex->mutex) == 0 ) 
+		{ // success. 
+			int64_t last_release = mutex->released_logical_time; 
+			DBG(3, "--trylock");
+			if ( last_release >= clock ) 
+			{ // physically ok but logically not. 
+				DBG(3, "--case2: released at %lld\n", last_release ); 
+				if ( op.st ) STAT_ADD(op.st, case2, 1); 
+				pthread_mutex_unlock(&mutex->mutex); 
+#if USE_DET_FASTFORWARD
+				// deterministic fast forward. 
+				wa[myid].sw_clock += (last_release - clock); 
+#endif 
+			}
+			else 
+			{ // logically and physically ok. 
+				DBG(3, "got it. sw_clock = %lld\n", wa[myid].sw_clock); 
+				mutex->owner = myid; 
+				mutex->ref = 1; 
+				break; // quit the loop. 
+			}
+		} 
+		assert(GET_CLOCK(myid) < MAX_LOGICAL_CLOCK); 
+		TRACE(DET_TRACE_SPINNING, mutex->id, 0);
+		if ( op.st ) STAT_ADD(op.st, retries, 1); 
+
+		// increase clock 
+		if ( deadline < MAX_LOGICAL_CLOCK ) { 
+			int64_t now = GET_CLOCK(myid); 
+			if ( now + 1 >= deadline ) { 
+				TRACE(DET_TRACE_ACQ_TIMEOUT, mutex->id, 0); 
+				DelItemQ(&mutex->queue, (void *)myid); 
+				if ( now < deadline ) { 
+					SET_CLOCK(myid, deadline); 
+				}
+				ret = ETIMEDOUT; 
+				goto timedout; 
+			}
+			// reach the deadline in a bounded number of turns 
+			wa[myid].sw_clock += max(1, (deadline - now) / 16); 
+		} else { 
+			wa[myid].sw_clock ++; 
+		}
+
+		// wait for turn 
+		clock = wait_for_turn(mutex->domain);
+
+		if ( grp->mode_request != grp->mode ) { 
+			// the owner may be waiting at the switch. leave and retry. 
+			DelItemQ(&mutex->queue, (void *)myid); 
+			mode_arrive(); 
+			if ( lret == 0 ) enable_logical_clock(); 
+			return lock_acquire(mutex, deadline, site); 
+		}
+	}	
+
+#endif // USE_NESTED_LOCK
+	assert(GET_CLOCK(myid) < MAX_LOGICAL_CLOCK); 
+	TRACE(DET_TRACE_ACQ, mutex->id, 0);
+
+	// update last sync logical time 
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
+	
+	// remove from the queue. 
+	DelQ(&mutex->queue); 
+
+out: 
+	// statistic 
+	lock_count ++; 
+	if ( op.st && mutex->ref == 1 ) 
+		op.st->acquired_tsc = stat_end(&op); 
+timedout: 
+	// increase logical clock 
+	wa[myid].sw_clock++; 
+
+	// resume logical clock 
+	if ( lret == 0 ) enable_logical_clock(); 
+
+	return ret; 
+}
+
+int det_lock(det_mutex_t *mutex)
+{
+	return lock_acquire(mutex, MAX_LOGICAL_CLOCK, __builtin_return_address(0)); 
+}
+
+int det_timedlock(det_mutex_t *mutex, const struct timespec *abstime)
+{
+	if ( mutex->id < 0 ) { 
+		lock_init(mutex, mutex->domain, 0); 
+		stat_site(STAT_MUTEX, mutex->id, __builtin_return_address(0)); 
+	}
+	return lock_acquire(mutex, timed_deadline(abstime), __builtin_return_address(0)); 
+}
+
+int det_unlock_and_incr_clock(det_mutex_t *mutex, int64_t incr)
+{
+	int ret = 0; 
+	int lret; 
+
+	assert(mutex->id > 0 ); 
+
+	// if det is disabled simply same as pthread. 
+	if ( !det_is_enabled() ) 
+		return native_unlock(mutex);
+
+	// must be initialized first. 
+	assert( grp->max_thr > 0 ); 
+
+	// disable count 	
+	lret = disable_logical_clock(); 
+
+#if USE_MUTEX_RECURSIVE 
+	// clean up 
+	mutex->ref--; 
+	if ( mutex->ref > 0 ) { 
+		goto out; 
+	}
+	mutex->owner = -1; 
+#endif 
+
+	mutex->released_logical_time = get_logical_clock(myid) ;  
+	wa[myid].last_release_logical_time = mutex->released_logical_time; 
+	TRACE(DET_TRACE_REL, mutex->id, 0); 
+	stat_release(mutex); 
+
+	// update last sync logical time 
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
+
+	ret = pthread_mutex_unlock(&mutex->mutex); 
+out: 
+	// other thread's wait_for_turn immediately progress. 
+	// So I have to be sure I don't hold this lock anymore before increment this. 
+	wa[myid].sw_clock += incr;
+	if ( incr > 1 ) timed_kick(); 
+
+	// resume logical clock 
+	if ( lret == 0 ) enable_logical_clock(); 
+
+	return ret; 
+}
+
+int det_unlock(det_mutex_t *mutex)
+{
+	return det_unlock_and_incr_clock(mutex, 1); 
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// lock sets 
+///////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * copy mutexes to set sorted by id, the canonical order, without duplicates. 
+ * returns the size of the set. 
+ */
+static int lock_set(det_mutex_t **set, det_mutex_t **mutexes, int n)
+{
+	int i, j, k = 0; 
+
+	for ( i = 0; i < n; i++ ) { 
+		det_mutex_t *m = mutexes[i]; 
+
+		assert(m->id > 0); 
+		for ( j = 0; j < k && set[j] != m; j++ ); 
+		if ( j < k ) 
+			continue; // duplicate 
+		for ( j = k++; j > 0 && set[j-1]->id > m->id; j-- ) 
+			set[j] = set[j-1]; 
+		set[j] = m; 
+	}
+	return k; 
+}
+
+/**
+ * acquire all or nothing at a single turn. the caller lines up on the queue 
+ * of every mutex of the set, like lock_acquire(), and takes the set when it 
+ * is at the head of all of them and all are free. a set that is not free at 
+ * the turn is released and tried again at the next one, so the caller never 
+ * holds a part of the set while it waits. 
+ */
+int det_lock_many(det_mutex_t **mutexes, int n)
+{
+	det_mutex_t *set[n > 0 ? n : 1]; 
+	int held[n > 0 ? n : 1]; 
+	int mine[n > 0 ? n : 1]; // already held, recursive 
+	int i, k, busy, first, ret = 0; 
+	int lret; 
+	int domain; 
+	int64_t clock; 
+	struct stat_op op; 
+	struct obj_stat *st; 
+	uint64_t now; 
+
+	for ( i = 0; i < n; i++ ) { 
+		if ( mutexes[i]->id < 0 ) { // statically initialized 
+			lock_init(mutexes[i], mutexes[i]->domain, 0); 
+			stat_site(STAT_MUTEX, mutexes[i]->id, __builtin_return_address(0)); 
+		}
+	}
+	if ( (k = lock_set(set, mutexes, n)) == 0 ) 
+		return 0; 
+
+	mode_check(); 
+
+	// if det is disabled, take them one by one in the canonical order. 
+	if ( !det_is_enabled() ) { 
+		for ( i = 0; i < k; i++ ) { 
+			if ( (ret = native_lock(set[i], MAX_LOGICAL_CLOCK)) != 0 ) 
+				break; 
+		}
+		if ( ret != 0 ) { 
+			while ( --i >= 0 ) 
+				native_unlock(set[i]); 
+		}
+		return ret; 
+	}
+
+	// the turn is taken in the domain of the set, global if it is mixed. 
+	domain = set[0]->domain; 
+	for ( i = 0; i < k; i++ ) { 
+		if ( check_domain(set[i]->domain, "acq_many", set[i]->id) ) 
+			return EPERM; 
+		if ( set[i]->domain != domain ) 
+			domain = DET_DOMAIN_GLOBAL; 
+	}
+
+	// disable count       
+	lret = disable_logical_clock(); 
+
+	TRACE(DET_TRACE_ACQ_MANY_ENTER, set[0]->id, set[k-1]->id); 
+	stat_begin(&op, STAT_MUTEX, set[0]->id); 
+
+	// wait for turn, and line up on every mutex of the set at once. 
+	clock = wait_for_turn(domain); 
+	for ( i = 0; i < k; i++ ) { 
+		mine[i] = 0; 
+#if USE_MUTEX_RECURSIVE 
+		mine[i] = ( set[i]->ref > 0 && set[i]->owner == myid ); 
+#endif 
+		if ( !mine[i] ) 
+			AddQ(&set[i]->queue, (void *)(intptr_t)myid); 
+	}
+
+	while ( 1 ) { 
+		busy = 0; // a mutex of the set is not free at this turn 
+		first = -1; // the first one I cannot take 
+		for ( i = 0; i < k; i++ ) { 
+			det_mutex_t *m = set[i]; 
+
+			held[i] = 0; 
+			if ( mine[i] ) 
+				continue; 
+			if ( pthread_mutex_trylock(&m->mutex) != 0 ) { 
+				busy = 1; 
+			} else { 
+				held[i] = 1; 
+				if ( m->released_logical_time >= clock ) { 
+					// physically ok but logically not. 
+					DBG(3, "--case2: %d released at %lld\n", 
+					    m->id, m->released_logical_time); 
+					STAT_COUNT(STAT_MUTEX, m->id, case2); 
+					busy = 1; 
+				} else if ( (int)(intptr_t)GetHeadQ(&m->queue) == myid ) { 
+					continue; 
+				}
+			}
+			if ( first < 0 ) 
+				first = i; 
+		}
+		if ( first < 0 ) 
+			break; // got all of them. 
+		STAT_COUNT(STAT_MUTEX, set[first]->id, retries); 
+
+		// give back what was taken at this turn. 
+		for ( i = 0; i < k; i++ ) { 
+			if ( held[i] ) 
+				pthread_mutex_unlock(&set[i]->mutex); 
+		}
+
+		// the owner of a busy one may be lined up behind me for another 
+		// mutex of the set. step back to the tail of every queue so that 
+		// it can finish and release. 
+		for ( i = 0; busy && i < k; i++ ) { 
+			if ( !mine[i] && DelItemQ(&set[i]->queue, (void *)(intptr_t)myid) ) 
+				AddQ(&set[i]->queue, (void *)(intptr_t)myid); 
+		}
+		assert(GET_CLOCK(myid) < MAX_LOGICAL_CLOCK); 
+		TRACE(DET_TRACE_SPINNING, set[0]->id, 0);
+
+		// increase clock 
+		wa[myid].sw_clock ++; 
+
+		// wait for turn 
+		clock = wait_for_turn(domain); 
+
+		if ( grp->mode_request != grp->mode ) { 
+			// an owner may be waiting at the switch. leave and retry. 
+			for ( i = 0; i < k; i++ ) { 
+				if ( !mine[i] ) 
+					DelItemQ(&set[i]->queue, (void *)(intptr_t)myid); 
+			}
+			mode_arrive(); 
+			if ( lret == 0 ) enable_logical_clock(); 
+			return det_lock_many(mutexes, n); 
+		}
+	}
+
+	// the wait is counted once, for set[0]. each one is held from now. 
+	now = op.st ? stat_end(&op) : ( obj_stats ? read_tsc() : 0 ); 
+	for ( i = 0; i < k; i++ ) { 
+		if ( held[i] ) { 
+			DelQ(&set[i]->queue); // I am the head 
+			set[i]->owner = myid; 
+			set[i]->ref = 1; 
+			if ( (st = obj_stat(STAT_MUTEX, set[i]->id)) ) 
+				st->acquired_tsc = now; 
+		} else { 
+			set[i]->ref++; // recursive 
+		}
+	}
+	TRACE(DET_TRACE_ACQ_MANY, set[0]->id, set[k-1]->id); 
+
+	// update last sync logical time 
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
+
+	// statistic 
+	lock_count += k; 
+
+	// increase logical clock 
+	wa[myid].sw_clock++; 
+
+	// resume logical clock 
+	if ( lret == 0 ) enable_logical_clock(); 
+
+	return 0; 
+}
+
+/**
+ * release a set taken by det_lock_many() at a single logical time. 
+ */
+int det_unlock_many(det_mutex_t **mutexes, int n)
+{
+	det_mutex_t *set[n > 0 ? n : 1]; 
+	int i, k, ret = 0; 
+	int lret; 
+	int64_t clock; 
+
+	if ( (k = lock_set(set, mutexes, n)) == 0 ) 
+		return 0; 
+
+	// if det is disabled simply same as pthread. 
+	if ( !det_is_enabled() ) { 
+		for ( i = 0; i < k; i++ ) 
+			ret |= native_unlock(set[i]); 
+		return ret; 
+	}
+
+	// disable count 	
+	lret = disable_logical_clock(); 
+
+	clock = get_logical_clock(myid); 
+	for ( i = 0; i < k; i++ ) { 
+		det_mutex_t *m = set[i]; 
+#if USE_MUTEX_RECURSIVE 
+		if ( --m->ref > 0 ) 
+			continue; 
+		m->owner = -1; 
+#endif 
+		m->released_logical_time = clock; 
+		stat_release(m); 
+		ret |= pthread_mutex_unlock(&m->mutex); 
+	}
+	wa[myid].last_release_logical_time = clock; 
+	TRACE(DET_TRACE_REL_MANY, set[0]->id, set[k-1]->id); 
+
+	// update last sync logical time 
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
+
+	// increase logical clock 
+	wa[myid].sw_clock++; 
+
+	// resume logical clock 
+	if ( lret == 0 ) enable_logical_clock(); 
+
+	return ret; 
+}
+
+
+static int cond_init(det_cond_t *cond, int domain, int pshared)
+{
+	int lret; 
+	int i; 
+
+	// if not initialized, initialize. 
+	if ( grp->max_thr == 0 ) det_init(0, NULL);
+
+	lret = disable_logical_clock(); 
+	
+	sync_queue_init(&cond->queue, pshared); 
+
+	for ( i = 0; i < MAX_THR; i++ ) { 
+		cond->waiter[i].id = i; 
+		sync_mutex_init(&cond->waiter[i].mutex, pshared); 
+		pthread_mutex_lock(&cond->waiter[i].mutex); 
+	}
+
+	pthread_mutex_lock(&grp->count_mutex); 
+	cond->id = ++grp->g_cond_count; 
+	pthread_mutex_unlock(&grp->count_mutex); 
+	if ( wd_cond && cond->id < WD_MAX_OBJ ) 
+		wd_cond[cond->id] = cond; 
+	cond->domain = domain; 
+
+	TRACE(DET_TRACE_COND_INIT, cond->id, 0); 
+	if ( lret == 0 ) enable_logical_clock(); 
+	return 0; 
+}
+
+int  det_cond_init(det_cond_t *cond)
+{
+	cond_init(cond, wa[myid].domain, 0); 
+	stat_site(STAT_COND, cond->id, __builtin_return_address(0)); 
+	return 0; 
+}
+
+int  det_cond_init_domain(det_cond_t *cond, int domain)
+{
+	cond_init(cond, domain, 0); 
+	stat_site(STAT_COND, cond->id, __builtin_return_address(0)); 
+	return 0; 
+}
+
+int  det_cond_init_shared(det_cond_t *cond)
+{
+	cond_init(cond, wa[myid].domain, 1); 
+	stat_site(STAT_COND, cond->id, __builtin_return_address(0)); 
+	return 0; 
+}
+
+int  det_cond_destroy(det_cond_t *cond)
+{
+	if ( wd_cond && cond->id < WD_MAX_OBJ && wd_cond[cond->id] == cond ) 
+		wd_cond[cond->id] = NULL; 
+	sync_queue_destroy(&cond->queue); 
+	return 0; 
+}
+
+/**
+ */ 
+int  det_cond_wait(det_cond_t *cond, det_mutex_t *mutex)
+{
+	int lret; 
+	det_mutex_t *lock;
+	struct stat_op op; 
+
+	if ( check_domain(cond->domain, "cond", cond->id) || 
+	     check_domain(mutex->domain, "cond", mutex->id) ) 
+		return EPERM; 
+
+	mode_check(); 
+
+	lret = disable_logical_clock(); 
+	TRACE(DET_TRACE_COND_WAIT, cond->id, 0); 
+	stat_begin(&op, STAT_COND, cond->id); 
+
+	// add to waiting list. mutex is still held. 
+	lock = &cond->waiter[myid]; 
+	AddQ(&cond->queue, (void *)lock);
+
+#if USE_CHECKPOINT
+	if ( ckpt_interval > 0 ) { 
+		// a checkpoint resumes this thread right here. 
+		getcontext(&wa[myid].ckpt_ctx); 
+		if ( wa[myid].ckpt_resumed == 1 ) { 
+			wa[myid].ckpt_resumed = 2; 
+			goto wait; 
+		}
+		wa[myid].ckpt_lock_count = lock_count; 
+		wa[myid].ckpt_barrier_count = barrier_count; 
+	}
+#endif 
+	wa[myid].parked = 1; 
+
+	// release condition lock & quit 
+	det_unlock_and_incr_clock(mutex, MAX_LOGICAL_CLOCK); 
+	__sync_bool_compare_and_swap(&wa[myid].parked, 1, 2); // unless signaled 
+
+#if USE_CHECKPOINT
+wait: 
+#endif 
+	// waiter->P()
+	pthread_mutex_lock(&lock->mutex);  
+	time_woken(); 
+
+	// signaler must set this already. 
+	assert(GET_CLOCK(myid) < MAX_LOGICAL_CLOCK); 
+
+	TRACE(DET_TRACE_COND_WAKE, cond->id, 0); 
+	if ( op.st ) stat_end(&op); 
+	
+	if ( lret == 0 ) enable_logical_clock();
+	
+	// acquite the lock 
+	det_lock(mutex); 
+
+	return 0;
+}
+
+/**
+ * the deadline is my clock while I wait, so I time out in my turn, after 
+ * every thread of the domain has passed it. 
+ */ 
+int  det_cond_timedwait(det_cond_t *cond, det_mutex_t *mutex, 
+			const struct timespec *abstime)
+{
+	int lret, ret; 
+	int64_t deadline, now; 
+	det_mutex_t *lock;
+	struct stat_op op; 
+
+	if ( check_domain(cond->domain, "cond", cond->id) || 
+	     check_domain(mutex->domain, "cond", mutex->id) ) 
+		return EPERM; 
+
+	mode_check(); 
+
+	lret = disable_logical_clock(); 
+	deadline = timed_deadline(abstime); 
+	now = get_logical_clock(myid); 
+	TRACE(DET_TRACE_COND_TIMEDWAIT, cond->id, deadline); 
+	stat_begin(&op, STAT_COND, cond->id); 
+
+	if ( deadline <= now ) { 
+		wa[myid].sw_clock ++; 
+		if ( lret == 0 ) enable_logical_clock(); 
+		return ETIMEDOUT; 
+	}
+
+	// add to waiting list. mutex is still held. 
+	lock = &cond->waiter[myid]; 
+	timed_begin(lock, cond->domain, deadline); 
+	AddQ(&cond->queue, (void *)lock);
+	wa[myid].parked = 1; 
+
+	// release condition lock & move to the deadline 
+	det_unlock_and_incr_clock(mutex, det_is_enabled() ? deadline - now : 0); 
+	__sync_bool_compare_and_swap(&wa[myid].parked, 1, 3); // unless signaled 
+
+	ret = timed_block(lock, deadline - now); 
+
+	assert(GET_CLOCK(myid) < MAX_LOGICAL_CLOCK); 
+	TRACE(ret ? DET_TRACE_COND_TIMEOUT : DET_TRACE_COND_TIMEDWAKE, cond->id, 0); 
+	if ( op.st ) stat_end(&op); 
+
+	if ( lret == 0 ) enable_logical_clock();
+	
+	// acquite the lock 
+	det_lock(mutex); 
+
+	if ( ret == ETIMEDOUT ) 
+		DelItemQ(&cond->queue, (void *)lock); 
+	timed_end(); 
+
+	return ret;
+}
+
+int  det_cond_signal(det_cond_t *cond)
+{ 
+	int64_t clock; 
+	det_mutex_t *lock; 
+	int lret; 
+
+	if ( check_domain(cond->domain, "cond", cond->id) ) 
+		return EPERM; 
+
+	mode_check(); 
+
+	lret = disable_logical_clock(); 
+
+	clock = get_logical_clock(myid); 
+	assert( clock < MAX_LOGICAL_CLOCK ); // FIXME: sometimes it aborts. 
+
+	/* condition lock is already held */ 
+
+	while ( !IsEmptyQ(&cond->queue) ) { 
+		lock = (det_mutex_t*)DelQ(&cond->queue); 
+		if ( wake_waiter(lock, clock) == 0 ) { 
+			TRACE(DET_TRACE_COND_SIGNAL, cond->id, lock - &cond->waiter[0]); 
+			STAT_COUNT(STAT_COND, cond->id, signals); 
+			break; 
+		}
+	}
+
+	// increase logical clock 
+	wa[myid].sw_clock ++; 
+
+	if ( lret == 0 ) enable_logical_clock(); 
+	return 0; 
+}
+
+int  det_cond_broadcast(det_cond_t *cond) 
+{
+	int lret; 
+
+	if ( check_domain(cond->domain, "cond", cond->id) ) 
+		return EPERM; 
+
+	lret = disable_logical_clock(); 	
+
+	while ( !IsEmptyQ(&cond->queue) ) { 
+		det_cond_signal(cond); 
+	}
+
+	if ( lret == 0 ) enable_logical_clock(); 
+	return 0; 
+}
+
+static int barrier_init(det_barrier_t *barrier, int count, int domain, int pshared, 
+			void *site)
+{
+	// if not initialized, initialize. 
+	if ( grp->max_thr == 0 ) det_init(0, NULL);
+
+	barrier->target_count = count; 
+	barrier->wait_count   = 0; 
+	barrier->phase        = 0; 
+	barrier->release_clock = 0; 
+
+	pthread_mutex_lock(&grp->count_mutex); 
+	barrier->id = ++grp->g_barr_count; 
+	pthread_mutex_unlock(&grp->count_mutex); 
+	barrier->domain = domain; 
+
+	lock_init(&barrier->wait_mutex, domain, pshared); 
+	cond_init(&barrier->wait_cond, domain, pshared); 
+	stat_site(STAT_BARRIER, barrier->id, site); 
+	stat_site(STAT_MUTEX, barrier->wait_mutex.id, site); 
+	stat_site(STAT_COND, barrier->wait_cond.id, site); 
+
+	DBG(1, "lock %d is for barrier\n", grp->g_lock_count); 
+	DBG(1, "cond %d is for barrier\n", grp->g_cond_count); 
+	return 0; 
+}
+
+int det_barrier_init(det_barrier_t *barrier, int count)
+{
+	return barrier_init(barrier, count, wa[myid].domain, 0, __builtin_return_address(0)); 
+}
+
+int det_barrier_init_domain(det_barrier_t *barrier, int count, int domain)
+{
+	return barrier_init(barrier, count, domain, 0, __builtin_return_address(0)); 
+}
+
+int det_barrier_init_shared(det_barrier_t *barrier, int count)
+{
+	return barrier_init(barrier, count, wa[myid].domain, 1, __builtin_return_address(0)); 
+}
+
+int det_barrier_destroy(det_barrier_t *barrier)
+{
+	det_lock_destroy(&barrier->wait_mutex); 
+	det_cond_destroy(&barrier->wait_cond); 
+	return 0; 
+}
+
+int det_barrier_wait(det_barrier_t *barrier)
+{
+	int ret = 0; 
+#if USE_CHECKPOINT
+	int64_t clock; 
+#endif 
+
+	int lret; 
+	struct stat_op op; 
+
+	if ( check_domain(barrier->domain, "barrier", barrier->id) ) 
+		return EPERM; 
+
+	mode_check(); 
+
+	// disable counting
+	lret = disable_logical_clock(); 
+
+	TRACE(DET_TRACE_BARRIER_ENTER, barrier->id, 0); 
+	stat_begin(&op, STAT_BARRIER, barrier->id); 
+
+	det_lock(&barrier->wait_mutex); 
+
+	// must be initialized before (barrier init)
+	assert( grp->max_thr > 0 );
+
+	barrier->wait_count ++; 
+	if ( barrier->wait_count == barrier->target_count ) {
+		barrier->wait_count = 0; 
+		barrier->release_clock = get_logical_clock(myid); 
+		__sync_synchronize(); // det_barrier_wait_token() reads it w/o the lock 
+		barrier->phase++; 
+#if USE_CHECKPOINT
+		if ( ckpt_interval > 0 && grp->mode == DET_MODE_DET && 
+		     (clock = get_logical_clock(myid)) >= ckpt_next_clock ) { 
+			ckpt_take(clock); 
+			ckpt_next_clock = (clock / ckpt_interval + 1) * ckpt_interval; 
+		}
+#endif 
+		det_cond_broadcast(&barrier->wait_cond); 
+	} else { 
+		det_cond_wait(&barrier->wait_cond, &barrier->wait_mutex); 
+	}
+	det_unlock(&barrier->wait_mutex); 
+
+	if ( op.st ) stat_end(&op); 
+	TRACE(DET_TRACE_BARRIER_LEAVE, barrier->id, 0); 
+	// enable counting 
+
+	if ( lret == 0 ) enable_logical_clock(); 
+
+	barrier_count ++; 
+	return ret; 
+}
+
+/**
+ * the first half of det_barrier_wait(): count me in and return at once. 
+ * the last to arrive releases the phase at its clock. 
+ */
+unsigned int det_barrier_arrive(det_barrier_t *barrier)
+{
+	unsigned int token; 
+	int lret; 
+
+	if ( check_domain(barrier->domain, "barrier", barrier->id) ) 
+		return 0; 
+
+	mode_check(); 
+
+	lret = disable_logical_clock(); 
+
+	det_lock(&barrier->wait_mutex); 
+	TRACE(DET_TRACE_BARRIER_ARRIVE, barrier->id, 0); 
+
+	token = barrier->phase; 
+	if ( ++barrier->wait_count == barrier->target_count ) { 
+		barrier->wait_count = 0; 
+		barrier->release_clock = get_logical_clock(myid); 
+		__sync_synchronize(); // det_barrier_wait_token() reads it w/o the lock 
+		barrier->phase++; 
+		det_cond_broadcast(&barrier->wait_cond); 
+	}
+	det_unlock(&barrier->wait_mutex); 
+
+	if ( lret == 0 ) enable_logical_clock(); 
+	return token; 
+}
+
+/**
+ * a token released already, seen without taking wait_mutex. in det mode 
+ * the phase is read at my turn if wait_mutex is free at my clock, the way 
+ * lock_acquire() checks it, so whether it was released is the same on 
+ * every run. the turn costs no clock. 
+ */
+static int barrier_released(det_barrier_t *barrier, unsigned int token, 
+			    int64_t *release)
+{
+	det_mutex_t *m = &barrier->wait_mutex; 
+	int64_t clock; 
+	int ret = 0; 
+
+	if ( !det_is_enabled() ) { 
+		if ( barrier->phase == token ) 
+			return 0; 
+		__sync_synchronize(); 
+		*release = barrier->release_clock; 
+		return 1; 
+	}
+
+	clock = wait_for_turn(barrier->domain); 
+	if ( pthread_mutex_trylock(&m->mutex) == 0 ) { 
+		if ( m->released_logical_time < clock && barrier->phase != token ) { 
+			*release = barrier->release_clock; 
+			ret = 1; 
+		}
+		pthread_mutex_unlock(&m->mutex); 
+	}
+	return ret; 
+}
+
+/**
+ * the second half: wait for the phase of token to be released. I leave at 
+ * the release clock or at my own if it is later, whether I had to block 
+ * or not, so the clock depends only on the arrivals. 
+ */
+int det_barrier_wait_token(det_barrier_t *barrier, unsigned int token)
+{
+	int64_t clock, release; 
+	int lret; 
+	struct stat_op op; 
+
+	if ( check_domain(barrier->domain, "barrier", barrier->id) ) 
+		return EPERM; 
+
+	mode_check(); 
+
+	lret = disable_logical_clock(); 
+
+	if ( barrier_released(barrier, token, &release) ) { 
+		TRACE(DET_TRACE_BARRIER_TOKEN, barrier->id, token); 
+		goto out; 
+	}
+
+	stat_begin(&op, STAT_BARRIER, barrier->id); 
+
+	det_lock(&barrier->wait_mutex); 
+	while ( barrier->phase == token ) 
+		det_cond_wait(&barrier->wait_cond, &barrier->wait_mutex); 
+	// the next release needs my next arrival, so this is token's. 
+	release = barrier->release_clock; 
+	TRACE(DET_TRACE_BARRIER_TOKEN, barrier->id, token); 
+	det_unlock(&barrier->wait_mutex); 
+	if ( op.st ) stat_end(&op); 
+
+out: 
+	clock = get_logical_clock(myid); 
+	if ( det_is_enabled() && clock < release ) 
+		wa[myid].sw_clock += release - clock; 
+
+	if ( lret == 0 ) enable_logical_clock(); 
+
+	barrier_count ++; 
+	return 0; 
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// reduction 
+///////////////////////////////////////////////////////////////////////////////////
+
+static int reduce_init(det_reduce_t *red, int count, int op, int type, 
+		       det_reduce_fn fn, size_t size, int len)
+{
+	// if not initialized, initialize. 
+	if ( grp->max_thr == 0 ) det_init(0, NULL);
+
+	red->target_count = count; 
+	red->wait_count = 0; 
+	red->phase = 0; 
+	red->op = op; 
+	red->type = type; 
+	red->fn = fn; 
+	red->size = size; 
+	red->len = len; 
+	red->partial = calloc(MAX_THR, size * len); 
+	red->present = calloc(MAX_THR, 1); 
+	red->result = calloc(1, size * len); 
+	if ( !red->partial || !red->present || !red->result ) {
+		free(red->partial); 
+		free(red->present); 
+		free(red->result); 
+		red->partial = red->present = red->result = NULL; 
+		return ENOMEM; 
+	}
+
+	pthread_mutex_lock(&grp->count_mutex); 
+	red->id = ++grp->g_reduce_count; 
+	pthread_mutex_unlock(&grp->count_mutex); 
+	red->domain = wa[myid].domain; 
+
+	lock_init(&red->lock, red->domain, 0); 
+	cond_init(&red->cond, red->domain, 0); 
+
+	TRACE(DET_TRACE_REDUCE_INIT, red->id, 0); 
+	return 0; 
+}
+
+int det_reduce_init(det_reduce_t *red, int count, int op, int type, int len)
+{
+	size_t size = (type == DET_REDUCE_INT64) ? sizeof(int64_t) : sizeof(double); 
+
+	if ( op < DET_REDUCE_SUM || op > DET_REDUCE_MAX ) 
+		return EINVAL; 
+	return reduce_init(red, count, op, type, NULL, size, len); 
+}
+
+int det_reduce_init_fn(det_reduce_t *red, int count, det_reduce_fn fn, 
+		       size_t size, int len)
+{
+	return reduce_init(red, count, -1, -1, fn, size, len); 
+}
+
+int det_reduce_destroy(det_reduce_t *red)
+{
+	det_lock_destroy(&red->lock); 
+	det_cond_destroy(&red->cond); 
+	free(red->partial); 
+	free(red->present); 
+	free(red->result); 
+	red->partial = red->present = red->result = NULL; 
+	return 0; 
+}
+
+#define REDUCE_OP(type, op, inout, in, len) do {			\
+		type *__d = (type *)(inout);				\
+		const type *__s = (const type *)(in);			\
+		int __i;						\
+		for ( __i = 0; __i < (len); __i++ ) {			\
+			if ( (op) == DET_REDUCE_SUM )			\
+				__d[__i] += __s[__i];			\
+			else if ( (op) == DET_REDUCE_MIN ? __s[__i] < __d[__i] : \
+				  __s[__i] > __d[__i] )			\
+				__d[__i] = __s[__i];			\
+		}							\
+	} while (0)
+
+static void reduce_op(det_reduce_t *red, void *inout, const void *in)
+{
+	if ( red->fn ) 
+		red->fn(inout, in, red->len); 
+	else if ( red->type == DET_REDUCE_INT64 ) 
+		REDUCE_OP(int64_t, red->op, inout, in, red->len); 
+	else 
+		REDUCE_OP(double, red->op, inout, in, red->len); 
+}
+
+/**
+ * the last of count threads combines the contributions in thread id order, 
+ * not in arrival order, so a floating point result is the same bit for bit 
+ * on every run, in native mode too. 
+ */
+int det_reduce(det_reduce_t *red, const void *in, void *out)
+{
+	size_t bytes = red->size * red->len; 
+	unsigned int phase; 
+	int i, first = 1; 
+	int lret; 
+
+	if ( check_domain(red->domain, "reduce", red->id) ) 
+		return EPERM; 
+
+	// disable counting
+	lret = disable_logical_clock(); 
+
+	det_lock(&red->lock); 
+
+	TRACE(DET_TRACE_REDUCE_ENTER, red->id, 0); 
+	assert(!red->present[myid]); 
+	memcpy(red->partial + myid * bytes, in, bytes); 
+	red->present[myid] = 1; 
+
+	if ( ++red->wait_count == red->target_count ) { 
+		for ( i = 0; i < MAX_THR; i++ ) { 
+			if ( !red->present[i] ) 
+				continue; 
+			if ( first ) 
+				memcpy(red->result, red->partial + i * bytes, bytes); 
+			else 
+				reduce_op(red, red->result, red->partial + i * bytes); 
+			red->present[i] = 0; 
+			first = 0; 
+		}
+		red->wait_count = 0; 
+		red->phase++; 
+		det_cond_broadcast(&red->cond); 
+	} else { 
+		phase = red->phase; 
+		while ( phase == red->phase ) 
+			det_cond_wait(&red->cond, &red->lock); 
+	}
+	// the result stays until all of this phase have left. 
+	if ( out ) 
+		memcpy(out, red->result, bytes); 
+
+	det_unlock(&red->lock); 
+
+	TRACE(DET_TRACE_REDUCE_LEAVE, red->id, 0); 
+
+	// enable counting 
+	if ( lret == 0 ) enable_logical_clock(); 
+
+	return 0; 
+}
+
+static int rwlock_init(det_rwlock_t *rwlock, int domain, int pshared)
+{
+	int id; 
+
+	// if not initialized, initialize. 
+	if ( grp->max_thr == 0 ) det_init(0, NULL);
+
+	rwlock->readers = 0; 
+	rwlock->writer = -1; 
+	rwlock->rd_waiting = 0; 
+	rwlock->wr_waiting = 0; 
+	rwlock->rd_phase = 0; 
+
+	pthread_mutex_lock(&grp->count_mutex); 
+	id = ++grp->g_rwlock_count; 
+	pthread_mutex_unlock(&grp->count_mutex); 
+	rwlock->domain = domain; 
+
+	lock_init(&rwlock->lock, domain, pshared); 
+	cond_init(&rwlock->rd_cond, domain, pshared); 
+	cond_init(&rwlock->wr_cond, domain, pshared); 
+
+	// statically initialized ones are usable from here. 
+	__sync_synchronize(); 
+	rwlock->id = id; 
+
+	TRACE(DET_TRACE_RWLOCK_INIT, rwlock->id, 0); 
+	return 0; 
+}
+
+int det_rwlock_init(det_rwlock_t *rwlock)
+{
+	return rwlock_init(rwlock, wa[myid].domain, 0); 
+}
+
+int det_rwlock_init_domain(det_rwlock_t *rwlock, int domain)
+{
+	return rwlock_init(rwlock, domain, 0); 
+}
+
+int det_rwlock_init_shared(det_rwlock_t *rwlock)
+{
+	return rwlock_init(rwlock, wa[myid].domain, 1); 
+}
+
+/**
+ * PTHREAD_RWLOCK_INITIALIZER. the first user initializes it in its turn. 
+ */
+static void rwlock_static_init(det_rwlock_t *rwlock)
+{
+	int lret; 
+
+	if ( grp->max_thr == 0 ) det_init(0, NULL);
+
+	lret = disable_logical_clock(); 
+	wait_for_turn(DET_DOMAIN_GLOBAL); 
+	if ( rwlock->id < 0 ) 
+		rwlock_init(rwlock, rwlock->domain, 0); 
+	wa[myid].sw_clock++; 
+	if ( lret == 0 ) enable_logical_clock(); 
+}
+
+/**
+ * hand the lock to the first writer in the wait queue. rwlock->lock is held. 
+ */
+static void rwlock_wake_writer(det_rwlock_t *rwlock)
+{
+	rwlock->wr_waiting--; 
+	rwlock->writer = MAX_THR; // reserved for the writer to wake up 
+	det_cond_signal(&rwlock->wr_cond); 
+}
+
+/**
+ * a reader's lock or unlock at a single turn. rwlock->lock is taken and 
+ * released within the turn if it is free at my clock, the way 
+ * lock_acquire() checks it. returns 0 if the reader has to wait or wake a 
+ * writer, or the lock was busy; the caller then goes through det_lock(). 
+ * *readers is the count as of the turn. 
+ */
+static int rwlock_reader_turn(det_rwlock_t *rwlock, int unlock, int *readers)
+{
+	det_mutex_t *m = &rwlock->lock; 
+	int64_t clock; 
+	int ret = 0; 
+
+	mode_check(); 
+	if ( !det_is_enabled() ) 
+		return 0; 
+
+	clock = wait_for_turn(m->domain); 
+	if ( IsEmptyQ(&m->queue) && pthread_mutex_trylock(&m->mutex) == 0 ) { 
+		if ( m->released_logical_time < clock ) { 
+			if ( !unlock && rwlock->writer < 0 && rwlock->wr_waiting == 0 ) { 
+				rwlock->readers++; 
+				ret = 1; 
+			} else if ( unlock && rwlock->writer != myid && 
+				    (rwlock->readers > 1 || rwlock->wr_waiting == 0) ) { 
+				rwlock->readers--; 
+				ret = 1; 
+			}
+			*readers = rwlock->readers; 
+		}
+		pthread_mutex_unlock(&m->mutex); 
+	}
+
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
+	wa[myid].sw_clock++; 
+	return ret; 
+}
+
+/**
+ * a reader is admitted unless a writer holds the lock or its turn came 
+ * first. in that case it waits for the batch the writer admits on unlock. 
+ */
+int det_rwlock_rdlock(det_rwlock_t *rwlock)
+{
+	int lret, ret, readers; 
+	unsigned int phase; 
+
+	if ( rwlock->id < 0 ) rwlock_static_init(rwlock); 
+	if ( check_domain(rwlock->domain, "rwlock", rwlock->id) ) 
+		return EPERM; 
+
+	lret = disable_logical_clock(); 
+	TRACE(DET_TRACE_RDLOCK_ENTER, rwlock->id, 0); 
+
+	if ( rwlock_reader_turn(rwlock, 0, &readers) ) 
+		goto out; 
+
+	if ( (ret = det_lock(&rwlock->lock)) ) 
+		goto fail; 
+	if ( rwlock->writer >= 0 || rwlock->wr_waiting > 0 ) { 
+		rwlock->rd_waiting++; 
+		phase = rwlock->rd_phase; 
+		while ( phase == rwlock->rd_phase ) 
+			det_cond_wait(&rwlock->rd_cond, &rwlock->lock); 
+		// counted in readers by the writer 
+	} else { 
+		rwlock->readers++; 
+	}
+	readers = rwlock->readers; 
+	det_unlock(&rwlock->lock); 
+out: 
+	TRACE(DET_TRACE_RDLOCK, rwlock->id, readers); 
+	ret = 0; 
+fail: 
+	if ( lret == 0 ) enable_logical_clock(); 
+	return ret; 
+}
+
+int det_rwlock_tryrdlock(det_rwlock_t *rwlock)
+{
+	int lret, ret = 0; 
+
+	if ( rwlock->id < 0 ) rwlock_static_init(rwlock); 
+	if ( check_domain(rwlock->domain, "rwlock", rwlock->id) ) 
+		return EPERM; 
+
+	lret = disable_logical_clock(); 
+
+	if ( (ret = det_lock(&rwlock->lock)) ) 
+		goto out; 
+	if ( rwlock->writer >= 0 || rwlock->wr_waiting > 0 ) 
+		ret = EBUSY; 
+	else 
+		rwlock->readers++; 
+	det_unlock(&rwlock->lock); 
+
+	TRACE(ret ? DET_TRACE_TRYRDLOCK_FAIL : DET_TRACE_TRYRDLOCK, rwlock->id, 0); 
+out: 
+	if ( lret == 0 ) enable_logical_clock(); 
+	return ret; 
+}
+
+/**
+ * writers are served in turn order after the readers ahead of them. 
+ */
+int det_rwlock_wrlock(det_rwlock_t *rwlock)
+{
+	int lret, ret; 
+
+	if ( rwlock->id < 0 ) rwlock_static_init(rwlock); 
+	if ( check_domain(rwlock->domain, "rwlock", rwlock->id) ) 
+		return EPERM; 
+
+	lret = disable_logical_clock(); 
+	TRACE(DET_TRACE_WRLOCK_ENTER, rwlock->id, 0); 
+
+	if ( (ret = det_lock(&rwlock->lock)) ) 
+		goto out; 
+	if ( rwlock->writer >= 0 || rwlock->readers > 0 || 
+	     rwlock->wr_waiting > 0 || rwlock->rd_waiting > 0 ) { 
+		rwlock->wr_waiting++; 
+		while ( rwlock->writer != MAX_THR ) 
+			det_cond_wait(&rwlock->wr_cond, &rwlock->lock); 
+	}
+	rwlock->writer = myid; 
+	det_unlock(&rwlock->lock); 
+
+	TRACE(DET_TRACE_WRLOCK, rwlock->id, 0); 
+out: 
+	if ( lret == 0 ) enable_logical_clock(); 
+	return ret; 
+}
+
+int det_rwlock_trywrlock(det_rwlock_t *rwlock)
+{
+	int lret, ret = 0; 
+
+	if ( rwlock->id < 0 ) rwlock_static_init(rwlock); 
+	if ( check_domain(rwlock->domain, "rwlock", rwlock->id) ) 
+		return EPERM; 
+
+	lret = disable_logical_clock(); 
+
+	if ( (ret = det_lock(&rwlock->lock)) ) 
+		goto out; 
+	if ( rwlock->writer >= 0 || rwlock->readers > 0 || 
+	     rwlock->wr_waiting > 0 || rwlock->rd_waiting > 0 ) 
+		ret = EBUSY; 
+	else 
+		rwlock->writer = myid; 
+	det_unlock(&rwlock->lock); 
+
+	TRACE(ret ? DET_TRACE_TRYWRLOCK_FAIL : DET_TRACE_TRYWRLOCK, rwlock->id, 0); 
+out: 
+	if ( lret == 0 ) enable_logical_clock(); 
+	return ret; 
+}
+
+/**
+ * a writer admits the readers that waited for it as one batch, so writers 
+ * and batches of readers alternate while both wait. 
+ */
+int det_rwlock_unlock(det_rwlock_t *rwlock)
+{
+	int lret, ret, readers; 
+
+	assert(rwlock->id > 0 ); 
+	if ( check_domain(rwlock->domain, "rwlock", rwlock->id) ) 
+		return EPERM; 
+
+	lret = disable_logical_clock(); 
+
+	if ( rwlock->writer != myid && rwlock_reader_turn(rwlock, 1, &readers) ) { 
+		TRACE(DET_TRACE_RD_REL, rwlock->id, 0); 
+		ret = 0; 
+		goto out; 
 	}
-	return 0; 
+
+	if ( (ret = det_lock(&rwlock->lock)) ) 
+		goto out; 
+	if ( rwlock->writer == myid ) { 
+		TRACE(DET_TRACE_WR_REL, rwlock->id, 0); 
+		rwlock->writer = -1; 
+		if ( rwlock->rd_waiting > 0 ) { 
+			rwlock->readers = rwlock->rd_waiting; 
+			rwlock->rd_waiting = 0; 
+			rwlock->rd_phase++; 
+			det_cond_broadcast(&rwlock->rd_cond); 
+		} else if ( rwlock->wr_waiting > 0 ) { 
+			rwlock_wake_writer(rwlock); 
+		}
+	} else { 
+		assert(rwlock->readers > 0 ); 
+		TRACE(DET_TRACE_RD_REL, rwlock->id, 0); 
+		if ( --rwlock->readers == 0 && rwlock->wr_waiting > 0 ) 
+			rwlock_wake_writer(rwlock); 
+	}
+	det_unlock(&rwlock->lock); 
+out: 
+	if ( lret == 0 ) enable_logical_clock(); 
+	return ret; 
 }
 
-static void *worker_thread(void *v)
+enum { ATOMIC_ADD, ATOMIC_AND, ATOMIC_OR, ATOMIC_XCHG, ATOMIC_CAS }; 
+
+#define ATOMIC_RMW(p, t, op, val, cmp)					\
+	((op) == ATOMIC_ADD ? __sync_fetch_and_add(p, (t)(val)) :		\
+	 (op) == ATOMIC_AND ? __sync_fetch_and_and(p, (t)(val)) :		\
+	 (op) == ATOMIC_OR ? __sync_fetch_and_or(p, (t)(val)) :		\
+	 (op) == ATOMIC_XCHG ? __atomic_exchange_n(p, (t)(val), __ATOMIC_SEQ_CST) : \
+	 __sync_val_compare_and_swap(p, (t)(cmp), (t)(val)))
+
+static int64_t atomic_rmw(volatile void *ptr, int size, int op, 
+			  int64_t val, int64_t cmp)
 {
-	struct worker_args *w = (struct worker_args *)v; 
-	int ret; 
-	unsigned start, elapsed; 
-	char *ptr; 
-	
-	/* assign myid (TLS) */ 
-	myid = w->id; 
-	my_det_enabled = 1; 
-	my_det_clock = 0; 
+	switch ( size ) { 
+	case 1: 
+		return ATOMIC_RMW((volatile int8_t *)ptr, int8_t, op, val, cmp); 
+	case 2: 
+		return ATOMIC_RMW((volatile int16_t *)ptr, int16_t, op, val, cmp); 
+	case 4: 
+		return ATOMIC_RMW((volatile int32_t *)ptr, int32_t, op, val, cmp); 
+	default: 
+		return ATOMIC_RMW((volatile int64_t *)ptr, int64_t, op, val, cmp); 
+	}
+}
 
-	cpu_set_t cmask;
+/**
+ * one turn, like the turn of a lock acquisition but nothing to wait for. 
+ */
+static int64_t det_atomic(volatile void *ptr, int size, int op, 
+			  int64_t val, int64_t cmp)
+{
+	int64_t ret; 
+	int lret; 
 
-	assert(num_processors > 0 ); 
+	mode_check(); 
 
-	CPU_ZERO(&cmask);
-	CPU_SET(myid % num_processors, &cmask);
-	sched_setaffinity(0, num_processors, &cmask); 
+	// if det is disabled simply same as the builtin. 
+	if ( !det_is_enabled() ) 
+		return atomic_rmw(ptr, size, op, val, cmp); 
 
-	if ( (ptr = getenv("DPTHREAD_RT") ) ) { 
-		struct sched_param param;
-		param.sched_priority = 1; 
-		if(sched_setscheduler(0, SCHED_FIFO, &param) == -1) {
-			perror("sched_setscheduler failed");
-		}
-	}
+	lret = disable_logical_clock(); 
 
-	/* open counter */ 
-	open_pfm_counter(w); 
+	wait_for_turn(wa[myid].domain); 
+	ret = atomic_rmw(ptr, size, op, val, cmp); 
+	DBG(2, "atomic(%p) op %d\n", ptr, op); 
 
-	start = get_usecs(); 
+	// update last sync logical time 
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
 
-	enable_logical_clock(); 
-	
-	// physically enable performance counter 
-	enable_performance_counter();
+	// the result is visible (__sync is a full barrier) before others proceed. 
+	wa[myid].sw_clock++; 
 
-	det_lock(&w->thread_lock); 
-	w->started = 1; 
-	det_cond_signal(&w->thread_cond); 
-	det_unlock(&w->thread_lock); 
+	if ( lret == 0 ) enable_logical_clock(); 
+	return ret; 
+}
 
-	/* execute user supplied function */ 
-	w->func(w->arg); 
+int32_t det_atomic_load_32(volatile int32_t *ptr)
+{
+	return det_atomic(ptr, 4, ATOMIC_ADD, 0, 0); 
+}
 
-	/* cleanup and finish */ 
-	elapsed = get_usecs() - start; 
+int64_t det_atomic_load_64(volatile int64_t *ptr)
+{
+	return det_atomic(ptr, 8, ATOMIC_ADD, 0, 0); 
+}
 
-	det_exit((void *)&ret); // do not return 
+int32_t det_atomic_fetch_add_32(volatile int32_t *ptr, int32_t val)
+{
+	return det_atomic(ptr, 4, ATOMIC_ADD, val, 0); 
+}
 
-	assert(0); // should not reach here. 
-	return NULL; 
+int64_t det_atomic_fetch_add_64(volatile int64_t *ptr, int64_t val)
+{
+	return det_atomic(ptr, 8, ATOMIC_ADD, val, 0); 
 }
 
-///////////////////////////////////////////////////////////////////////////////////
-// dpthread core  
-///////////////////////////////////////////////////////////////////////////////////
+int32_t det_atomic_fetch_and_32(volatile int32_t *ptr, int32_t val)
+{
+	return det_atomic(ptr, 4, ATOMIC_AND, val, 0); 
+}
 
-int det_increase_logical_clock(int incr)
+int64_t det_atomic_fetch_and_64(volatile int64_t *ptr, int64_t val)
 {
-	if ( !det_is_enabled() ) return -1; 
-	wa[myid].sw_clock +=incr; 
-	return 0; 
+	return det_atomic(ptr, 8, ATOMIC_AND, val, 0); 
 }
 
-int det_enable_logical_clock(int incr)
+int32_t det_atomic_fetch_or_32(volatile int32_t *ptr, int32_t val)
 {
-	if (!det_is_enabled() ) return -1; 
+	return det_atomic(ptr, 4, ATOMIC_OR, val, 0); 
+}
 
-	wa[myid].sw_clock +=incr; 
-	return enable_logical_clock(); 
+int64_t det_atomic_fetch_or_64(volatile int64_t *ptr, int64_t val)
+{
+	return det_atomic(ptr, 8, ATOMIC_OR, val, 0); 
 }
 
-int det_disable_logical_clock()
+int32_t det_atomic_exchange_32(volatile int32_t *ptr, int32_t val)
 {
-	if ( !det_is_enabled() ) return -1; 
+	return det_atomic(ptr, 4, ATOMIC_XCHG, val, 0); 
+}
 
-	return disable_logical_clock(); 
+int64_t det_atomic_exchange_64(volatile int64_t *ptr, int64_t val)
+{
+	return det_atomic(ptr, 8, ATOMIC_XCHG, val, 0); 
 }
 
-int det_exit_logical_clock()
+int32_t det_atomic_cas_32(volatile int32_t *ptr, int32_t oldval, int32_t newval)
 {
-	if ( !det_is_enabled() ) return -1; 
+	return det_atomic(ptr, 4, ATOMIC_CAS, newval, oldval); 
+}
 
-	wa[myid].last_exit_logical_time = GET_CLOCK(myid); 
-	SET_CLOCK(myid, MAX_LOGICAL_CLOCK); 
+int64_t det_atomic_cas_64(volatile int64_t *ptr, int64_t oldval, int64_t newval)
+{
+	return det_atomic(ptr, 8, ATOMIC_CAS, newval, oldval); 
+}
 
-	return 0; 
+int64_t det_atomic_load_n(volatile void *ptr, int size)
+{
+	assert(size == 1 || size == 2); 
+	return det_atomic(ptr, size, ATOMIC_ADD, 0, 0); 
 }
 
-/**
- * @brief asynchronously wokeup by external event. 
- * I catch up time progress up to last sync time. 
- * use this function only for waiting for external events. 
- */ 
-int det_adjust_logical_clock()
+int64_t det_atomic_fetch_add_n(volatile void *ptr, int size, int64_t val)
 {
-	if ( !det_is_enabled() ) return -1; 
+	assert(size == 1 || size == 2); 
+	return det_atomic(ptr, size, ATOMIC_ADD, val, 0); 
+}
 
-	if ( last_sync_logical_time > wa[myid].last_exit_logical_time ) {
-		int lret = disable_logical_clock();
-		SET_CLOCK(myid, last_sync_logical_time); 
-		wa[myid].nondet_count++; 
-		DBG(2, "got alarm\n"); 
-		if ( lret == 0 ) enable_logical_clock(); 
-	} else {
-		SET_CLOCK(myid, wa[myid].last_exit_logical_time); 
-	}
+int64_t det_atomic_fetch_and_n(volatile void *ptr, int size, int64_t val)
+{
+	assert(size == 1 || size == 2); 
+	return det_atomic(ptr, size, ATOMIC_AND, val, 0); 
+}
+
+int64_t det_atomic_fetch_or_n(volatile void *ptr, int size, int64_t val)
+{
+	assert(size == 1 || size == 2); 
+	return det_atomic(ptr, size, ATOMIC_OR, val, 0); 
+}
+
+int64_t det_atomic_exchange_n(volatile void *ptr, int size, int64_t val)
+{
+	assert(size == 1 || size == 2); 
+	return det_atomic(ptr, size, ATOMIC_XCHG, val, 0); 
+}
+
+int64_t det_atomic_cas_n(volatile void *ptr, int size, int64_t oldval, int64_t newval)
+{
+	assert(size == 1 || size == 2); 
+	return det_atomic(ptr, size, ATOMIC_CAS, newval, oldval); 
+}
+
+static int semaphore_init(det_sem_t *sem, unsigned int value, int domain, int pshared)
+{
+	// if not initialized, initialize. 
+	if ( grp->max_thr == 0 ) det_init(0, NULL);
+
+	sem->value = value; 
+
+	pthread_mutex_lock(&grp->count_mutex); 
+	sem->id = ++grp->g_sem_count; 
+	pthread_mutex_unlock(&grp->count_mutex); 
+	sem->domain = domain; 
+
+	sync_mutex_init(&sem->mutex, pshared); 
+	cond_init(&sem->wait, domain, pshared); 
 
+	TRACE(DET_TRACE_SEM_INIT, sem->id, value); 
 	return 0; 
 }
 
-void det_set_debug(int level)
+int det_sem_init(det_sem_t *sem, unsigned int value)
 {
-	debug_level = level; 
+	return semaphore_init(sem, value, wa[myid].domain, 0); 
+}
+
+int det_sem_init_domain(det_sem_t *sem, unsigned int value, int domain)
+{
+	return semaphore_init(sem, value, domain, 0); 
+}
+
+int det_sem_init_shared(det_sem_t *sem, unsigned int value)
+{
+	return semaphore_init(sem, value, wa[myid].domain, 1); 
 }
 
 /**
- * initialize dpthread 
+ * one turn unless the value is 0. the post that wakes me hands its unit 
+ * over and sets my clock. 
  */
-int det_init(int argc, char *argv[])
+int det_sem_wait(det_sem_t *sem)
 {
-	struct worker_args *w; 
+	det_mutex_t *lock; 
+	int lret, det; 
 
-	/* 
-	   Environment variables: 
-	   DPTHREAD_DEBUG <number>     # enable debug. 0 - none, 1 - basic, 2 - verbose, 3 - all.
-	*/ 
-	char *ptr; 
-	cpu_set_t cmask;
+	if ( check_domain(sem->domain, "sem", sem->id) ) { 
+		errno = EPERM; 
+		return -1; 
+	}
 
-	num_processors = sysconf(_SC_NPROCESSORS_CONF); 
-	assert(num_processors > 0 ); 
+	mode_check(); 
 
-	CPU_ZERO(&cmask);
-	sched_setaffinity(0, num_processors, &cmask); 
+	lret = disable_logical_clock(); 
+	if ( (det = det_is_enabled()) ) 
+		wait_for_turn(sem->domain); 
 
-	if ( (ptr = getenv("DPTHREAD_DEBUG")) ) { 
-		debug_level = atoi(ptr); 
+	pthread_mutex_lock(&sem->mutex); 
+	if ( sem->value > 0 ) { 
+		sem->value--; 
+		pthread_mutex_unlock(&sem->mutex); 
+		TRACE(DET_TRACE_SEM_WAIT, sem->id, 0); 
+
+		grp->last_sync_logical_time = GET_CLOCK(myid); 
+		wa[myid].sw_clock++; 
+		if ( lret == 0 ) enable_logical_clock(); 
+		return 0; 
 	}
-	if ( (ptr = getenv("DPTHREAD_LOG_FILE")) ) { 
-		debug_log_file = ptr; 
+
+	TRACE(DET_TRACE_SEM_BLOCK, sem->id, 0); 
+	lock = &sem->wait.waiter[myid]; 
+	AddQ(&sem->wait.queue, (void *)lock); 
+	wa[myid].parked = 1; 
+	pthread_mutex_unlock(&sem->mutex); 
+
+	// others take their turns while I'm blocked. in native mode the post 
+	// may have come already; the switch to det sets the clock instead. 
+	if ( det ) { 
+		wa[myid].sw_clock += MAX_LOGICAL_CLOCK; 
+		timed_kick(); 
 	}
+	__sync_bool_compare_and_swap(&wa[myid].parked, 1, 3); // unless posted 
 
-	if ( (ptr = getenv("DPTHREAD_RT") ) ) { 
-		struct sched_param param;
-		param.sched_priority = 1; 
-		if(sched_setscheduler(0, SCHED_FIFO, &param) == -1) {
-			perror("sched_setscheduler failed");
+	// waiter->P()
+	pthread_mutex_lock(&lock->mutex); 
+	time_woken(); 
+
+	// poster must set this already. 
+	assert(GET_CLOCK(myid) < MAX_LOGICAL_CLOCK); 
+	TRACE(DET_TRACE_SEM_WAKE, sem->id, 0); 
+
+	if ( lret == 0 ) enable_logical_clock(); 
+	return 0; 
+}
+
+int det_sem_timedwait(det_sem_t *sem, const struct timespec *abstime)
+{
+	det_mutex_t *lock; 
+	int64_t deadline, now; 
+	int lret, det, ret; 
+
+	if ( check_domain(sem->domain, "sem", sem->id) ) { 
+		errno = EPERM; 
+		return -1; 
+	}
+
+	mode_check(); 
+
+	lret = disable_logical_clock(); 
+	if ( (det = det_is_enabled()) ) 
+		wait_for_turn(sem->domain); 
+	deadline = timed_deadline(abstime); 
+	now = get_logical_clock(myid); 
+
+	pthread_mutex_lock(&sem->mutex); 
+	if ( sem->value > 0 || deadline <= now ) { 
+		ret = 0; 
+		if ( sem->value > 0 ) 
+			sem->value--; 
+		else 
+			ret = ETIMEDOUT; 
+		pthread_mutex_unlock(&sem->mutex); 
+		TRACE(ret ? DET_TRACE_SEM_TIMEDWAIT_FAIL : DET_TRACE_SEM_TIMEDWAIT, sem->id, 0); 
+
+		grp->last_sync_logical_time = GET_CLOCK(myid); 
+		wa[myid].sw_clock++; 
+		if ( lret == 0 ) enable_logical_clock(); 
+		if ( ret ) { 
+			errno = ret; 
+			return -1; 
 		}
+		return 0; 
 	}
 
-	// if ( (ptr = getenv("LD_PRELOAD")) && strstr(ptr, "libdetio.so") )
+	TRACE(DET_TRACE_SEM_TIMEDBLOCK, sem->id, deadline); 
+	lock = &sem->wait.waiter[myid]; 
+	timed_begin(lock, sem->domain, deadline); 
+	AddQ(&sem->wait.queue, (void *)lock); 
+	wa[myid].parked = 1; 
+	pthread_mutex_unlock(&sem->mutex); 
 
-	if (pfm_initialize() != PFM_SUCCESS)
-		errx(1, "pfm_initialize failed");
-	
-	// initialize structure
-	memset(wa, 0, MAX_THR * sizeof(struct worker_args)); 
+	if ( det ) 
+		wa[myid].sw_clock += deadline - now; 
+	__sync_bool_compare_and_swap(&wa[myid].parked, 1, 3); // unless posted 
 
-	// setup master thread 
-	assert(max_thr == 0 ); 
+	ret = timed_block(lock, deadline - now); 
+	assert(GET_CLOCK(myid) < MAX_LOGICAL_CLOCK); 
 
-	myid = 0; 
-	my_det_enabled = 1; 
-	my_det_clock = 0; 
-	max_thr = num_thr = 1; 
+	if ( ret == ETIMEDOUT ) { 
+		pthread_mutex_lock(&sem->mutex); 
+		DelItemQ(&sem->wait.queue, (void *)lock); 
+		pthread_mutex_unlock(&sem->mutex); 
+		wa[myid].sw_clock++; 
+	}
+	timed_end(); 
+	TRACE(ret ? DET_TRACE_SEM_TIMEOUT : DET_TRACE_SEM_TIMEDWAKE, sem->id, 0); 
 
-	w = &wa[0]; 
-	w->id = myid; 
-	w->func = NULL; 
-	w->arg  = NULL; 
-	w->sw_clock = 0; 
-	w->hw_clock  = 0; 
-	w->hw_clock_enabled = 0; 
+	if ( lret == 0 ) enable_logical_clock(); 
+	if ( ret ) { 
+		errno = ret; 
+		return -1; 
+	}
+	return 0; 
+}
 
-	if ( debug_log_file ) {
-		char name[40]; 
-		sprintf(name, "%s.p%d", debug_log_file, myid); 
-		w->log_file = fopen(name, "w+"); 
-	} else {
-		w->log_file = stderr; 
+int det_sem_trywait(det_sem_t *sem)
+{
+	int lret, ret = 0; 
+
+	if ( check_domain(sem->domain, "sem", sem->id) ) { 
+		errno = EPERM; 
+		return -1; 
+	}
+
+	mode_check(); 
+
+	lret = disable_logical_clock(); 
+	if ( det_is_enabled() ) 
+		wait_for_turn(sem->domain); 
+
+	pthread_mutex_lock(&sem->mutex); 
+	if ( sem->value > 0 ) 
+		sem->value--; 
+	else 
+		ret = -1; 
+	pthread_mutex_unlock(&sem->mutex); 
+	TRACE(ret ? DET_TRACE_SEM_TRYWAIT_FAIL : DET_TRACE_SEM_TRYWAIT, sem->id, 0); 
+
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
+	wa[myid].sw_clock++; 
+	if ( lret == 0 ) enable_logical_clock(); 
+
+	if ( ret ) errno = EAGAIN; 
+	return ret; 
+}
+
+#define SEM_NO_WAITER ((det_mutex_t *)1) // nobody woken yet, unlike NULL 
+
+int det_sem_post(det_sem_t *sem)
+{
+	det_mutex_t *lock = SEM_NO_WAITER; 
+	int64_t clock; 
+	int lret; 
+
+	if ( check_domain(sem->domain, "sem", sem->id) ) { 
+		errno = EPERM; 
+		return -1; 
+	}
+
+	mode_check(); 
+
+	lret = disable_logical_clock(); 
+	if ( det_is_enabled() ) 
+		wait_for_turn(sem->domain); 
+	clock = get_logical_clock(myid); 
+
+	pthread_mutex_lock(&sem->mutex); 
+	while ( !IsEmptyQ(&sem->wait.queue) ) { 
+		lock = (det_mutex_t*)DelQ(&sem->wait.queue); 
+		if ( wake_waiter(lock, clock) == 0 ) { 
+			TRACE(DET_TRACE_SEM_POST_TO, sem->id, lock->id); 
+			lock = NULL; 
+			break; 
+		}
+	}
+	if ( lock ) { 
+		sem->value++; 
+		TRACE(DET_TRACE_SEM_POST, sem->id, 0); 
+	}
+	pthread_mutex_unlock(&sem->mutex); 
+
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
+	wa[myid].sw_clock++; 
+	if ( lret == 0 ) enable_logical_clock(); 
+	return 0; 
+}
+
+/**
+ * the value at my turn, like det_sem_trywait(). 
+ */
+int det_sem_getvalue(det_sem_t *sem, int *sval)
+{
+	int lret; 
+
+	if ( check_domain(sem->domain, "sem", sem->id) ) { 
+		errno = EPERM; 
+		return -1; 
 	}
 
-	// open performance counter
-	open_pfm_counter(w); 
+	mode_check(); 
 
-	// perf related. 
-	perf_logical.min = perf_wait_turn.min = INT_MAX;
-	perf_enable.min = perf_disable.min = INT_MAX; 
+	lret = disable_logical_clock(); 
+	if ( det_is_enabled() ) 
+		wait_for_turn(sem->domain); 
 
-	DBG(1, "INIT: debug_level=%d. event begin \n", debug_level); 
+	pthread_mutex_lock(&sem->mutex); 
+	*sval = sem->value; 
+	pthread_mutex_unlock(&sem->mutex); 
+
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
+	wa[myid].sw_clock++; 
+	if ( lret == 0 ) enable_logical_clock(); 
+	return 0; 
+}
+
+int det_spin_init(det_spinlock_t *lock)
+{
+	// if not initialized, initialize. 
+	if ( grp->max_thr == 0 ) det_init(0, NULL);
 
+	lock->locked = 0; 
+	lock->released_logical_time = 0; 
+	lock->owner = -1; 
+	lock->domain = wa[myid].domain; 
 
+	pthread_mutex_lock(&grp->count_mutex); 
+	lock->id = ++grp->g_lock_count; 
+	pthread_mutex_unlock(&grp->count_mutex); 
+
+	TRACE(DET_TRACE_SPIN_INIT, lock->id, 0); 
 	return 0; 
 }
 
-int det_lock_init(det_mutex_t *mutex)
+/**
+ * same rule as det_lock(): free both physically and logically at my turn. 
+ */
+int det_spin_lock(det_spinlock_t *lock)
 {
-	int ret; 
-	int lret;
+	int64_t clock; 
+	int lret; 
 
-	// if not initialized, initialize. 
-	if ( max_thr == 0 ) det_init(0, NULL);
-	lret = disable_logical_clock(); 
+	if ( check_domain(lock->domain, "spin", lock->id) ) 
+		return EPERM; 
 
-	InitQ(&mutex->queue, MAX_THR); 
+	mode_check(); 
 
-	pthread_mutex_lock(&count_mutex); 
-	mutex->id = ++g_lock_count; 
-	pthread_mutex_unlock(&count_mutex); 
-	mutex->released_logical_time = 0; 
-	mutex->owner = -1; 
-	mutex->ref = 0; 
+	if ( !det_is_enabled() ) { 
+		while ( !__sync_bool_compare_and_swap(&lock->locked, 0, 1) ) { 
+			sched_yield(); 
+			if ( grp->mode_request != grp->mode ) { 
+				mode_check(); 
+				if ( det_is_enabled() ) 
+					return det_spin_lock(lock); 
+			}
+		}
+		lock->owner = myid; 
+		return 0; 
+	}
 
-	DBG(1, "mutex_init(%d)\n", mutex->id); 
+	lret = disable_logical_clock(); 
 
-	ret = pthread_mutex_init(&mutex->mutex, NULL); 
+	clock = wait_for_turn(lock->domain); 
+	while ( lock->released_logical_time >= clock || 
+		!__sync_bool_compare_and_swap(&lock->locked, 0, 1) ) { 
+		DBG(3, "spin(%d) --spinning\n", lock->id); 
+		wa[myid].sw_clock++; 
+		clock = wait_for_turn(lock->domain); 
+
+		if ( grp->mode_request != grp->mode ) { 
+			// the owner may be waiting at the switch. leave and retry. 
+			mode_arrive(); 
+			if ( lret == 0 ) enable_logical_clock(); 
+			return det_spin_lock(lock); 
+		}
+	}
+	lock->owner = myid; 
+	TRACE(DET_TRACE_SPIN, lock->id, 0); 
 
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
+	wa[myid].sw_clock++; 
 	if ( lret == 0 ) enable_logical_clock(); 
 
+	lock_count ++; 
 	return 0; 
 }
 
-int det_trylock(det_mutex_t *mutex)
+int det_spin_trylock(det_spinlock_t *lock)
 {
-	int ret = 0; 
-	int lret; 
 	int64_t clock; 
+	int lret, ret = 0; 
 
-	assert(mutex->id > 0 ); 
-
-	// if det is disabled simply same as pthread. 
-	if ( !det_is_enabled() ) 
-		return pthread_mutex_lock(&mutex->mutex);
-	// disable count       
-	lret = disable_logical_clock(); 
-
-	DBG(1, "trylock(%d)\n", mutex->id);
+	if ( check_domain(lock->domain, "spin", lock->id) ) 
+		return EPERM; 
 
-#if USE_MUTEX_RECURSIVE 
-	if ( mutex->ref > 0 && mutex->owner == myid ) { 
-		mutex->ref++; 
-		goto out; 
-	} 
-#endif 
+	mode_check(); 
 
-	clock = wait_for_turn(); 
-	AddQ(&mutex->queue, (void *)myid);
+	if ( !det_is_enabled() ) { 
+		if ( !__sync_bool_compare_and_swap(&lock->locked, 0, 1) ) 
+			return EBUSY; 
+		lock->owner = myid; 
+		return 0; 
+	}
 
-	if ( (int)GetHeadQ(&mutex->queue) == myid && 
-	     (ret = pthread_mutex_trylock(&mutex->mutex)) == 0 ) 
-	{ // success. 
-		int64_t last_release = mutex->released_logical_time; 
-		DBG(3, "--trylock");
-		if ( last_release >= clock ) 
-		{ // physically ok but logically not. 
-			DBG(3, "--case2: released at %lld\n", last_release); 
-			pthread_mutex_unlock(&mutex->mutex); 
-#if USE_DET_FASTFORWARD
-			// deterministic fast forward. 
-			wa[myid].sw_clock += (last_release - clock); 
-#endif 
-			ret = EBUSY; 
-		}
-		else 
-		{ // logically and physically ok. 
-			mutex->owner = myid;
-			mutex->ref = 1; 
-		}
-	} 
-	assert(GET_CLOCK(myid) < MAX_LOGICAL_CLOCK); 
+	lret = disable_logical_clock(); 
 
-	// update last sync logical time 
-	last_sync_logical_time = GET_CLOCK(myid); 
-	
-	if ( ret == 0 ) {
-		DBG(1, "trylock acq(%d)\n", mutex->id);
-		// statistic 
+	clock = wait_for_turn(lock->domain); 
+	if ( lock->released_logical_time >= clock || 
+	     !__sync_bool_compare_and_swap(&lock->locked, 0, 1) ) { 
+		ret = EBUSY; 
+	} else { 
+		lock->owner = myid; 
 		lock_count ++; 
-
-		// remove from the queue. 
-		DelQ(&mutex->queue); 
-	} else {
-		DBG(1, "trylock fail(%d)\n", mutex->id); 
 	}
+	TRACE(ret ? DET_TRACE_SPIN_TRYLOCK_FAIL : DET_TRACE_SPIN_TRYLOCK, lock->id, 0); 
 
-out:
-	// increase logical clock 
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
 	wa[myid].sw_clock++; 
-
-	// resume logical clock 
 	if ( lret == 0 ) enable_logical_clock(); 
-
 	return ret; 
 }
 
-int det_lock(det_mutex_t *mutex)
+/**
+ * no turn, like det_unlock(). the release time orders the next acquisition. 
+ */
+int det_spin_unlock(det_spinlock_t *lock)
 {
-	int ret = 0; 
 	int lret; 
-	int64_t clock; 
 
-	if ( mutex->id < 0 ) { 
-		det_lock_init(mutex); 
+	lock->owner = -1; 
+	if ( !det_is_enabled() ) { 
+		__sync_lock_release(&lock->locked); 
+		return 0; 
 	}
 
-	assert(mutex->id > 0 ); 
-
-	// if det is disabled simply same as pthread. 
-	if ( !det_is_enabled() ) 
-		return pthread_mutex_lock(&mutex->mutex);
-
-	// disable count       
 	lret = disable_logical_clock(); 
 
-#if USE_MUTEX_RECURSIVE 
-	if ( mutex->ref > 0 && mutex->owner == myid ) { 
-		mutex->ref++; 
-		goto out; 
-	} 
-#endif 
+	lock->released_logical_time = get_logical_clock(myid); 
+	wa[myid].last_release_logical_time = lock->released_logical_time; 
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
+	__sync_lock_release(&lock->locked); 
+	TRACE(DET_TRACE_SPIN_REL, lock->id, 0); 
 
-#if !USE_NESTED_LOCK
-	DBG(2, "acq(%d) enter\n", mutex->id);
+	wa[myid].sw_clock++; 
+	if ( lret == 0 ) enable_logical_clock(); 
+	return 0; 
+}
 
-	// wait for turn 
-	clock = wait_for_turn();
+///////////////////////////////////////////////////////////////////////////////////
+// bounded queue 
+///////////////////////////////////////////////////////////////////////////////////
 
-	ret = pthread_mutex_lock(&mutex->mutex);
+static char queue_closed; // handed to blocked threads at close 
 
-#else // USE_NESTED_LOCK
+int det_queue_init(det_queue_t *q, int size)
+{
+	// if not initialized, initialize. 
+	if ( grp->max_thr == 0 ) det_init(0, NULL);
+
+	if ( size < 1 ) 
+		return EINVAL; 
+	if ( !(q->buf = calloc(size, sizeof(void *))) ) 
+		return ENOMEM; 
+	q->size = size; 
+	q->count = 0; 
+	q->head = q->tail = 0; 
+	q->closed = 0; 
+
+	pthread_mutex_lock(&grp->count_mutex); 
+	q->id = ++grp->g_queue_count; 
+	pthread_mutex_unlock(&grp->count_mutex); 
+	q->domain = wa[myid].domain; 
+
+	sync_mutex_init(&q->mutex, 0); 
+	cond_init(&q->getters, q->domain, 0); 
+	cond_init(&q->putters, q->domain, 0); 
+
+	TRACE(DET_TRACE_QUEUE_INIT, q->id, size); 
+	return 0; 
+}
 
-	DBG(1, "acq(%d) - enter\n", mutex->id);
+void det_queue_destroy(det_queue_t *q)
+{
+	det_cond_destroy(&q->getters); 
+	det_cond_destroy(&q->putters); 
+	pthread_mutex_destroy(&q->mutex); 
+	free(q->buf); 
+	q->buf = NULL; 
+}
 
-	clock = wait_for_turn(); 
-	AddQ(&mutex->queue, (void *)myid);
+/**
+ * park on cond until another thread, in its turn, hands me an item or 
+ * takes mine and sets my clock. q->mutex is held on entry, not on return. 
+ */
+static void *queue_block(det_queue_t *q, det_cond_t *cond, void *item, int det)
+{
+	det_mutex_t *lock = &cond->waiter[myid]; 
 
-	while ( 1 ) {
-		if ( (int)GetHeadQ(&mutex->queue) == myid && 
-		     pthread_mutex_trylock(&mutex->mutex) == 0 ) 
-		{ // success. 
-			int64_t last_release = mutex->released_logical_time; 
-			DBG(3, "--trylock");
-			if ( last_release >= clock ) 
-			{ // physically ok but logically not. 
-				DBG(3, "--case2: released at %lld\n", last_release ); 
-				pthread_mutex_unlock(&mutex->mutex); 
-#if USE_DET_FASTFORWARD
-				// deterministic fast forward. 
-				wa[myid].sw_clock += (last_release - clock); 
-#endif 
-			}
-			else 
-			{ // logically and physically ok. 
-				DBG(3, "got it. sw_clock = %lld\n", wa[myid].sw_clock); 
-				mutex->owner = myid; 
-				mutex->ref = 1; 
-				break; // quit the loop. 
-			}
-		} 
-		assert(GET_CLOCK(myid) < MAX_LOGICAL_CLOCK); 
-		DBG(1, "--spinning\n");
+	q->handoff[myid] = item; 
+	AddQ(&cond->queue, (void *)lock); 
+	wa[myid].parked = 1; 
+	pthread_mutex_unlock(&q->mutex); 
 
-		// increase clock 
-		wa[myid].sw_clock ++; 
+	if ( det ) { 
+		wa[myid].sw_clock += MAX_LOGICAL_CLOCK; 
+		timed_kick(); 
+	}
+	__sync_bool_compare_and_swap(&wa[myid].parked, 1, 3); // unless woken 
 
-		// wait for turn 
-		clock = wait_for_turn();
-	}	
+	pthread_mutex_lock(&lock->mutex); 
+	time_woken(); 
 
-#endif // USE_NESTED_LOCK
+	// waker must set this already. 
 	assert(GET_CLOCK(myid) < MAX_LOGICAL_CLOCK); 
-	DBG(1, "acq(%d)\n", mutex->id);
-
-	// update last sync logical time 
-	last_sync_logical_time = GET_CLOCK(myid); 
-	
-	// remove from the queue. 
-	DelQ(&mutex->queue); 
-
-out: 
-	// increase logical clock 
-	wa[myid].sw_clock++; 
+	return q->handoff[myid]; 
+}
 
-	// resume logical clock 
-	if ( lret == 0 ) enable_logical_clock(); 
+/**
+ * wake the first thread parked on cond with item. a thread in 
+ * det_chan_select() is parked on several queues; the first waker takes it 
+ * and the later ones drop its entry. returns -1 if no one was woken. 
+ */
+static int queue_wake(det_queue_t *q, det_cond_t *cond, void *item, int64_t clock)
+{
+	det_mutex_t *lock; 
 
-	// statistic 
-	lock_count ++; 
-	return ret; 
+	while ( !IsEmptyQ(&cond->queue) ) { 
+		lock = (det_mutex_t *)DelQ(&cond->queue); 
+		if ( wa[lock->id].select_state && 
+		     !__sync_bool_compare_and_swap(&wa[lock->id].select_state, 1, 2) ) 
+			continue; // woken through another queue 
+		wa[lock->id].select_queue = q; 
+		q->handoff[lock->id] = item; 
+		wake_waiter(lock, clock); 
+		return 0; 
+	}
+	return -1; 
 }
 
-int det_unlock_and_incr_clock(det_mutex_t *mutex, int64_t incr)
+/**
+ * take the item at the head; a blocked putter moves its item in. 
+ */
+static void *queue_take(det_queue_t *q, int64_t clock)
 {
-	int ret = 0; 
-	int lret; 
+	det_mutex_t *lock; 
+	void *item = q->buf[q->head]; 
+
+	q->head = (q->head + 1) % q->size; 
+	q->count--; 
+	if ( !IsEmptyQ(&q->putters.queue) ) { 
+		lock = (det_mutex_t *)GetHeadQ(&q->putters.queue); 
+		q->buf[q->tail] = q->handoff[lock->id]; 
+		q->tail = (q->tail + 1) % q->size; 
+		q->count++; 
+		queue_wake(q, &q->putters, NULL, clock); 
+	}
+	return item; 
+}
 
-	assert(mutex->id > 0 ); 
+/**
+ * one turn for as many items as there are getters or room for. the rest 
+ * waits for room, a turn each time it is woken. returns the number of 
+ * items put, which is less than n only when the queue is closed. 
+ */
+int det_queue_put_batch(det_queue_t *q, void **items, int n)
+{
+	int64_t clock; 
+	int lret, det; 
+	int i = 0; 
 
-	// if det is disabled simply same as pthread. 
-	if ( !det_is_enabled() ) 
-		return pthread_mutex_unlock(&mutex->mutex);
+	if ( check_domain(q->domain, "queue", q->id) ) 
+		return 0; 
 
-	// must be initialized first. 
-	assert( max_thr > 0 ); 
+	mode_check(); 
 
-	// disable count 	
 	lret = disable_logical_clock(); 
+	while ( i < n ) { 
+		if ( (det = det_is_enabled()) ) 
+			wait_for_turn(q->domain); 
+		clock = get_logical_clock(myid); 
+
+		pthread_mutex_lock(&q->mutex); 
+		if ( q->closed ) { 
+			pthread_mutex_unlock(&q->mutex); 
+			break; 
+		}
+		for ( ; i < n; i++ ) { 
+			if ( queue_wake(q, &q->getters, items[i], clock) == 0 ) { 
+				// the queue is empty; straight to the first getter 
+			} else if ( q->count < q->size ) { 
+				q->buf[q->tail] = items[i]; 
+				q->tail = (q->tail + 1) % q->size; 
+				q->count++; 
+			} else { 
+				break; // full 
+			}
+		}
+		grp->last_sync_logical_time = GET_CLOCK(myid); 
+		if ( i == n ) { 
+			pthread_mutex_unlock(&q->mutex); 
+			wa[myid].sw_clock++; 
+			break; 
+		}
 
-#if USE_MUTEX_RECURSIVE 
-	// clean up 
-	mutex->ref--; 
-	if ( mutex->ref > 0 ) { 
-		goto out; 
+		TRACE(DET_TRACE_QUEUE_PUT_BLOCK, q->id, 0); 
+		if ( queue_block(q, &q->putters, items[i], det) == &queue_closed ) 
+			break; 
+		i++; // a getter has moved it in 
 	}
-	mutex->owner = -1; 
-#endif 
-
-	mutex->released_logical_time = get_logical_clock(myid) ;  
-	DBG(1, "rel(%d)\n", mutex->id); 
-
-	// update last sync logical time 
-	last_sync_logical_time = GET_CLOCK(myid); 
-
-	ret = pthread_mutex_unlock(&mutex->mutex); 
-out: 
-	// other thread's wait_for_turn immediately progress. 
-	// So I have to be sure I don't hold this lock anymore before increment this. 
-	wa[myid].sw_clock += incr;
+	TRACE(DET_TRACE_QUEUE_PUT, q->id, i); 
 
-	// resume logical clock 
 	if ( lret == 0 ) enable_logical_clock(); 
-
-	return ret; 
+	return i; 
 }
 
-int det_unlock(det_mutex_t *mutex)
+/**
+ * one turn for up to n items; waits only while the queue is empty. returns 
+ * the number of items got, 0 when the queue is closed and empty. 
+ */
+int det_queue_get_batch(det_queue_t *q, void **items, int n)
 {
-	return det_unlock_and_incr_clock(mutex, 1); 
-}
-
+	int64_t clock; 
+	int lret, det; 
+	int i = 0; 
+	void *item; 
 
-int  det_cond_init(det_cond_t *cond)
-{
-	int lret; 
-	int i; 
+	if ( n <= 0 || check_domain(q->domain, "queue", q->id) ) 
+		return 0; 
 
-	// if not initialized, initialize. 
-	if ( max_thr == 0 ) det_init(0, NULL);
+	mode_check(); 
 
 	lret = disable_logical_clock(); 
-	
-	InitQ(&cond->queue, MAX_THR); 
+	if ( (det = det_is_enabled()) ) 
+		wait_for_turn(q->domain); 
+	clock = get_logical_clock(myid); 
 
-	for ( i = 0; i < MAX_THR; i++ ) { 
-		cond->waiter[i].id = i; 
-		pthread_mutex_init(&cond->waiter[i].mutex, NULL); 
-		pthread_mutex_lock(&cond->waiter[i].mutex); 
-	}
+	pthread_mutex_lock(&q->mutex); 
+	for ( ; i < n && q->count > 0; i++ ) 
+		items[i] = queue_take(q, clock); 
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
 
-	pthread_mutex_lock(&count_mutex); 
-	cond->id = ++g_cond_count; 
-	pthread_mutex_unlock(&count_mutex); 
+	if ( i > 0 || q->closed ) { 
+		pthread_mutex_unlock(&q->mutex); 
+		wa[myid].sw_clock++; 
+	} else { 
+		TRACE(DET_TRACE_QUEUE_GET_BLOCK, q->id, 0); 
+		if ( (item = queue_block(q, &q->getters, NULL, det)) != &queue_closed ) 
+			items[i++] = item; 
+	}
+	TRACE(DET_TRACE_QUEUE_GET, q->id, i); 
 
-	DBG(1, "cond_init(%d)\n", cond->id); 
 	if ( lret == 0 ) enable_logical_clock(); 
-	return 0; 
+	return i; 
+}
+
+int det_queue_put(det_queue_t *q, void *item)
+{
+	return det_queue_put_batch(q, &item, 1) == 1 ? 0 : EPIPE; 
+}
+
+int det_queue_get(det_queue_t *q, void **item)
+{
+	return det_queue_get_batch(q, item, 1) == 1 ? 0 : EPIPE; 
 }
 
 /**
- */ 
-int  det_cond_wait(det_cond_t *cond, det_mutex_t *mutex)
+ * items in the queue can still be got. blocked threads are woken empty 
+ * handed. 
+ */
+int det_queue_close(det_queue_t *q)
 {
-	int lret = disable_logical_clock(); 
-	det_mutex_t *lock;
-	DBG(1, "cond(%d) wait enter\n", cond->id); 
+	int64_t clock; 
+	int lret; 
 
-	// add to waiting list. mutex is still held. 
-	lock = &cond->waiter[myid]; 
-	AddQ(&cond->queue, (void *)lock);
+	if ( check_domain(q->domain, "queue", q->id) ) 
+		return EPERM; 
 
-	// release condition lock & quit 
-	det_unlock_and_incr_clock(mutex, MAX_LOGICAL_CLOCK); 
+	mode_check(); 
 
-	// waiter->P()
-	pthread_mutex_lock(&lock->mutex);  
+	lret = disable_logical_clock(); 
+	if ( det_is_enabled() ) 
+		wait_for_turn(q->domain); 
+	clock = get_logical_clock(myid); 
 
-	// signaler must set this already. 
-	assert(GET_CLOCK(myid) < MAX_LOGICAL_CLOCK); 
+	pthread_mutex_lock(&q->mutex); 
+	q->closed = 1; 
+	while ( queue_wake(q, &q->getters, &queue_closed, clock) == 0 ) 
+		; 
+	while ( queue_wake(q, &q->putters, &queue_closed, clock) == 0 ) 
+		; 
+	pthread_mutex_unlock(&q->mutex); 
+	TRACE(DET_TRACE_QUEUE_CLOSE, q->id, 0); 
 
-	DBG(1, "cond(%d) wait leave\n", cond->id); 
-	
-	if ( lret == 0 ) enable_logical_clock();
-	
-	// acquite the lock 
-	det_lock(mutex); 
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
+	wa[myid].sw_clock++; 
+	if ( lret == 0 ) enable_logical_clock(); 
+	return 0; 
+}
 
-	return 0;
+static void select_leave(det_chan_t **chans, int n, det_mutex_t *lock)
+{
+	int i; 
+
+	for ( i = 0; i < n; i++ ) { 
+		pthread_mutex_lock(&chans[i]->mutex); 
+		DelItemQ(&chans[i]->getters.queue, (void *)lock); 
+		pthread_mutex_unlock(&chans[i]->mutex); 
+	}
 }
 
-int  det_cond_signal(det_cond_t *cond)
-{ 
-	int64_t clock; 
+/**
+ * one turn to take from the first channel with an item. if none has, the 
+ * caller parks on the getters queue of each open channel and the first put 
+ * in turn order hands it its item. 
+ */
+int det_chan_select(det_chan_t **chans, int n, void **item)
+{
 	det_mutex_t *lock; 
+	det_queue_t *q; 
+	int64_t clock; 
+	int lret, det, domain; 
+	int i, open, ready; 
+
+	if ( n <= 0 ) 
+		return -1; 
+
+	// the turn is taken in the domain of the channels, global if mixed. 
+	domain = chans[0]->domain; 
+	for ( i = 0; i < n; i++ ) { 
+		if ( check_domain(chans[i]->domain, "select", chans[i]->id) ) 
+			return -1; 
+		if ( chans[i]->domain != domain ) 
+			domain = DET_DOMAIN_GLOBAL; 
+	}
+	// queued on every channel, blocked on this one 
+	lock = &chans[0]->getters.waiter[myid]; 
 
-	int lret = disable_logical_clock(); 
-
-	clock = get_logical_clock(myid); 
-	assert( clock < MAX_LOGICAL_CLOCK ); // FIXME: sometimes it aborts. 
+	mode_check(); 
 
-	/* condition lock is already held */ 
+	lret = disable_logical_clock(); 
+	while ( 1 ) { 
+		if ( (det = det_is_enabled()) ) 
+			wait_for_turn(domain); 
+		clock = get_logical_clock(myid); 
+
+		for ( i = 0, open = 0; i < n; i++ ) { 
+			q = chans[i]; 
+			pthread_mutex_lock(&q->mutex); 
+			if ( q->count > 0 ) { 
+				*item = queue_take(q, clock); 
+				pthread_mutex_unlock(&q->mutex); 
+				break; 
+			}
+			open += !q->closed; 
+			pthread_mutex_unlock(&q->mutex); 
+		}
+		grp->last_sync_logical_time = GET_CLOCK(myid); 
+		if ( i < n || open == 0 ) { 
+			wa[myid].sw_clock++; 
+			break; 
+		}
 
-	if ( !IsEmptyQ(&cond->queue) ) { 
-		lock = (det_mutex_t*)DelQ(&cond->queue); 
-		SET_CLOCK(lock->id, clock); 
-		pthread_mutex_unlock(&lock->mutex); 
-		DBG(1, "cond(%d) signal to %d\n", cond->id, lock - &cond->waiter[0]); 
-	}
+		TRACE(DET_TRACE_SELECT_BLOCK, chans[0]->id, 0); 
+		wa[myid].select_state = 1; 
+		wa[myid].parked = 1; 
+		for ( i = 0; i < n; i++ ) { 
+			q = chans[i]; 
+			pthread_mutex_lock(&q->mutex); 
+			if ( !q->closed ) 
+				AddQ(&q->getters.queue, (void *)lock); 
+			pthread_mutex_unlock(&q->mutex); 
+		}
 
-	// increase logical clock 
-	wa[myid].sw_clock ++; 
+		// without turns, a put may have come in before the last AddQ. 
+		for ( i = 0, ready = 0; i < n && !ready; i++ ) { 
+			pthread_mutex_lock(&chans[i]->mutex); 
+			ready = chans[i]->count > 0; 
+			pthread_mutex_unlock(&chans[i]->mutex); 
+		}
+		if ( ready && 
+		     __sync_bool_compare_and_swap(&wa[myid].select_state, 1, 2) ) { 
+			wa[myid].parked = 0; 
+			wa[myid].select_state = 0; 
+			select_leave(chans, n, lock); 
+			continue; 
+		}
 
-	if ( lret == 0 ) enable_logical_clock(); 
-	return 0; 
-}
+		if ( det ) { 
+			wa[myid].sw_clock += MAX_LOGICAL_CLOCK; 
+			timed_kick(); 
+		}
+		__sync_bool_compare_and_swap(&wa[myid].parked, 1, 3); // unless woken 
 
-int  det_cond_broadcast(det_cond_t *cond) 
-{
-	int lret = disable_logical_clock(); 	
+		pthread_mutex_lock(&lock->mutex); 
+		time_woken(); 
 
-	while ( !IsEmptyQ(&cond->queue) ) { 
-		det_cond_signal(cond); 
+		// waker must set this already. 
+		assert(GET_CLOCK(myid) < MAX_LOGICAL_CLOCK); 
+		select_leave(chans, n, lock); 
+		wa[myid].select_state = 0; 
+		q = wa[myid].select_queue; 
+		if ( q->handoff[myid] != &queue_closed ) { 
+			*item = q->handoff[myid]; 
+			for ( i = 0; chans[i] != q; i++ ) 
+				; 
+			break; 
+		}
+		// a channel is closed. look again. 
 	}
+	TRACE(DET_TRACE_SELECT, chans[0]->id, i < n ? i : -1); 
 
 	if ( lret == 0 ) enable_logical_clock(); 
-	return 0; 
+	return i < n ? i : -1; 
 }
 
-int det_barrier_init(det_barrier_t *barrier, int count)
+///////////////////////////////////////////////////////////////////////////////////
+// promise 
+///////////////////////////////////////////////////////////////////////////////////
+
+int det_promise_init(det_promise_t *p)
 {
 	// if not initialized, initialize. 
-	if ( max_thr == 0 ) det_init(0, NULL);
+	if ( grp->max_thr == 0 ) det_init(0, NULL);
 
-	barrier->target_count = count; 
-	barrier->wait_count   = 0; 
+	p->ready = 0; 
+	p->value = NULL; 
 
-	pthread_mutex_lock(&count_mutex); 
-	barrier->id = ++g_barr_count; 
-	pthread_mutex_unlock(&count_mutex); 
+	pthread_mutex_lock(&grp->count_mutex); 
+	p->id = ++grp->g_promise_count; 
+	pthread_mutex_unlock(&grp->count_mutex); 
+	p->domain = wa[myid].domain; 
 
-	det_lock_init(&barrier->wait_mutex); 
-	det_cond_init(&barrier->wait_cond); 
+	sync_mutex_init(&p->mutex, 0); 
+	cond_init(&p->wait, p->domain, 0); 
 
-	DBG(1, "lock %d is for barrier\n", g_lock_count); 
-	DBG(1, "cond %d is for barrier\n", g_cond_count); 
+	TRACE(DET_TRACE_PROMISE_INIT, p->id, 0); 
 	return 0; 
 }
 
-int det_barrier_wait(det_barrier_t *barrier)
+/**
+ * the getters blocked so far resume at the clock of this turn. 
+ */
+int det_promise_set(det_promise_t *p, void *value)
 {
-	int ret = 0; 
-
-	// disable counting
-	int lret = disable_logical_clock(); 
+	det_mutex_t *lock; 
+	int64_t clock; 
+	int lret, ret = 0; 
 
-	DBG(1, "barrier(%d) enter\n", barrier->id); 
+	if ( check_domain(p->domain, "promise", p->id) ) 
+		return EPERM; 
 
-	det_lock(&barrier->wait_mutex); 
+	mode_check(); 
 
-	// must be initialized before (barrier init)
-	assert( max_thr > 0 );
+	lret = disable_logical_clock(); 
+	if ( det_is_enabled() ) 
+		wait_for_turn(p->domain); 
+	clock = get_logical_clock(myid); 
 
-	barrier->wait_count ++; 
-	if ( barrier->wait_count == barrier->target_count ) {
-		barrier->wait_count = 0; 
-		det_cond_broadcast(&barrier->wait_cond); 
+	pthread_mutex_lock(&p->mutex); 
+	if ( p->ready ) { 
+		ret = EBUSY; 
 	} else { 
-		det_cond_wait(&barrier->wait_cond, &barrier->wait_mutex); 
+		p->value = value; 
+		p->ready = 1; 
+		while ( !IsEmptyQ(&p->wait.queue) ) { 
+			lock = (det_mutex_t *)DelQ(&p->wait.queue); 
+			wake_waiter(lock, clock); 
+		}
 	}
-	det_unlock(&barrier->wait_mutex); 
-
-	DBG(1, "barrier(%d) leave\n\n", barrier->id); 
-	// enable counting 
+	pthread_mutex_unlock(&p->mutex); 
+	TRACE(DET_TRACE_PROMISE_SET, p->id, ret); 
 
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
+	wa[myid].sw_clock++; 
 	if ( lret == 0 ) enable_logical_clock(); 
-
-	barrier_count ++; 
 	return ret; 
 }
 
+int det_future_get(det_promise_t *p, void **value)
+{
+	det_mutex_t *lock = &p->wait.waiter[myid]; 
+	int lret, det; 
+
+	if ( check_domain(p->domain, "future", p->id) ) 
+		return EPERM; 
+
+	mode_check(); 
+
+	lret = disable_logical_clock(); 
+	if ( (det = det_is_enabled()) ) 
+		wait_for_turn(p->domain); 
+
+	pthread_mutex_lock(&p->mutex); 
+	grp->last_sync_logical_time = GET_CLOCK(myid); 
+	if ( p->ready ) { 
+		pthread_mutex_unlock(&p->mutex); 
+		wa[myid].sw_clock++; 
+	} else { 
+		TRACE(DET_TRACE_FUTURE_BLOCK, p->id, 0); 
+		AddQ(&p->wait.queue, (void *)lock); 
+		wa[myid].parked = 1; 
+		pthread_mutex_unlock(&p->mutex); 
+
+		if ( det ) { 
+			wa[myid].sw_clock += MAX_LOGICAL_CLOCK; 
+			timed_kick(); 
+		}
+		__sync_bool_compare_and_swap(&wa[myid].parked, 1, 3); // unless woken 
+
+		pthread_mutex_lock(&lock->mutex); 
+		time_woken(); 
+
+		// waker must set this already. 
+		assert(GET_CLOCK(myid) < MAX_LOGICAL_CLOCK); 
+	}
+	*value = p->value; 
+
+	if ( lret == 0 ) enable_logical_clock(); 
+	return 0; 
+}
+
 int det_create( pthread_t *thread, const pthread_attr_t *attr,
 		void *(*start_routine)(void*), void *arg)
+{
+	return det_create_domain(thread, attr, start_routine, arg, wa[myid].domain); 
+}
+
+int det_create_domain(pthread_t *thread, const pthread_attr_t *attr,
+		      void *(*start_routine)(void*), void *arg, int domain)
 {
 	int id; 
 	int ret; 
 	int lret; 
 
 	// if not initialized, initialize. 
-	if ( max_thr == 0 ) 
+	if ( grp->max_thr == 0 ) 
 		det_init(0, NULL);
 
-	if ( num_thr <= 1 ) {
+	mode_check(); 
+
+	if ( grp->num_thr <= 1 ) {
 		// physically enable performance counter 
 		enable_logical_clock(); 
 #if USE_FAKE_DISABLE 
@@ -1063,14 +5119,20 @@ int det_create( pthread_t *thread, const pthread_attr_t *attr,
 	// disable count 	
 	lret = disable_logical_clock(); 
 
-	DBG(1, "create thread %d from a child thread %d\n", max_thr, myid); 
+	DBG(1, "create thread %d from a child thread %d\n", grp->max_thr, myid); 
+
+	assert( domain >= 0 ); // DET_DOMAIN_GLOBAL is for objects only 
 
-	wait_for_turn(); 
+	// thread ids are allocated across domains (and processes of the group). 
+	wait_for_turn(DET_DOMAIN_GLOBAL); 
 
-	id = max_thr; 
+	id = grp->max_thr; 
+	wa[id].domain = domain; 
+	wa[id].pid = my_pid; 
+	__sync_synchronize(); 
 
-	max_thr ++; 
-	num_thr ++; 
+	grp->max_thr ++; 
+	__sync_fetch_and_add(&grp->num_thr, 1); 
 
 	wa[id].id   = id; 
 	wa[id].func = start_routine; 
@@ -1082,25 +5144,30 @@ int det_create( pthread_t *thread, const pthread_attr_t *attr,
 	wa[id].finished = 0; 
 	wa[id].started = 0; 
 
-	det_lock_init(&wa[id].thread_lock); 
-	det_cond_init(&wa[id].thread_cond); 
+	// creator/joiner and the thread can be in different domains 
+	lock_init(&wa[id].thread_lock, DET_DOMAIN_GLOBAL, grp->shm_size > 0); 
+	cond_init(&wa[id].thread_cond, DET_DOMAIN_GLOBAL, grp->shm_size > 0); 
 
 	wa[id].nondet_count = 0; 
 
-	DBG(1, "lock %d is thread %d internal\n", g_lock_count, id); 
-	DBG(1, "cond %d is thread %d internal\n", g_cond_count, id); 
+	DBG(1, "lock %d is thread %d internal\n", grp->g_lock_count, id); 
+	DBG(1, "cond %d is thread %d internal\n", grp->g_cond_count, id); 
 
 	DBG(2, "Thread %d initial clock = %ld, hw = %d\n", 
 	    id, wa[id].sw_clock, wa[id].hw_clock); 
 
-	if ( debug_log_file ) {
-		char name[40]; 
-		sprintf(name, "%s.p%d", debug_log_file, id); 
-		wa[id].log_file = fopen(name, "w+"); 
-	} else {
-		wa[id].log_file = stderr; 
-	}
-
+	log_open(&wa[id]); 
+
+#if USE_CHECKPOINT
+	if ( ckpt_interval > 0 ) { 
+		// glibc recycles the stacks of threads lost by fork(). resumed 
+		// threads run on these stacks, so the runtime allocates them. 
+		pthread_attr_t ckpt_attr; 
+		ckpt_stack_attr(&wa[id], &ckpt_attr, attr); 
+		ret = pthread_create(thread, &ckpt_attr, worker_thread, &wa[id]); 
+		pthread_attr_destroy(&ckpt_attr); 
+	} else 
+#endif 
 	ret = pthread_create(thread, attr, worker_thread, &wa[id]); 
 
 	// pthread_t 
@@ -1122,9 +5189,12 @@ int det_join ( pthread_t threadid, void **thread_return )
 	int ret; 
 	int i; 
 	struct worker_args *w = NULL; 
+	int lret; 
+
+	mode_check(); 
 
 	// disable count       
-	int lret = disable_logical_clock();
+	lret = disable_logical_clock();
 
 	// somewhat ugly. but doesn't matter. 
 	for ( i = 0; i < MAX_THR; i++ ) { 
@@ -1133,7 +5203,7 @@ int det_join ( pthread_t threadid, void **thread_return )
 	}
 	assert( i < MAX_THR ); 
 
-	DBG(1, "JOIN(%d):enter \n", i); 
+	TRACE(DET_TRACE_JOIN_ENTER, i, 0); 
 
 	det_lock(&w->thread_lock); 
 	if ( !w->finished ) {
@@ -1141,16 +5211,218 @@ int det_join ( pthread_t threadid, void **thread_return )
 	}
 	det_unlock(&w->thread_lock); 
 	
+#if USE_CHECKPOINT
+	if ( w->ckpt_orphan ) // exited before the checkpoint 
+		ret = 0; 
+	else if ( w->ckpt_resumed ) 
+		ret = pthread_join( w->ckpt_tid, thread_return); 
+	else 
+#endif 
 	ret = pthread_join( threadid, thread_return); 
 
-	DBG(1, "JOIN(%d):exit \n", i);
+#if USE_CHECKPOINT
+	if ( w->ckpt_stack ) { 
+		munmap(w->ckpt_stack, w->ckpt_stack_size); 
+		w->ckpt_stack = NULL; 
+	}
+#endif 
+	TRACE(DET_TRACE_JOIN, i, 0);
 
-	num_thr --; 
+	__sync_fetch_and_sub(&grp->num_thr, 1); 
 
 	if ( lret == 0 ) enable_logical_clock(); 
 
-	if ( num_thr <= 1 ) {
+	if ( grp->num_thr <= 1 ) {
+		// physically enable performance counter 
+		disable_logical_clock(); 
+#if USE_FAKE_DISABLE 
+		disable_performance_counter();
+#endif 
+	}
+
+	return ret; 
+}
+
+/**
+ * a process of the group leaves at exit(). its clock must not hold back 
+ * the others, and det_waitpid() of the parent is signaled. 
+ */ 
+static void group_exit(void)
+{
+	struct worker_args *w = &wa[myid]; 
+
+	if ( w->pid != getpid() ) return; // not the thread that joined 
+
+	if ( w->thread_lock.id > 0 ) { 
+		// det_fork()ed 
+		det_lock(&w->thread_lock); 
+		w->finished = 1; 
+		det_cond_signal(&w->thread_cond); 
+		det_unlock_and_incr_clock(&w->thread_lock, MAX_LOGICAL_CLOCK); 
+	} else { 
+		disable_logical_clock(); 
+		SET_CLOCK(myid, MAX_LOGICAL_CLOCK); 
+		timed_kick(); 
+	}
+	disable_logical_clock(); 
+
+	DBG(1, "GROUP: process %d leaves\n", w->pid); 
+
+	if ( grp->shm_leader == w->pid ) { 
+		if ( strchr(shm_name + 1, '/') ) 
+			unlink(shm_name); 
+		else 
+			shm_unlink(shm_name); 
+	}
+}
+
+/**
+ * fork() a process that joins the deterministic group of the caller. 
+ * its main thread takes a new thread id as if det_create()d. 
+ */ 
+pid_t det_fork(void)
+{
+	int id, i; 
+	int parent = myid; 
+	pid_t pid; 
+	int lret; 
+
+	// if not initialized, initialize. 
+	if ( grp->max_thr == 0 ) 
+		det_init(0, NULL);
+
+	if ( grp->shm_size == 0 ) { 
+		// the child would wait for threads it doesn't have. 
+		errno = ENOTSUP; 
+		return -1; 
+	}
+
+	mode_check(); 
+
+	if ( grp->num_thr <= 1 ) {
 		// physically enable performance counter 
+		enable_logical_clock(); 
+#if USE_FAKE_DISABLE 
+		enable_performance_counter();
+#endif 
+	}
+
+	lret = disable_logical_clock(); 
+
+	wait_for_turn(DET_DOMAIN_GLOBAL); 
+
+	id = grp->max_thr; 
+	wa[id].domain = wa[myid].domain; 
+	wa[id].pid = 0; // not readable until the child opens its counter 
+	wa[id].fds = NULL; 
+	wa[id].hw_clock_enabled = 0; 
+	__sync_synchronize(); 
+
+	grp->max_thr ++; 
+	__sync_fetch_and_add(&grp->num_thr, 1); 
+
+	wa[id].id   = id; 
+	wa[id].func = NULL; 
+	wa[id].arg  = NULL; 
+	wa[id].sw_clock = get_logical_clock(myid) + 1; // assign initial 
+	wa[id].hw_clock = 0; 
+	wa[id].last_exit_logical_time = 0; 
+	wa[id].finished = 0; 
+	wa[id].started = 1; 
+	wa[id].nondet_count = 0; 
+
+	// the parent det_waitpid()s on these from another process 
+	lock_init(&wa[id].thread_lock, DET_DOMAIN_GLOBAL, 1); 
+	cond_init(&wa[id].thread_cond, DET_DOMAIN_GLOBAL, 1); 
+
+	DBG(1, "FORK: thread %d\n", id); 
+
+	fflush(NULL); 
+	pid = fork(); 
+	if ( pid < 0 ) { 
+		// nobody will run as the thread. 
+		wa[id].finished = 1; 
+		SET_CLOCK(id, MAX_LOGICAL_CLOCK); 
+		if ( lret == 0 ) enable_logical_clock(); 
+		return -1; 
+	}
+
+	if ( pid == 0 ) { 
+		// the counter of the parent thread was inherited. 
+		for ( i = 0; i < wa[parent].nevts; i++ ) 
+			close(wa[parent].fds[i].fd); 
+
+		myid = id; 
+		my_pid = getpid(); 
+		lock_count = barrier_count = 0; 
+
+		wa[id].tid = pthread_self(); 
+		wa[id].pid = my_pid; 
+
+		log_open(&wa[id]); 
+		if ( top_prefix ) 
+			top_open(); // top_close() is inherited 
+
+		open_pfm_counter(&wa[id]); // group_exit() is inherited 
+
+		DBG(1, "FORK: process %d is thread %d\n", my_pid, id); 
+
+		enable_logical_clock(); 
+		enable_performance_counter(); 
+		return 0; 
+	}
+
+	wa[id].pid = pid; // also set by the child. for det_waitpid() 
+	DBG(1, "FORK(%d): pid %d\n", id, pid); 
+
+	// increase logical clock 
+	wa[myid].sw_clock ++; 
+
+	if ( lret == 0 ) enable_logical_clock(); 
+	return pid; 
+}
+
+/**
+ * wait for a det_fork()ed process in logical time. 
+ */ 
+pid_t det_waitpid(pid_t pid, int *status)
+{
+	int i; 
+	pid_t ret; 
+	struct worker_args *w = NULL; 
+	int lret; 
+
+	for ( i = 0; i < grp->max_thr; i++ ) { 
+		if ( wa[i].pid == pid && wa[i].thread_lock.id > 0 ) { 
+			w = &wa[i]; 
+			break; 
+		}
+	}
+	if ( !w ) 
+		return waitpid(pid, status, 0); 
+
+	mode_check(); 
+
+	lret = disable_logical_clock(); 
+
+	TRACE(DET_TRACE_WAITPID_ENTER, i, 0); 
+
+	det_lock(&w->thread_lock); 
+	if ( !w->finished ) {
+		det_cond_wait(&w->thread_cond, &w->thread_lock); 
+	}
+	det_unlock(&w->thread_lock); 
+
+	ret = waitpid(pid, status, 0); 
+	w->pid = 0; // pid can be reused 
+
+	TRACE(DET_TRACE_WAITPID, i, 0); 
+
+	__sync_fetch_and_sub(&grp->num_thr, 1); 
+
+	if ( lret == 0 ) enable_logical_clock(); 
+
+	if ( grp->num_thr <= 1 ) {
 		disable_logical_clock(); 
 #if USE_FAKE_DISABLE 
 		disable_performance_counter();
@@ -1174,6 +5446,8 @@ void det_exit(void *value_ptr)
 	sw_clock = wa[myid].sw_clock; 
 
 	det_unlock_and_incr_clock(&w->thread_lock, MAX_LOGICAL_CLOCK); 
+	if ( top ) 
+		top->thread[myid].state = DET_TOP_EXITED; 
 
 	/* disable event */ 
 	disable_logical_clock(); 
@@ -1186,6 +5460,13 @@ void det_exit(void *value_ptr)
 	    lock_count, 
 	    barrier_count); 	
 
+#if USE_CHECKPOINT
+	if ( w->ckpt_resumed ) { 
+		// running on the stack of the thread in the original process. 
+		w->ckpt_retval = value_ptr; 
+		longjmp(w->ckpt_exit_jmp, 1); 
+	}
+#endif 
 	pthread_exit(value_ptr);
 }
 
@@ -1212,6 +5493,7 @@ int det_cancel(pthread_t threadid)
 	lret = disable_logical_clock(); 	
 
 	SET_CLOCK(i, MAX_LOGICAL_CLOCK * 2); 
+	timed_kick(); 
 	DBG(1, "EXIT: Thread %d: (hw_evt:%lld, sw_evt:%lld) ndet_evt:%d\n", 
 	    w->id, 
 	    w->hw_clock, w->sw_clock, w->nondet_count); 
@@ -1222,7 +5504,7 @@ int det_cancel(pthread_t threadid)
 
 void  det_enable(void)
 {
-	assert(max_thr > 0 ); // must be initialized first. 
+	assert(grp->max_thr > 0 ); // must be initialized first. 
 	assert(!my_det_enabled); // must be disabled 
 	DBG(1, "%s: \n", __FUNCTION__); 
 
@@ -1234,36 +5516,70 @@ void  det_enable(void)
 void  det_disable(void)
 {
 	// if not initialized, initialize. 
-	if ( max_thr == 0 ) det_init(0, NULL);
+	if ( grp->max_thr == 0 ) det_init(0, NULL);
 
 	assert(my_det_enabled); // must be enabled 
 	disable_logical_clock();
 	my_det_clock = get_logical_clock(myid); 
 	SET_CLOCK(myid, MAX_LOGICAL_CLOCK); // quit if somebody is waiting. 
+	timed_kick(); 
 	my_det_enabled = 0; 
 	DBG(1, "%s: \n", __FUNCTION__); 
 }
 
 int  det_is_enabled(void)
 {
-	if ( num_thr <= 1 ) 
+	if ( grp->num_thr <= 1 || grp->mode == DET_MODE_NATIVE ) 
 		return 0; 
 	else 
 		return my_det_enabled; 
 }
 
+/**
+ * switch all the threads (of the group) between DET_MODE_DET and 
+ * DET_MODE_NATIVE. returns when every thread has reached the switch. 
+ */ 
+int  det_set_mode(int mode)
+{
+	int cur; 
+
+	// if not initialized, initialize. 
+	if ( grp->max_thr == 0 ) det_init(0, NULL);
+
+	if ( mode != DET_MODE_DET && mode != DET_MODE_NATIVE ) 
+		return EINVAL; 
+	if ( !my_det_enabled ) 
+		return EPERM; // can't take part in the switch 
+
+	while ( (cur = grp->mode) != mode ) { 
+		__sync_bool_compare_and_swap(&grp->mode_request, cur, mode); 
+		mode_check(); 
+	}
+	return 0; 
+}
+
+int  det_get_mode(void)
+{
+	return grp->mode; 
+}
+
 int  det_get_pid(void)
 {
 	return myid; 
 }
 
+int  det_get_domain(void)
+{
+	return wa[myid].domain; 
+}
+
 int64_t det_get_clock() 
 {
 	int64_t ret; 
 	int lret; 
 
 	// if not initialized, initialize. 
-	if ( max_thr == 0 ) det_init(0, NULL);
+	if ( grp->max_thr == 0 ) det_init(0, NULL);
 
 	lret = disable_logical_clock(); 
 
@@ -1280,7 +5596,7 @@ int det_sigmask(int how, const sigset_t * set,
 	int lret; 
 
 	// if not initialized, initialize. 
-	if ( max_thr == 0 ) det_init(0, NULL);
+	if ( grp->max_thr == 0 ) det_init(0, NULL);
 
 	lret = disable_logical_clock(); 
 
@@ -1302,7 +5618,7 @@ int det_dbg(const char *format, ...)
 	int lret; 
 
 	// if not initialized, initialize. 
-	if ( max_thr == 0 ) det_init(0, NULL);
+	if ( grp->max_thr == 0 ) det_init(0, NULL);
 
 	// disable count       
 	lret = disable_logical_clock();
@@ -1342,25 +5658,22 @@ void det_print_stat()
 	    wa[myid].hw_clock, wa[myid].sw_clock, wa[myid].nondet_count, 
 	    lock_count, 
 	    barrier_count); 	
-
-#if USE_TIMING 
-	DBG(0, "Thread %d : wait_turn: min(%lld),max(%lld),tot(%lld),cnt(%lld),avg(%lld)\n", 
-	    myid, 
-	    perf_wait_turn.min, perf_wait_turn.max, perf_wait_turn.tot, 
-	    perf_wait_turn.cnt, 
-	    (perf_wait_turn.cnt >0 ) ? perf_wait_turn.tot / perf_wait_turn.cnt : 0);
-
-	DBG(0, "Thread %d : enable: min(%lld),max(%lld),tot(%lld),cnt(%lld),avg(%lld)\n", 
-	    myid, 
-	    perf_enable.min, perf_enable.max, perf_enable.tot, 
-	    perf_enable.cnt, 
-	    (perf_enable.cnt >0 ) ? perf_enable.tot / perf_enable.cnt : 0);
-	DBG(0, "Thread %d : disable: min(%lld),max(%lld),tot(%lld),cnt(%lld),avg(%lld)\n", 
-	    myid, 
-	    perf_disable.min, perf_disable.max, perf_disable.tot, 
-	    perf_disable.cnt, 
-	    (perf_disable.cnt >0 ) ? perf_disable.tot / perf_disable.cnt : 0);
-#endif 
+	DBG(0, "STAT: fingerprint %016llx, order %016llx, %lld events\n", 
+	    wa[myid].fingerprint, wa[myid].fingerprint_order, 
+	    wa[myid].fingerprint_events); 
+
+	if ( use_timing ) { 
+		int k; 
+		for ( k = 0; k < TIME_NR_PHASES; k++ ) { 
+			struct time_hist *h = &time_hists[myid][k]; 
+			if ( h->cnt == 0 ) 
+				continue; 
+			DBG(0, "TIME: %s count %lld avg %.1f max %.1f ns\n", 
+			    time_phase[k], h->cnt, 
+			    h->tot * 1000.0 / tsc_per_usec / h->cnt, 
+			    h->max * 1000.0 / tsc_per_usec); 
+		}
+	}
 
 	if ( lret == 0 ) enable_logical_clock(); 
 }
@@ -1372,7 +5685,7 @@ static void self_test()
 	int i,j; 
 	unsigned start, dur; 
 	int64_t clock; 
-	int inner_loops = max_thr; // max_thr 
+	int inner_loops = grp->max_thr; // max_thr 
 	
 	int64_t old, cur, diff;
 
@@ -1398,7 +5711,7 @@ static void self_test()
 	for ( i = 0; i < SELF_TEST_LOOP; i++ ) { 
 		wa[myid].hw_clock = i; 
 		for ( j = 0; j < inner_loops; j++ ) { 
-			clock += wa[(myid + j)%max_thr].hw_clock;
+			clock += wa[(myid + j)%grp->max_thr].hw_clock;
 		}
 	}
 	dur = get_usecs() - start; 
@@ -1409,7 +5722,7 @@ static void self_test()
 	start = get_usecs(); 
 	for ( i = 0; i < SELF_TEST_LOOP; i++ ) { 
 		for ( j = 0; j < inner_loops; j++ ) { 
-			clock += get_logical_clock((myid + j)%max_thr); 
+			clock += get_logical_clock((myid + j)%grp->max_thr); 
 		}
 	}
 	dur = get_usecs() - start; 
@@ -1429,7 +5742,7 @@ static void self_test()
 	start = get_usecs(); 
 	for ( i = 0; i < SELF_TEST_LOOP; i++ ) { 
 		disable_logical_clock(); 
-		wait_for_turn(); 
+		wait_for_turn(DET_DOMAIN_GLOBAL); 
 		enable_logical_clock();
 	}
 
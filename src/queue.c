@@ -22,6 +22,15 @@ void  InitQ( TQueue* queue, int size)
 	queue->array = (void **)malloc(sizeof(void *) * size); 
 }
 
+/* array is owned by the caller (e.g., shared memory) */ 
+void  InitQBuf( TQueue* queue, void **array, int size)
+{
+	queue->head = 0;
+	queue->tail = 0;
+	queue->size = size;
+	queue->array = array; 
+}
+
 void  InitQ2( TQueue* queue, TQueue* src)
 {
 	queue->head = src->head;
@@ -50,6 +59,23 @@ void* DelQ( TQueue* queue )
 	return item;
 }
 
+/* remove an item at any position. 1 - found */ 
+int DelItemQ( TQueue* queue, void* item )
+{
+	int i, next;
+	for ( i = queue->head; i != queue->tail; i = (i + 1) % queue->size )
+		if ( queue->array[i] == item ) 
+			break;
+	if ( i == queue->tail ) // not found
+		return 0;
+	for ( next = (i + 1) % queue->size; next != queue->tail; next = (next + 1) % queue->size ) {
+		queue->array[i] = queue->array[next];
+		i = next;
+	}
+	queue->tail = i;
+	return 1;
+}
+
 void* GetHeadQ( TQueue *queue )
 {
 	void* item;
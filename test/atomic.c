@@ -0,0 +1,114 @@
+/**
+ * Deterministic atomic operations.
+ *
+ * Threads take tickets from a shared counter with __sync_fetch_and_add()
+ * and keep a running maximum with a compare-and-swap loop. dpthread-wrapper.h
+ * maps the builtins to det_atomic_*(), so the tickets each thread gets, and
+ * the checksum, are the same on every run. With -l the counter is updated
+ * under a mutex instead, for comparison (run both with time).
+ *
+ * ex) ./atomic -n 4 -i 10000
+ *     ./atomic -n 4 -i 10000 -l
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <dpthread-wrapper.h>
+
+#define NTHR 16
+
+static pthread_mutex_t lock;
+
+static int max_thr = 4;
+static int iteration = 10000;
+static int use_lock = 0;
+
+static volatile long counter = 0;
+static volatile int32_t maximum = 0;
+static unsigned long checksum[NTHR];
+
+unsigned long fib(unsigned long n)
+{
+	if (n == 0)
+		return 0;
+	if (n == 1)
+		return 2;
+	return fib(n-1)+fib(n-2);
+}
+
+void *worker(void *v)
+{
+	long id = (long)v;
+	long ticket;
+	int32_t old, val;
+	int i;
+
+	for ( i = 0; i < iteration; i++ ) {
+		fib(3 + (id + i) % 5);
+
+		if ( use_lock ) {
+			pthread_mutex_lock(&lock);
+			ticket = counter++;
+			pthread_mutex_unlock(&lock);
+		} else {
+			ticket = __sync_fetch_and_add(&counter, 1);
+		}
+		checksum[id] = checksum[id] * 31 + ticket;
+
+		val = (ticket * 7919) % 100003;
+		do {
+			old = __atomic_load_n(&maximum, __ATOMIC_SEQ_CST);
+		} while ( val > old && !__sync_bool_compare_and_swap(&maximum, old, val) );
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t allthr[NTHR];
+	unsigned long sum = 0;
+	long i;
+	int c;
+
+	while((c=getopt(argc, argv, "n:i:lh")) != EOF) {
+		switch(c) {
+		case 'n':
+			max_thr = atoi(optarg);
+			if (max_thr > NTHR)
+				errx(1, "no more than %d threads", NTHR);
+			break;
+		case 'i':
+			iteration = atoi(optarg);
+			break;
+		case 'l':
+			use_lock = 1;
+			break;
+		default:
+			printf("atomic [-n threads] [-i iteration] [-l]\n");
+			return 0;
+		}
+	}
+
+	pthread_mutex_init(&lock, NULL);
+
+	for ( i = 1; i < max_thr; i++ )
+		pthread_create(&allthr[i], NULL, worker, (void *)i);
+	worker((void *)0);
+	for ( i = 1; i < max_thr; i++ )
+		pthread_join(allthr[i], NULL);
+
+	for ( i = 0; i < max_thr; i++ )
+		sum = sum * 31 + checksum[i];
+	printf("counter : %ld (expected %d), max : %d\n",
+	       counter, max_thr * iteration, maximum);
+	printf("checksum : %lu\n", sum);
+	return 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * Channels and promises.
+ *
+ * Sources wait on a start promise, then send numbered items on a channel
+ * each and close it. A merger det_chan_select()s over all the channels
+ * and sets a done promise to the checksum of what it got from where. The
+ * order in which the merger gets the items, and so the checksum, is the
+ * same on every run.
+ *
+ * ex) ./chan -n 4 -i 10000 -q 4
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <err.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <dpthread-wrapper.h>
+
+#define NTHR 16
+
+static det_chan_t ch[NTHR];
+static det_chan_t *chans[NTHR];
+static det_promise_t start, done;
+
+static int max_thr = 4;
+static int iteration = 10000;
+static int qsize = 4;
+
+static long got[NTHR];
+
+void *source(void *v)
+{
+	long id = (long)v;
+	void *go;
+	long i;
+
+	det_future_get(&start, &go);
+	for ( i = 0; i < iteration; i++ )
+		det_chan_send(&ch[id], (void *)(id * iteration + i + 1));
+	det_chan_close(&ch[id]);
+	return NULL;
+}
+
+void *merger(void *v)
+{
+	int nsrc = (long)v;
+	unsigned long sum = 0;
+	void *item;
+	int k;
+
+	while ( (k = det_chan_select(chans, nsrc, &item)) >= 0 ) {
+		sum = sum * 31 + (k + 1) * (uintptr_t)item;
+		got[k]++;
+	}
+	det_promise_set(&done, (void *)sum);
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t allthr[NTHR];
+	void *checksum;
+	long total = 0;
+	int nsrc, i, c;
+
+	while((c=getopt(argc, argv, "n:i:q:h")) != EOF) {
+		switch(c) {
+		case 'n':
+			max_thr = atoi(optarg);
+			if (max_thr > NTHR || max_thr < 3)
+				errx(1, "3 to %d threads", NTHR);
+			break;
+		case 'i':
+			iteration = atoi(optarg);
+			break;
+		case 'q':
+			qsize = atoi(optarg);
+			break;
+		default:
+			printf("chan [-n threads] [-i items per source] "
+			       "[-q channel size]\n");
+			return 0;
+		}
+	}
+	nsrc = max_thr - 2;
+
+	det_promise_init(&start);
+	det_promise_init(&done);
+	for ( i = 0; i < nsrc; i++ ) {
+		det_chan_init(&ch[i], qsize);
+		chans[i] = &ch[i];
+	}
+
+	// thread 0 starts the sources and waits for the merger's result
+	for ( i = 0; i < nsrc; i++ )
+		pthread_create(&allthr[i], NULL, source, (void *)(long)i);
+	pthread_create(&allthr[nsrc], NULL, merger, (void *)(long)nsrc);
+
+	det_promise_set(&start, NULL);
+	det_future_get(&done, &checksum);
+	if ( det_promise_set(&start, NULL) != EBUSY )
+		printf("start set twice\n");
+
+	for ( i = 0; i <= nsrc; i++ )
+		pthread_join(allthr[i], NULL);
+
+	for ( i = 0; i < nsrc; i++ ) {
+		printf("channel %d : %ld items\n", i, got[i]);
+		total += got[i];
+	}
+	printf("items : %ld (expected %ld)\n", total, (long)nsrc * iteration);
+	printf("checksum : %lu\n", (unsigned long)checksum);
+	return 0;
+}
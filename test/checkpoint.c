@@ -0,0 +1,116 @@
+/**
+ * Checkpoint example. 
+ *
+ * Threads repeatedly compute and meet at a barrier. Run it with 
+ * DPTHREAD_CKPT_INTERVAL set to take checkpoints at the barriers, then 
+ * resume one of them with ckpt-resume.sh. A resumed run must print the same 
+ * checksum as the original run. 
+ *
+ * The order independent total is checked against its closed form, and 
+ * with -e the checksum against the one of the original run. It exits 1 on 
+ * a mismatch. 
+ *
+ * ex) DPTHREAD_CKPT_INTERVAL=1000 DPTHREAD_CKPT_KEEP=1 ./checkpoint -n 4
+ *     ../ckpt-resume.sh ckpt.<pid> 3000 
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */ 
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <dpthread-wrapper.h>
+
+#define NTHR 16
+
+static pthread_mutex_t lock; 
+static pthread_barrier_t barrier; 
+
+static int max_thr = 4; 
+static int iteration = 10; 
+static unsigned long checksum = 0; 
+static unsigned long total = 0; 
+
+unsigned long fib(unsigned long n)
+{
+	if (n == 0)
+		return 0;
+	if (n == 1)
+		return 2;
+	return fib(n-1)+fib(n-2);
+}
+
+void *worker(void *v)
+{
+	long id = (long)v; 
+	int i; 
+
+	for ( i = 0; i < iteration; i++ ) { 
+		unsigned long val = fib(10 + id); 
+
+		pthread_mutex_lock(&lock); 
+		checksum = checksum * 31 + val + id; 
+		total += val * (i + 1) + id; 
+		pthread_mutex_unlock(&lock); 
+
+		pthread_barrier_wait(&barrier); 
+	}
+	return NULL; 
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t allthr[NTHR];
+	unsigned long expect = 0, want = 0; 
+	int check = 0; 
+	long i, j; 
+	int c; 
+
+	while((c=getopt(argc, argv, "n:i:e:h")) != EOF) {
+		switch(c) {
+		case 'n':
+			max_thr = atoi(optarg);
+			if (max_thr > NTHR)
+				errx(1, "no more than %d threads", NTHR);
+			break;
+		case 'i': 
+			iteration = atoi(optarg); 
+			break; 
+		case 'e': 
+			want = strtoul(optarg, NULL, 0); 
+			check = 1; 
+			break; 
+		default:
+			printf("checkpoint [-n threads] [-i iteration] [-e checksum]\n"); 
+			return 0; 
+		}
+	}
+
+	pthread_mutex_init(&lock, NULL); 
+	pthread_barrier_init(&barrier, NULL, max_thr); 
+
+	for ( i = 1; i < max_thr; i++ ) 
+		pthread_create(&allthr[i], NULL, worker, (void *)i); 
+	worker((void *)0); 
+	for ( i = 1; i < max_thr; i++ ) 
+		pthread_join(allthr[i], NULL); 
+
+	for ( i = 0; i < max_thr; i++ ) 
+		for ( j = 0; j < iteration; j++ ) 
+			expect += fib(10 + i) * (j + 1) + i; 
+
+	printf("checksum : %lu (pid %d)\n", checksum, getpid()); 
+	if ( total != expect ) {
+		printf("total %lu != %lu\n", total, expect); 
+		return 1; 
+	}
+	if ( check && checksum != want ) {
+		printf("checksum %lu != %lu\n", checksum, want); 
+		return 1; 
+	}
+	return 0; 
+}
@@ -0,0 +1,125 @@
+/**
+ * Determinism domains. 
+ *
+ * Worker threads increment a shared counter under a lock while a helper 
+ * thread (e.g. a logger or an I/O thread) computes for a long time between 
+ * its own sync operations. With one domain, the helper's low logical clock 
+ * holds back every lock turn of the workers. With -d, the helper is placed 
+ * in its own domain and the two turn orders are independent. The helper 
+ * hands its result to the workers through a DET_DOMAIN_GLOBAL lock. 
+ *
+ * ex) time ./domain -n 4 -i 10000      # single domain 
+ *     time ./domain -n 4 -i 10000 -d   # helper in domain 1 
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */ 
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <dpthread-wrapper.h>
+
+#define NTHR 16
+
+static pthread_mutex_t lock;        // workers' domain 
+static pthread_mutex_t helper_lock; // helper's domain 
+static pthread_mutex_t result_lock; // shared: DET_DOMAIN_GLOBAL 
+
+static int max_thr = 4; 
+static int iteration = 1000; 
+static int use_domain = 0; 
+
+static volatile int sum = 0; 
+static volatile int helper_sum = 0; 
+static volatile int result = 0; 
+
+unsigned long fib(unsigned long n)
+{
+	if (n == 0)
+		return 0;
+	if (n == 1)
+		return 2;
+	return fib(n-1)+fib(n-2);
+}
+
+void *helper(void *v)
+{
+	int i; 
+
+	for ( i = 0; i < 10; i++ ) { 
+		fib(25); 
+		pthread_mutex_lock(&helper_lock); 
+		helper_sum ++; 
+		pthread_mutex_unlock(&helper_lock); 
+	}
+
+	pthread_mutex_lock(&result_lock); 
+	result = helper_sum; 
+	pthread_mutex_unlock(&result_lock); 
+	return NULL; 
+}
+
+void *worker(void *v)
+{
+	int i; 
+
+	for ( i = 0; i < iteration; i++ ) { 
+		fib(5); 
+		pthread_mutex_lock(&lock); 
+		sum ++; 
+		pthread_mutex_unlock(&lock); 
+	}
+	return NULL; 
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t allthr[NTHR], hthr;
+	int i, c; 
+
+	while((c=getopt(argc, argv, "n:i:dh")) != EOF) {
+		switch(c) {
+		case 'n':
+			max_thr = atoi(optarg);
+			if (max_thr > NTHR)
+				errx(1, "no more than %d threads", NTHR);
+			break;
+		case 'i': 
+			iteration = atoi(optarg); 
+			break; 
+		case 'd': 
+			use_domain = 1; 
+			break; 
+		default:
+			printf("domain [-n threads] [-i iteration] [-d]\n"); 
+			return 0; 
+		}
+	}
+
+	pthread_mutex_init(&lock, NULL); 
+	det_lock_init_domain(&result_lock, DET_DOMAIN_GLOBAL); 
+
+	if ( use_domain ) { 
+		det_lock_init_domain(&helper_lock, 1); 
+		det_create_domain(&hthr, NULL, helper, NULL, 1); 
+	} else { 
+		pthread_mutex_init(&helper_lock, NULL); 
+		pthread_create(&hthr, NULL, helper, NULL); 
+	}
+
+	for ( i = 1; i < max_thr; i++ ) 
+		pthread_create(&allthr[i], NULL, worker, NULL); 
+	worker(NULL); 
+	for ( i = 1; i < max_thr; i++ ) 
+		pthread_join(allthr[i], NULL); 
+	pthread_join(hthr, NULL); 
+
+	pthread_mutex_lock(&result_lock); 
+	printf("sum : %d, helper : %d\n", sum, result); 
+	pthread_mutex_unlock(&result_lock); 
+	return 0; 
+}
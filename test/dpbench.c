@@ -0,0 +1,727 @@
+/**
+ * Microbenchmarks of the deterministic primitives against raw pthread.
+ *
+ * Each benchmark runs for 1, 2, 4, ... -n threads and every critical
+ * section (-c) and compute (-w) load it uses, the loads being fib(load)
+ * calls, once with the det_*() calls and once with the pthread calls they
+ * replace. Every point runs -r times, each in a forked process of its own,
+ * so the runs start from a fresh runtime (thread ids of det_create() are
+ * not reused) and the fastest and the median run are reported.
+ *
+ *   lock          det_lock/det_unlock of one mutex shared by all threads
+ *   lock_private  the same on a mutex per thread, i.e. uncontended
+ *   trylock       det_trylock, and det_unlock when it succeeds
+ *   condpp        cond ping-pong between pairs of threads. op = round trip
+ *   bcast         det_cond_broadcast to n-1 waiters, which all wake and ack
+ *   barrier       det_barrier_wait of all threads. op = barrier
+ *   create        det_create and det_join of n threads. op = a thread
+ *   clock         det_get_clock(), against clock_gettime()
+ *
+ * ex) ./dpbench -n 8 -i 10000 -o log.microbench   # .json and .csv
+ *     ./dpbench -b lock,condpp -c 0,5,10,15 -w 0 -p det
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include <dpthread.h>
+
+#define MAX_WORKERS 64
+#define MAX_LOADS   16
+#define MAX_REPEAT  32
+#define MAX_CREATE  (MAX_THR - 8) // det thread ids of a run
+
+#define USES_CS   0x1  // runs for every -c load
+#define USES_WORK 0x2  // runs for every -w load
+
+enum { IMPL_PTHREAD, IMPL_DET };
+static const char *impl_name[] = { "pthread", "det" };
+
+typedef struct {
+	pthread_mutex_t p;
+	det_mutex_t d;
+} bmutex_t;
+
+typedef struct {
+	pthread_cond_t p;
+	det_cond_t d;
+} bcond_t;
+
+typedef struct {
+	pthread_barrier_t p;
+	det_barrier_t d;
+} bbarrier_t;
+
+typedef struct {
+	const char *name;
+	void *(*worker)(void *);
+	int flags;               // USES_*
+	int min_thr;
+} bench_t;
+
+typedef struct {
+	double secs;
+	long ops;
+} run_t;
+
+typedef struct {
+	const char *bench;
+	int impl;
+	int threads, cs, work;
+	int runs;                // successful runs
+	long ops;
+	double best, median;     // nsec per op
+} result_t;
+
+// parameters of the current run
+static int impl;
+static int nthr;
+static int iteration = 10000;
+static int cs_load, work_load;
+static int verbose = 0;
+
+static bmutex_t lock, priv[MAX_WORKERS];
+static bcond_t cond[MAX_WORKERS], done;
+static bbarrier_t start;
+static volatile int turn[MAX_WORKERS];
+static volatile int gen, acks;
+static volatile long sum;
+static volatile unsigned long sink;
+static struct timespec t0, t1;
+static long ops;
+
+unsigned long fib(unsigned long n)
+{
+	if (n == 0)
+		return 0;
+	if (n == 1)
+		return 2;
+	return fib(n-1)+fib(n-2);
+}
+
+///////////////////////////////////////////////////////////////////
+// the two implementations
+///////////////////////////////////////////////////////////////////
+
+static void b_lock_init(bmutex_t *m)
+{
+	if ( impl == IMPL_DET )
+		det_lock_init(&m->d);
+	else
+		pthread_mutex_init(&m->p, NULL);
+}
+
+static void b_lock(bmutex_t *m)
+{
+	if ( impl == IMPL_DET )
+		det_lock(&m->d);
+	else
+		pthread_mutex_lock(&m->p);
+}
+
+static int b_trylock(bmutex_t *m)
+{
+	if ( impl == IMPL_DET )
+		return det_trylock(&m->d);
+	return pthread_mutex_trylock(&m->p);
+}
+
+static void b_unlock(bmutex_t *m)
+{
+	if ( impl == IMPL_DET )
+		det_unlock(&m->d);
+	else
+		pthread_mutex_unlock(&m->p);
+}
+
+static void b_cond_init(bcond_t *c)
+{
+	if ( impl == IMPL_DET )
+		det_cond_init(&c->d);
+	else
+		pthread_cond_init(&c->p, NULL);
+}
+
+static void b_cond_wait(bcond_t *c, bmutex_t *m)
+{
+	if ( impl == IMPL_DET )
+		det_cond_wait(&c->d, &m->d);
+	else
+		pthread_cond_wait(&c->p, &m->p);
+}
+
+static void b_cond_signal(bcond_t *c)
+{
+	if ( impl == IMPL_DET )
+		det_cond_signal(&c->d);
+	else
+		pthread_cond_signal(&c->p);
+}
+
+static void b_cond_broadcast(bcond_t *c)
+{
+	if ( impl == IMPL_DET )
+		det_cond_broadcast(&c->d);
+	else
+		pthread_cond_broadcast(&c->p);
+}
+
+static void b_barrier_init(bbarrier_t *b, int count)
+{
+	if ( impl == IMPL_DET )
+		det_barrier_init(&b->d, count);
+	else
+		pthread_barrier_init(&b->p, NULL, count);
+}
+
+static void b_barrier_wait(bbarrier_t *b)
+{
+	if ( impl == IMPL_DET )
+		det_barrier_wait(&b->d);
+	else
+		pthread_barrier_wait(&b->p);
+}
+
+static void b_create(pthread_t *t, void *(*fn)(void *), void *arg)
+{
+	int ret;
+
+	if ( impl == IMPL_DET )
+		ret = det_create(t, NULL, fn, arg);
+	else
+		ret = pthread_create(t, NULL, fn, arg);
+	if ( ret )
+		errx(1, "thread create failed: %d", ret);
+}
+
+static void b_join(pthread_t t)
+{
+	if ( impl == IMPL_DET )
+		det_join(t, NULL);
+	else
+		pthread_join(t, NULL);
+}
+
+static int64_t b_clock(void)
+{
+	struct timespec ts;
+
+	if ( impl == IMPL_DET )
+		return det_get_clock();
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_nsec;
+}
+
+/**
+ * all threads start and stop the clock together. thread 0 reads it.
+ */
+static void begin(long id)
+{
+	b_barrier_wait(&start);
+	if ( id == 0 )
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+}
+
+static void finish(long id)
+{
+	b_barrier_wait(&start);
+	if ( id == 0 )
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+}
+
+///////////////////////////////////////////////////////////////////
+// benchmarks
+///////////////////////////////////////////////////////////////////
+
+static void *lock_worker(void *v)
+{
+	long id = (long)v;
+	int i;
+
+	begin(id);
+	for ( i = 0; i < iteration; i++ ) {
+		sink += fib(work_load);
+		b_lock(&lock);
+		sink += fib(cs_load);
+		sum ++;
+		b_unlock(&lock);
+	}
+	finish(id);
+	if ( id == 0 )
+		ops = (long)iteration * nthr;
+	return NULL;
+}
+
+static void *lock_private_worker(void *v)
+{
+	long id = (long)v;
+	int i;
+
+	begin(id);
+	for ( i = 0; i < iteration; i++ ) {
+		sink += fib(work_load);
+		b_lock(&priv[id]);
+		sink += fib(cs_load);
+		b_unlock(&priv[id]);
+	}
+	finish(id);
+	if ( id == 0 ) {
+		ops = (long)iteration * nthr;
+		sum = ops;
+	}
+	return NULL;
+}
+
+static void *trylock_worker(void *v)
+{
+	long id = (long)v;
+	int i;
+
+	begin(id);
+	for ( i = 0; i < iteration; i++ ) {
+		sink += fib(work_load);
+		if ( b_trylock(&lock) == 0 ) {
+			sink += fib(cs_load);
+			sum ++;
+			b_unlock(&lock);
+		}
+	}
+	finish(id);
+	if ( id == 0 ) {
+		ops = (long)iteration * nthr;
+		sum = ops; // any number of them may fail
+	}
+	return NULL;
+}
+
+/**
+ * threads 2k and 2k+1 hand turn[k] back and forth. an odd thread idles.
+ */
+static void *condpp_worker(void *v)
+{
+	long id = (long)v;
+	int k = id / 2, me = id % 2;
+	int i;
+
+	begin(id);
+	if ( id < nthr / 2 * 2 ) {
+		for ( i = 0; i < iteration; i++ ) {
+			b_lock(&priv[k]);
+			while ( turn[k] != me )
+				b_cond_wait(&cond[k], &priv[k]);
+			turn[k] = !me;
+			__sync_fetch_and_add(&sum, me);
+			b_cond_signal(&cond[k]);
+			b_unlock(&priv[k]);
+		}
+	}
+	finish(id);
+	if ( id == 0 ) {
+		ops = (long)iteration * (nthr / 2);
+		sum = sum == ops ? ops : -1;
+	}
+	return NULL;
+}
+
+/**
+ * thread 0 bumps gen and waits until the n-1 others have seen it.
+ */
+static void *bcast_worker(void *v)
+{
+	long id = (long)v;
+	int seen = 0;
+	int i;
+
+	begin(id);
+	for ( i = 0; i < iteration; i++ ) {
+		b_lock(&lock);
+		if ( id == 0 ) {
+			gen ++;
+			acks = 0;
+			b_cond_broadcast(&cond[0]);
+			while ( acks < nthr - 1 )
+				b_cond_wait(&done, &lock);
+		} else {
+			while ( gen == seen )
+				b_cond_wait(&cond[0], &lock);
+			seen = gen;
+			if ( ++acks == nthr - 1 )
+				b_cond_signal(&done);
+			sum ++;
+		}
+		b_unlock(&lock);
+	}
+	finish(id);
+	if ( id == 0 ) {
+		ops = iteration;
+		sum = sum == ops * (nthr - 1) ? ops : -1;
+	}
+	return NULL;
+}
+
+static void *barrier_worker(void *v)
+{
+	long id = (long)v;
+	int i;
+
+	begin(id);
+	for ( i = 0; i < iteration; i++ ) {
+		sink += fib(work_load);
+		b_barrier_wait(&start);
+	}
+	finish(id);
+	if ( id == 0 )
+		sum = ops = iteration;
+	return NULL;
+}
+
+static void *empty_worker(void *v)
+{
+	return v;
+}
+
+/**
+ * thread 0 alone creates n threads and joins them, as often as the det
+ * thread ids last.
+ */
+static void *create_worker(void *v)
+{
+	pthread_t thr[MAX_WORKERS];
+	int rounds = MAX_CREATE / nthr;
+	int i, j;
+
+	if ( rounds > iteration )
+		rounds = iteration;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for ( i = 0; i < rounds; i++ ) {
+		for ( j = 0; j < nthr; j++ )
+			b_create(&thr[j], empty_worker, NULL);
+		for ( j = 0; j < nthr; j++ )
+			b_join(thr[j]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	sum = ops = (long)rounds * nthr;
+	return NULL;
+}
+
+static void *clock_worker(void *v)
+{
+	long id = (long)v;
+	int i;
+
+	begin(id);
+	for ( i = 0; i < iteration; i++ )
+		sink += b_clock();
+	finish(id);
+	if ( id == 0 )
+		sum = ops = (long)iteration * nthr;
+	return NULL;
+}
+
+static bench_t benches[] = {
+	{ "lock",         lock_worker,         USES_CS | USES_WORK, 1 },
+	{ "lock_private", lock_private_worker, USES_CS | USES_WORK, 1 },
+	{ "trylock",      trylock_worker,      USES_CS | USES_WORK, 1 },
+	{ "condpp",       condpp_worker,       0,                   2 },
+	{ "bcast",        bcast_worker,        0,                   2 },
+	{ "barrier",      barrier_worker,      USES_WORK,           1 },
+	{ "create",       create_worker,       0,                   1 },
+	{ "clock",        clock_worker,        0,                   1 },
+};
+#define NR_BENCHES (int)(sizeof(benches) / sizeof(benches[0]))
+
+/**
+ * one run in this process. returns the elapsed time, or a negative time
+ * if the result is wrong.
+ */
+static run_t run(bench_t *b)
+{
+	pthread_t thr[MAX_WORKERS];
+	run_t r;
+	long i;
+
+	b_lock_init(&lock);
+	b_cond_init(&done);
+	for ( i = 0; i < nthr; i++ ) {
+		b_lock_init(&priv[i]);
+		b_cond_init(&cond[i]);
+	}
+	b_barrier_init(&start, nthr);
+
+	if ( b->worker == create_worker ) {
+		create_worker(NULL);
+	} else {
+		for ( i = 1; i < nthr; i++ )
+			b_create(&thr[i], b->worker, (void *)i);
+		b->worker((void *)0);
+		for ( i = 1; i < nthr; i++ )
+			b_join(thr[i]);
+	}
+
+	r.ops = ops;
+	r.secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	if ( sum != ops )
+		r.secs = -1;
+	return r;
+}
+
+/**
+ * fork a process for the run and read its result back.
+ */
+static int run_child(bench_t *b, run_t *r)
+{
+	int fd[2], status, got;
+	pid_t pid;
+
+	if ( pipe(fd) < 0 )
+		err(1, "pipe");
+	fflush(stdout);
+	if ( (pid = fork()) < 0 )
+		err(1, "fork");
+	if ( pid == 0 ) {
+		close(fd[0]);
+		if ( !verbose && !freopen("/dev/null", "w", stderr) )
+			_exit(1);
+		*r = run(b);
+		if ( write(fd[1], r, sizeof(*r)) != sizeof(*r) )
+			_exit(1);
+		exit(0);
+	}
+	close(fd[1]);
+	got = read(fd[0], r, sizeof(*r)) == sizeof(*r);
+	close(fd[0]);
+	if ( waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	     WEXITSTATUS(status) != 0 || !got )
+		return -1;
+	return r->secs >= 0 ? 0 : -1;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int parse_list(const char *arg, int *list, int max)
+{
+	char *s = strdup(arg), *tok, *save;
+	int n = 0;
+
+	for ( tok = strtok_r(s, ",", &save); tok; tok = strtok_r(NULL, ",", &save) ) {
+		if ( n == max )
+			errx(1, "no more than %d values in %s", max, arg);
+		list[n++] = atoi(tok);
+	}
+	free(s);
+	return n;
+}
+
+/**
+ * name is an item of the comma separated list.
+ */
+static int selected(const char *list, const char *name)
+{
+	size_t len = strlen(name);
+	const char *p;
+
+	for ( p = list; p; p = strchr(p, ',') ? strchr(p, ',') + 1 : NULL )
+		if ( !strncmp(p, name, len) && (p[len] == ',' || p[len] == '\0') )
+			return 1;
+	return 0;
+}
+
+static void write_json(const char *path, result_t *res, int nres, int repeat)
+{
+	FILE *fp;
+	int i;
+
+	if ( !(fp = fopen(path, "w")) )
+		err(1, "%s", path);
+	fprintf(fp, "{\"iterations\":%d,\"repeat\":%d,\"cpus\":%ld,\"results\":[\n",
+		iteration, repeat, sysconf(_SC_NPROCESSORS_ONLN));
+	for ( i = 0; i < nres; i++ ) {
+		result_t *r = &res[i];
+
+		fprintf(fp, "%s{\"bench\":\"%s\",\"impl\":\"%s\",\"threads\":%d,"
+			"\"cs\":%d,\"work\":%d,\"runs\":%d,\"ops\":%ld,"
+			"\"ns_per_op\":%.1f,\"ns_per_op_median\":%.1f}",
+			i ? ",\n" : "", r->bench, impl_name[r->impl], r->threads,
+			r->cs, r->work, r->runs, r->ops, r->best, r->median);
+	}
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+}
+
+static void write_csv(const char *path, result_t *res, int nres)
+{
+	FILE *fp;
+	int i;
+
+	if ( !(fp = fopen(path, "w")) )
+		err(1, "%s", path);
+	fprintf(fp, "bench,impl,threads,cs,work,runs,ops,ns_per_op,ns_per_op_median\n");
+	for ( i = 0; i < nres; i++ ) {
+		result_t *r = &res[i];
+
+		fprintf(fp, "%s,%s,%d,%d,%d,%d,%ld,%.1f,%.1f\n", r->bench,
+			impl_name[r->impl], r->threads, r->cs, r->work, r->runs,
+			r->ops, r->best, r->median);
+	}
+	fclose(fp);
+}
+
+static void usage(void)
+{
+	int i;
+
+	printf("dpbench [-n max threads] [-i iteration] [-r repeat] [-b bench,...]\n"
+	       "        [-c cs load,...] [-w work load,...] [-p det|pthread|both]\n"
+	       "        [-o output prefix] [-v]\n"
+	       "-n : threads are swept 1, 2, 4, ... up to this (default: 4)\n"
+	       "-c : fib() loads inside the critical section (default: 0,10)\n"
+	       "-w : fib() loads between the operations (default: 0,10)\n"
+	       "-o : write <prefix>.json and <prefix>.csv\n"
+	       "-v : show the stderr of the runs\n"
+	       "benchmarks:");
+	for ( i = 0; i < NR_BENCHES; i++ )
+		printf(" %s", benches[i].name);
+	printf("\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int cs_list[MAX_LOADS] = { 0, 10 }, work_list[MAX_LOADS] = { 0, 10 };
+	int ncs = 2, nwork = 2;
+	int max_thr = 4, repeat = 3;
+	int impl_lo = IMPL_PTHREAD, impl_hi = IMPL_DET;
+	char *only = NULL, *prefix = NULL, path[256];
+	double ns[MAX_REPEAT], base;
+	result_t *res;
+	int nres = 0, failed = 0;
+	int b, t, c, w, k, i;
+	run_t r;
+
+	while((i=getopt(argc, argv, "n:i:r:b:c:w:p:o:vh")) != EOF) {
+		switch(i) {
+		case 'n':
+			max_thr = atoi(optarg);
+			if (max_thr < 1 || max_thr > MAX_WORKERS)
+				errx(1, "1 to %d threads", MAX_WORKERS);
+			break;
+		case 'i':
+			iteration = atoi(optarg);
+			break;
+		case 'r':
+			repeat = atoi(optarg);
+			if (repeat < 1 || repeat > MAX_REPEAT)
+				errx(1, "1 to %d repeats", MAX_REPEAT);
+			break;
+		case 'b':
+			only = optarg;
+			break;
+		case 'c':
+			ncs = parse_list(optarg, cs_list, MAX_LOADS);
+			break;
+		case 'w':
+			nwork = parse_list(optarg, work_list, MAX_LOADS);
+			break;
+		case 'p':
+			if ( !strcmp(optarg, "det") )
+				impl_lo = IMPL_DET;
+			else if ( !strcmp(optarg, "pthread") )
+				impl_hi = IMPL_PTHREAD;
+			else if ( strcmp(optarg, "both") )
+				usage();
+			break;
+		case 'o':
+			prefix = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if ( ncs == 0 || nwork == 0 || iteration < 1 )
+		usage();
+
+	if ( !(res = calloc(NR_BENCHES * 8 * MAX_LOADS * MAX_LOADS * 2, sizeof(*res))) )
+		err(1, NULL);
+
+	printf("%-12s %7s %4s %4s %4s %12s %12s %8s\n", "BENCH", "IMPL",
+	       "THR", "CS", "WORK", "NS/OP", "MEDIAN", "X PTHR");
+	for ( b = 0; b < NR_BENCHES; b++ ) {
+		bench_t *bench = &benches[b];
+
+		if ( only && !selected(only, bench->name) )
+			continue;
+		for ( t = 1; ; t = t * 2 < max_thr ? t * 2 : max_thr ) {
+		for ( c = 0; c < (bench->flags & USES_CS ? ncs : 1); c++ ) {
+		for ( w = 0; w < (bench->flags & USES_WORK ? nwork : 1); w++ ) {
+			base = 0;
+		for ( impl = impl_lo; impl <= impl_hi; impl++ ) {
+			result_t *rs = &res[nres];
+
+			if ( t < bench->min_thr )
+				continue;
+			nthr = t;
+			cs_load = bench->flags & USES_CS ? cs_list[c] : 0;
+			work_load = bench->flags & USES_WORK ? work_list[w] : 0;
+			for ( k = i = 0; k < repeat; k++ ) {
+				if ( run_child(bench, &r) < 0 ) {
+					warnx("%s %s %d threads: run failed",
+					      bench->name, impl_name[impl], t);
+					failed = 1;
+					continue;
+				}
+				rs->ops = r.ops;
+				ns[i++] = r.secs * 1e9 / r.ops;
+			}
+			if ( i == 0 )
+				continue;
+			qsort(ns, i, sizeof(double), cmp_double);
+			rs->bench = bench->name;
+			rs->impl = impl;
+			rs->threads = t;
+			rs->cs = cs_load;
+			rs->work = work_load;
+			rs->runs = i;
+			rs->best = ns[0];
+			rs->median = ns[i / 2];
+			if ( impl == IMPL_PTHREAD )
+				base = rs->best;
+			printf("%-12s %7s %4d %4d %4d %12.1f %12.1f", rs->bench,
+			       impl_name[impl], t, rs->cs, rs->work, rs->best, rs->median);
+			if ( impl == IMPL_DET && impl_lo == IMPL_PTHREAD && base > 0 )
+				printf(" %8.2f", rs->best / base);
+			printf("\n");
+			nres ++;
+		}
+		}
+		}
+		if ( t == max_thr )
+			break;
+		}
+	}
+
+	if ( prefix ) {
+		snprintf(path, sizeof(path), "%s.json", prefix);
+		write_json(path, res, nres, repeat);
+		snprintf(path, sizeof(path), "%s.csv", prefix);
+		write_csv(path, res, nres);
+		printf("wrote %s.json and %s.csv\n", prefix, prefix);
+	}
+	return failed;
+}
@@ -0,0 +1,121 @@
+/**
+ * Lock sets.
+ *
+ * Threads move money between accounts, each protected by its own lock.
+ * A transfer takes the locks of its two or three accounts at once with
+ * det_lock_many(), in whatever order the accounts come, and there is no
+ * deadlock. The total never changes and the balances, and so the
+ * checksum, are the same on every run.
+ *
+ * ex) ./lockmany -n 4 -i 10000 -a 8
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <dpthread-wrapper.h>
+
+#define NTHR 16
+#define MAX_ACC 256
+#define INIT_BALANCE 1000
+
+static pthread_mutex_t acc_lock[MAX_ACC];
+static volatile long balance[MAX_ACC];
+
+static int max_thr = 4;
+static int iteration = 10000;
+static int accounts = 8;
+
+void *worker(void *v)
+{
+	long id = (long)v;
+	unsigned int seed = id * 7 + 1;
+	pthread_mutex_t *set[3];
+	int i, a, b, c, amount;
+
+	for ( i = 0; i < iteration; i++ ) {
+		seed = seed * 1103515245 + 12345;
+		a = (seed >> 8) % accounts;
+		b = (seed >> 16) % accounts;
+		c = (seed >> 4) % accounts;
+		amount = (seed >> 20) % 100;
+
+		set[0] = &acc_lock[a];
+		set[1] = &acc_lock[b];
+		set[2] = &acc_lock[c];
+
+		if ( i % 4 ) {
+			// a -> b. a == b is fine, the set has no duplicates. 
+			det_lock_many(set, 2);
+			balance[a] -= amount;
+			balance[b] += amount;
+			det_unlock_many(set, 2);
+		} else {
+			// a -> b, c. the set is given in a different order. 
+			set[0] = &acc_lock[c];
+			set[2] = &acc_lock[a];
+			det_lock_many(set, 3);
+			balance[a] -= 2 * amount;
+			balance[b] += amount;
+			balance[c] += amount;
+			det_unlock_many(set, 3);
+		}
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t allthr[NTHR];
+	unsigned long checksum = 0;
+	long total = 0;
+	long i;
+	int c;
+
+	while((c=getopt(argc, argv, "n:i:a:h")) != EOF) {
+		switch(c) {
+		case 'n':
+			max_thr = atoi(optarg);
+			if (max_thr > NTHR || max_thr < 1)
+				errx(1, "1 to %d threads", NTHR);
+			break;
+		case 'i':
+			iteration = atoi(optarg);
+			break;
+		case 'a':
+			accounts = atoi(optarg);
+			if (accounts > MAX_ACC || accounts < 1)
+				errx(1, "1 to %d accounts", MAX_ACC);
+			break;
+		default:
+			printf("lockmany [-n threads] [-i iteration] [-a accounts]\n");
+			return 0;
+		}
+	}
+
+	for ( i = 0; i < accounts; i++ ) {
+		pthread_mutex_init(&acc_lock[i], NULL);
+		balance[i] = INIT_BALANCE;
+	}
+
+	for ( i = 1; i < max_thr; i++ )
+		pthread_create(&allthr[i], NULL, worker, (void *)i);
+	worker((void *)0);
+	for ( i = 1; i < max_thr; i++ )
+		pthread_join(allthr[i], NULL);
+
+	for ( i = 0; i < accounts; i++ ) {
+		total += balance[i];
+		checksum = checksum * 31 + balance[i];
+	}
+	printf("total : %ld (expected %ld)\n", total,
+	       (long)accounts * INIT_BALANCE);
+	printf("checksum : %lu\n", checksum);
+	return 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * Process-wide det/native mode switch.
+ *
+ * Threads increment a shared counter under a lock and meet at a barrier
+ * every 100 iterations while thread 0 switches the whole process between
+ * det and native mode every -t iterations. With -t 0 the mode is left to
+ * DPTHREAD_MODE_SIGNAL, e.g. toggled from another shell with kill.
+ *
+ * ex) ./mode -n 4 -i 10000 -t 1000
+ *     DPTHREAD_MODE_SIGNAL=10 ./mode -n 4 -i 1000000 -t 0 &
+ *     kill -USR1 <pid>
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <dpthread-wrapper.h>
+
+#define NTHR 16
+
+static pthread_mutex_t lock;
+static pthread_barrier_t barrier;
+
+static int max_thr = 4;
+static int iteration = 10000;
+static int toggle = 1000;
+
+static volatile int sum = 0;
+static volatile int switches = 0;
+
+unsigned long fib(unsigned long n)
+{
+	if (n == 0)
+		return 0;
+	if (n == 1)
+		return 2;
+	return fib(n-1)+fib(n-2);
+}
+
+void *worker(void *v)
+{
+	long id = (long)v;
+	int i;
+
+	for ( i = 0; i < iteration; i++ ) {
+		fib(5 + id);
+		pthread_mutex_lock(&lock);
+		sum ++;
+		pthread_mutex_unlock(&lock);
+
+		if ( i % 100 == 99 )
+			pthread_barrier_wait(&barrier);
+
+		if ( id == 0 && toggle > 0 && i % toggle == toggle - 1 ) {
+			det_set_mode(det_get_mode() == DET_MODE_DET ?
+				     DET_MODE_NATIVE : DET_MODE_DET);
+			switches ++;
+		}
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t allthr[NTHR];
+	long i;
+	int c;
+
+	while((c=getopt(argc, argv, "n:i:t:h")) != EOF) {
+		switch(c) {
+		case 'n':
+			max_thr = atoi(optarg);
+			if (max_thr > NTHR)
+				errx(1, "no more than %d threads", NTHR);
+			break;
+		case 'i':
+			iteration = atoi(optarg);
+			break;
+		case 't':
+			toggle = atoi(optarg);
+			break;
+		default:
+			printf("mode [-n threads] [-i iteration] [-t toggle period]\n");
+			return 0;
+		}
+	}
+	iteration = iteration / 100 * 100; // barrier every 100 iterations
+
+	pthread_mutex_init(&lock, NULL);
+	pthread_barrier_init(&barrier, NULL, max_thr);
+
+	for ( i = 1; i < max_thr; i++ )
+		pthread_create(&allthr[i], NULL, worker, (void *)i);
+	worker((void *)0);
+	for ( i = 1; i < max_thr; i++ )
+		pthread_join(allthr[i], NULL);
+
+	printf("sum : %d (expected %d), %d switches, %s mode\n",
+	       sum, max_thr * iteration, switches,
+	       det_get_mode() == DET_MODE_DET ? "det" : "native");
+	return 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * Multi-process example.
+ *
+ * Worker processes created by det_fork() append their ids to a log in
+ * shared memory under a process-shared lock and meet at a process-shared
+ * barrier. The log, and hence the checksum, is the same on every run.
+ * DPTHREAD_SHM is set to a private name unless given.
+ *
+ * ex) ./multiproc -n 4 -i 100
+ *     DPTHREAD_SHM=/tmp/dpthread.shm ./multiproc -n 4
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <pthread.h>
+
+#include <dpthread-wrapper.h>
+
+#define MAX_PROC 16
+#define MAX_ITER 1000
+
+struct shared {
+	det_mutex_t lock;
+	det_barrier_t barrier;
+	int pos;
+	int log[MAX_PROC * MAX_ITER];
+	unsigned long checksum;
+};
+
+static struct shared *sh;
+static int max_proc = 4;
+static int iteration = 100;
+
+unsigned long fib(unsigned long n)
+{
+	if (n == 0)
+		return 0;
+	if (n == 1)
+		return 2;
+	return fib(n-1)+fib(n-2);
+}
+
+void worker(int id)
+{
+	int i;
+
+	for ( i = 0; i < iteration; i++ ) {
+		unsigned long val = fib(5 + (id + i) % 8);
+
+		det_lock(&sh->lock);
+		sh->log[sh->pos++] = id;
+		sh->checksum = sh->checksum * 31 + val + id;
+		det_unlock(&sh->lock);
+
+		if ( i % 10 == 9 )
+			det_barrier_wait(&sh->barrier);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	pid_t pid[MAX_PROC];
+	char name[64];
+	int i, c, status;
+
+	while((c=getopt(argc, argv, "n:i:h")) != EOF) {
+		switch(c) {
+		case 'n':
+			max_proc = atoi(optarg);
+			if (max_proc > MAX_PROC)
+				errx(1, "no more than %d processes", MAX_PROC);
+			break;
+		case 'i':
+			iteration = atoi(optarg);
+			if (iteration > MAX_ITER)
+				errx(1, "no more than %d iterations", MAX_ITER);
+			break;
+		default:
+			printf("multiproc [-n processes] [-i iteration]\n");
+			return 0;
+		}
+	}
+	iteration = iteration / 10 * 10; // barrier every 10 iterations
+
+	snprintf(name, sizeof(name), "/dpthread-multiproc.%d", getpid());
+	setenv("DPTHREAD_SHM", name, 0);
+
+	// must be mapped before det_fork()
+	sh = mmap(NULL, sizeof(*sh), PROT_READ|PROT_WRITE,
+		  MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if ( sh == MAP_FAILED )
+		err(1, "mmap");
+
+	det_lock_init_shared(&sh->lock);
+	det_barrier_init_shared(&sh->barrier, max_proc);
+
+	for ( i = 1; i < max_proc; i++ ) {
+		if ( (pid[i] = det_fork()) < 0 )
+			err(1, "det_fork");
+		if ( pid[i] == 0 ) {
+			worker(i);
+			exit(0);
+		}
+	}
+	worker(0);
+	for ( i = 1; i < max_proc; i++ )
+		det_waitpid(pid[i], &status);
+
+	printf("order :");
+	for ( i = 0; i < 20 && i < sh->pos; i++ )
+		printf(" %d", sh->log[i]);
+	printf(" ...\n");
+	printf("checksum : %lu (%d entries)\n", sh->checksum, sh->pos);
+	return 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * Task pool.
+ *
+ * A det_parallel_for() over an array and a batch of det_spawn()ed tasks
+ * of uneven sizes on a det_pool_create()d pool. Each chunk and task
+ * records the thread that ran it; the mapping, and so the checksum, is the
+ * same on every run.
+ *
+ * ex) ./pool -n 4 -s 100000 -g 1000 -t 200
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <dpthread-wrapper.h>
+
+#define NTHR 16
+#define MAX_TASK 4096
+
+static det_pool_t pool;
+
+static int max_thr = 4;
+static long size = 100000;
+static long grain = 1000;
+static int ntasks = 200;
+
+static double *array;
+static int *ran_by;
+static unsigned long result[MAX_TASK];
+static int task_by[MAX_TASK];
+
+unsigned long fib(unsigned long n)
+{
+	if (n < 2)
+		return n;
+	return fib(n-1)+fib(n-2);
+}
+
+static void body(long lo, long hi, void *arg)
+{
+	long i;
+
+	for ( i = lo; i < hi; i++ ) {
+		array[i] = array[i] * 0.5 + i;
+		ran_by[i] = det_get_pid();
+	}
+}
+
+static void task(void *arg)
+{
+	long i = (long)arg;
+
+	result[i] = fib(10 + i % 12);
+	task_by[i] = det_get_pid();
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long checksum = 0;
+	int count[NTHR + 1] = { 0 };
+	long i;
+	int c;
+
+	while((c=getopt(argc, argv, "n:s:g:t:h")) != EOF) {
+		switch(c) {
+		case 'n':
+			max_thr = atoi(optarg);
+			if (max_thr > NTHR || max_thr < 1)
+				errx(1, "1 to %d threads", NTHR);
+			break;
+		case 's':
+			size = atol(optarg);
+			break;
+		case 'g':
+			grain = atol(optarg);
+			break;
+		case 't':
+			ntasks = atoi(optarg);
+			if (ntasks > MAX_TASK || ntasks < 1)
+				errx(1, "1 to %d tasks", MAX_TASK);
+			break;
+		default:
+			printf("pool [-n threads] [-s size] [-g grain] [-t tasks]\n");
+			return 0;
+		}
+	}
+
+	array = calloc(size, sizeof(double));
+	ran_by = calloc(size, sizeof(int));
+
+	det_pool_create(&pool, max_thr);
+
+	det_parallel_for(&pool, 0, size, grain, body, NULL);
+	det_parallel_for(&pool, 0, size, grain, body, NULL);
+
+	for ( i = 0; i < ntasks; i++ )
+		det_spawn(&pool, task, (void *)i);
+	det_sync(&pool);
+
+	det_pool_destroy(&pool);
+
+	for ( i = 0; i < size; i++ ) {
+		checksum = checksum * 31 + ran_by[i];
+		count[ran_by[i] % (NTHR + 1)]++;
+	}
+	for ( i = 0; i < ntasks; i++ )
+		checksum = checksum * 31 + task_by[i] * 7 + result[i];
+	for ( i = 0; i <= NTHR; i++ ) {
+		if ( count[i] )
+			printf("thread %ld : %d elements\n", i, count[i]);
+	}
+	printf("array[size-1] : %f\n", array[size-1]);
+	printf("checksum : %lu\n", checksum);
+	return 0;
+}
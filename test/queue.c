@@ -0,0 +1,193 @@
+/**
+ * Bounded MPMC queue.
+ *
+ * Producers put numbered items and consumers get them, either through a
+ * det_queue_t (default) or through the mutex and two condition variables
+ * of pfscan's PQUEUE (-c). Which consumer gets which item, and so the
+ * checksum, is the same on every run. -b moves the items in batches.
+ * Run it under time(1) to compare items/sec; the wrapped gettimeofday()
+ * runs in logical time.
+ *
+ * ex) time ./queue -n 4 -i 100000 -q 16
+ *     time ./queue -n 4 -i 100000 -q 16 -c
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <err.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <dpthread-wrapper.h>
+
+#define NTHR 16
+#define MAX_BATCH 64
+
+static det_queue_t dq;
+
+// the PQUEUE way 
+static pthread_mutex_t mtx;
+static pthread_cond_t more, less;
+static void **buf;
+static int occupied, nextin, nextout, closed;
+
+static int max_thr = 4;
+static int iteration = 100000;
+static int qsize = 16;
+static int batch = 1;
+static int use_cond = 0;
+
+static unsigned long sums[NTHR];
+static long got[NTHR];
+
+static void cond_put(void *item)
+{
+	pthread_mutex_lock(&mtx);
+	while (occupied >= qsize)
+		pthread_cond_wait(&less, &mtx);
+	buf[nextin++] = item;
+	nextin %= qsize;
+	occupied++;
+	pthread_cond_signal(&more);
+	pthread_mutex_unlock(&mtx);
+}
+
+static int cond_get(void **item)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&mtx);
+	while (occupied <= 0 && !closed)
+		pthread_cond_wait(&more, &mtx);
+	if (occupied > 0) {
+		*item = buf[nextout++];
+		nextout %= qsize;
+		occupied--;
+		ret = 1;
+		pthread_cond_signal(&less);
+	}
+	pthread_mutex_unlock(&mtx);
+	return ret;
+}
+
+void *producer(void *v)
+{
+	long id = (long)v;
+	void *items[MAX_BATCH];
+	long i, j;
+
+	for ( i = 0; i < iteration; i += batch ) {
+		for ( j = 0; j < batch; j++ )
+			items[j] = (void *)(id * iteration + i + j + 1);
+		if ( use_cond ) {
+			for ( j = 0; j < batch; j++ )
+				cond_put(items[j]);
+		} else if ( batch > 1 ) {
+			det_queue_put_batch(&dq, items, batch);
+		} else {
+			det_queue_put(&dq, items[0]);
+		}
+	}
+	return NULL;
+}
+
+void *consumer(void *v)
+{
+	long id = (long)v;
+	void *items[MAX_BATCH];
+	int j, n;
+
+	while ( 1 ) {
+		if ( use_cond )
+			n = cond_get(&items[0]);
+		else
+			n = det_queue_get_batch(&dq, items, batch);
+		if ( n == 0 )
+			break;
+		for ( j = 0; j < n; j++ ) {
+			sums[id] = sums[id] * 31 + (uintptr_t)items[j];
+			got[id]++;
+		}
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t allthr[NTHR];
+	unsigned long checksum = 0;
+	long total = 0;
+	int nprod, i, c;
+
+	while((c=getopt(argc, argv, "n:i:q:b:ch")) != EOF) {
+		switch(c) {
+		case 'n':
+			max_thr = atoi(optarg);
+			if (max_thr > NTHR || max_thr < 3)
+				errx(1, "3 to %d threads", NTHR);
+			break;
+		case 'i':
+			iteration = atoi(optarg);
+			break;
+		case 'q':
+			qsize = atoi(optarg);
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			if (batch > MAX_BATCH || batch < 1)
+				errx(1, "batch 1 to %d", MAX_BATCH);
+			break;
+		case 'c':
+			use_cond = 1;
+			break;
+		default:
+			printf("queue [-n threads] [-i items per producer] "
+			       "[-q queue size] [-b batch] [-c]\n");
+			return 0;
+		}
+	}
+	iteration -= iteration % batch;
+	nprod = max_thr / 2;
+
+	if ( use_cond ) {
+		pthread_mutex_init(&mtx, NULL);
+		pthread_cond_init(&more, NULL);
+		pthread_cond_init(&less, NULL);
+		buf = calloc(qsize, sizeof(void *));
+	} else {
+		det_queue_init(&dq, qsize);
+	}
+
+	// thread 0 waits for the producers, then closes the queue 
+	for ( i = 1; i < max_thr; i++ ) {
+		if ( i <= nprod )
+			pthread_create(&allthr[i], NULL, producer, (void *)(long)i);
+		else
+			pthread_create(&allthr[i], NULL, consumer, (void *)(long)i);
+	}
+	for ( i = 1; i <= nprod; i++ )
+		pthread_join(allthr[i], NULL);
+	if ( use_cond ) {
+		pthread_mutex_lock(&mtx);
+		closed = 1;
+		pthread_cond_broadcast(&more);
+		pthread_mutex_unlock(&mtx);
+	} else {
+		det_queue_close(&dq);
+	}
+	for ( ; i < max_thr; i++ )
+		pthread_join(allthr[i], NULL);
+
+	for ( i = nprod + 1; i < max_thr; i++ ) {
+		printf("consumer %d : %ld items\n", i, got[i]);
+		checksum = checksum * 31 + sums[i];
+		total += got[i];
+	}
+	printf("items : %ld (expected %ld)\n", total, (long)nprod * iteration);
+	printf("checksum : %lu\n", checksum);
+	return 0;
+}
@@ -0,0 +1,124 @@
+/**
+ * Reductions.
+ *
+ * Each thread computes partial sums of doubles of very different
+ * magnitudes, where the order of the additions shows in the low bits,
+ * and reduces them with det_reduce(): a sum of a vector, min and max of
+ * int64s and a custom product. The results are printed bit for bit (%a)
+ * and are the same on every run, in native mode (DPTHREAD_MODE=native)
+ * too.
+ *
+ * ex) ./reduce -n 4 -i 1000
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <err.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <dpthread-wrapper.h>
+
+#define NTHR 16
+#define VLEN 4
+
+static det_reduce_t vsum, lmin, lmax, prod;
+
+static int max_thr = 4;
+static int iteration = 1000;
+
+static double total[VLEN];
+static int64_t least, most;
+static double product;
+
+static void mul(void *inout, const void *in, int len)
+{
+	double *d = inout;
+	const double *s = in;
+	int i;
+
+	for ( i = 0; i < len; i++ )
+		d[i] *= s[i];
+}
+
+void *worker(void *v)
+{
+	long id = (long)v;
+	double part[VLEN], out[VLEN], p, pout;
+	int64_t val, vout;
+	int i, j;
+
+	for ( i = 0; i < iteration; i++ ) {
+		for ( j = 0; j < VLEN; j++ )
+			part[j] = (id + 1) * 1e-9 * (i + j) + ((i + id) % 3 ? 1e9 : 1e-3);
+		det_reduce(&vsum, part, out);
+
+		val = (int64_t)(id * 7919 + i * 104729) % 1000003 - 500000;
+		det_reduce(&lmin, &val, &vout);
+		if ( id == 0 )
+			least = (i == 0 || vout < least) ? vout : least;
+		det_reduce(&lmax, &val, &vout);
+		if ( id == 0 )
+			most = (i == 0 || vout > most) ? vout : most;
+
+		p = 1.0 + 1e-7 * (id + i % 5);
+		det_reduce(&prod, &p, &pout);
+
+		if ( id == 0 ) {
+			for ( j = 0; j < VLEN; j++ )
+				total[j] += out[j];
+			product *= pout;
+		}
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t allthr[NTHR];
+	long i;
+	int c;
+
+	while((c=getopt(argc, argv, "n:i:h")) != EOF) {
+		switch(c) {
+		case 'n':
+			max_thr = atoi(optarg);
+			if (max_thr > NTHR || max_thr < 1)
+				errx(1, "1 to %d threads", NTHR);
+			break;
+		case 'i':
+			iteration = atoi(optarg);
+			break;
+		default:
+			printf("reduce [-n threads] [-i iteration]\n");
+			return 0;
+		}
+	}
+
+	det_reduce_init(&vsum, max_thr, DET_REDUCE_SUM, DET_REDUCE_DOUBLE, VLEN);
+	det_reduce_init(&lmin, max_thr, DET_REDUCE_MIN, DET_REDUCE_INT64, 1);
+	det_reduce_init(&lmax, max_thr, DET_REDUCE_MAX, DET_REDUCE_INT64, 1);
+	det_reduce_init_fn(&prod, max_thr, mul, sizeof(double), 1);
+	product = 1.0;
+
+	for ( i = 1; i < max_thr; i++ )
+		pthread_create(&allthr[i], NULL, worker, (void *)i);
+	worker((void *)0);
+	for ( i = 1; i < max_thr; i++ )
+		pthread_join(allthr[i], NULL);
+
+	for ( i = 0; i < VLEN; i++ )
+		printf("sum[%ld] : %a\n", i, total[i]);
+	printf("min : %lld, max : %lld\n", (long long)least, (long long)most);
+	printf("product : %a\n", product);
+
+	det_reduce_destroy(&vsum);
+	det_reduce_destroy(&lmin);
+	det_reduce_destroy(&lmax);
+	det_reduce_destroy(&prod);
+	return 0;
+}
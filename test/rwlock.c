@@ -0,0 +1,125 @@
+/**
+ * Reader-writer lock scaling.
+ *
+ * Threads look up a shared table under a read lock and update it under a
+ * write lock once every -w operations. With -m the same work is done under
+ * a plain mutex, which serializes the readers. The checksum is the same on
+ * every run.
+ *
+ * ex) time ./rwlock -n 4 -i 10000 -w 100
+ *     time ./rwlock -n 4 -i 10000 -w 100 -m
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <dpthread-wrapper.h>
+
+#define NTHR 16
+#define TABLE_SIZE 1024
+
+static pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t mutex;
+
+static int max_thr = 4;
+static int iteration = 10000;
+static int write_period = 100;
+static int use_mutex = 0;
+
+static unsigned long table[TABLE_SIZE];
+static unsigned long checksum[NTHR];
+
+static unsigned long lookup(int key)
+{
+	unsigned long val = 0;
+	int i;
+
+	for ( i = 0; i < 64; i++ )
+		val += table[(key + i * 17) % TABLE_SIZE];
+	return val;
+}
+
+void *worker(void *v)
+{
+	long id = (long)v;
+	int i;
+
+	for ( i = 0; i < iteration; i++ ) {
+		int key = (id * 7919 + i * 31) % TABLE_SIZE;
+
+		if ( i % write_period == write_period - 1 ) {
+			if ( use_mutex )
+				pthread_mutex_lock(&mutex);
+			else
+				pthread_rwlock_wrlock(&rwlock);
+			table[key] = table[key] * 31 + id + 1;
+			checksum[id] = checksum[id] * 31 + table[key];
+		} else {
+			if ( use_mutex )
+				pthread_mutex_lock(&mutex);
+			else
+				pthread_rwlock_rdlock(&rwlock);
+			checksum[id] = checksum[id] * 31 + lookup(key);
+		}
+		if ( use_mutex )
+			pthread_mutex_unlock(&mutex);
+		else
+			pthread_rwlock_unlock(&rwlock);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t allthr[NTHR];
+	unsigned long sum = 0;
+	long i;
+	int c;
+
+	while((c=getopt(argc, argv, "n:i:w:mh")) != EOF) {
+		switch(c) {
+		case 'n':
+			max_thr = atoi(optarg);
+			if (max_thr > NTHR)
+				errx(1, "no more than %d threads", NTHR);
+			break;
+		case 'i':
+			iteration = atoi(optarg);
+			break;
+		case 'w':
+			write_period = atoi(optarg);
+			if (write_period < 1)
+				write_period = 1;
+			break;
+		case 'm':
+			use_mutex = 1;
+			break;
+		default:
+			printf("rwlock [-n threads] [-i iteration] [-w write period] [-m]\n");
+			return 0;
+		}
+	}
+
+	pthread_mutex_init(&mutex, NULL);
+	for ( i = 0; i < TABLE_SIZE; i++ )
+		table[i] = i;
+
+	for ( i = 1; i < max_thr; i++ )
+		pthread_create(&allthr[i], NULL, worker, (void *)i);
+	worker((void *)0);
+	for ( i = 1; i < max_thr; i++ )
+		pthread_join(allthr[i], NULL);
+
+	for ( i = 0; i < max_thr; i++ )
+		sum = sum * 31 + checksum[i];
+	printf("%s: %d threads, 1 write per %d ops\n",
+	       use_mutex ? "mutex" : "rwlock", max_thr, write_period);
+	printf("checksum : %lu\n", sum);
+	return 0;
+}
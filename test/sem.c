@@ -0,0 +1,127 @@
+/**
+ * Semaphores and spinlocks.
+ *
+ * Producers and consumers share a bounded buffer. Free and filled slots
+ * are counted by semaphores (sem_*) and the buffer indices are protected
+ * by a spinlock (pthread_spin_*). Which consumer gets which item, and so
+ * the checksum, is the same on every run.
+ *
+ * ex) ./sem -n 4 -i 10000 -b 8
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include <dpthread-wrapper.h>
+
+#define NTHR 16
+#define MAX_BUF 1024
+
+static sem_t empty, full;
+static pthread_spinlock_t spin;
+
+static int max_thr = 4;     // producers + consumers
+static int iteration = 10000;
+static int buf_size = 8;
+
+static long buffer[MAX_BUF];
+static int head = 0, tail = 0;
+static unsigned long checksum[NTHR];
+
+unsigned long fib(unsigned long n)
+{
+	if (n == 0)
+		return 0;
+	if (n == 1)
+		return 2;
+	return fib(n-1)+fib(n-2);
+}
+
+void *producer(void *v)
+{
+	long id = (long)v;
+	int i;
+
+	for ( i = 0; i < iteration; i++ ) {
+		fib(3 + (id + i) % 6);
+		sem_wait(&empty);
+		pthread_spin_lock(&spin);
+		buffer[tail] = id * iteration + i;
+		tail = (tail + 1) % buf_size;
+		pthread_spin_unlock(&spin);
+		sem_post(&full);
+	}
+	return NULL;
+}
+
+void *consumer(void *v)
+{
+	long id = (long)v;
+	long item;
+	int i;
+
+	for ( i = 0; i < iteration; i++ ) {
+		sem_wait(&full);
+		pthread_spin_lock(&spin);
+		item = buffer[head];
+		head = (head + 1) % buf_size;
+		pthread_spin_unlock(&spin);
+		sem_post(&empty);
+		checksum[id] = checksum[id] * 31 + item;
+		fib(3 + (id + i) % 4);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t allthr[NTHR];
+	unsigned long sum = 0;
+	long i;
+	int c;
+
+	while((c=getopt(argc, argv, "n:i:b:h")) != EOF) {
+		switch(c) {
+		case 'n':
+			max_thr = atoi(optarg);
+			if (max_thr > NTHR || max_thr < 2 || max_thr % 2)
+				errx(1, "even number of threads up to %d", NTHR);
+			break;
+		case 'i':
+			iteration = atoi(optarg);
+			break;
+		case 'b':
+			buf_size = atoi(optarg);
+			if (buf_size > MAX_BUF || buf_size < 1)
+				errx(1, "buffer size 1 to %d", MAX_BUF);
+			break;
+		default:
+			printf("sem [-n threads] [-i iteration] [-b buffer size]\n");
+			return 0;
+		}
+	}
+
+	sem_init(&empty, 0, buf_size);
+	sem_init(&full, 0, 0);
+	pthread_spin_init(&spin, PTHREAD_PROCESS_PRIVATE);
+
+	for ( i = 1; i < max_thr; i++ )
+		pthread_create(&allthr[i], NULL, (i % 2) ? consumer : producer,
+			       (void *)i);
+	producer((void *)0);
+	for ( i = 1; i < max_thr; i++ )
+		pthread_join(allthr[i], NULL);
+
+	for ( i = 1; i < max_thr; i += 2 )
+		sum = sum * 31 + checksum[i];
+	printf("head %d tail %d\n", head, tail);
+	printf("checksum : %lu\n", sum);
+	return 0;
+}
@@ -0,0 +1,122 @@
+/**
+ * Split-phase barrier.
+ *
+ * A 1D stencil: each thread updates its block, arrives at the barrier,
+ * does local work that doesn't need the neighbors (-l), and then waits
+ * for the phase before it reads their boundary values. Threads that
+ * reach the wait after the release do not block. The result and the
+ * clocks at which threads leave the barrier are the same on every run.
+ *
+ * ex) ./splitbar -n 4 -i 200 -s 4096 -l 10
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <dpthread-wrapper.h>
+
+#define NTHR 16
+
+static pthread_barrier_t bar;
+
+static int max_thr = 4;
+static int iteration = 200;
+static int size = 4096;
+static int local_work = 10;
+
+static double *buf[2];
+static unsigned long local_sum[NTHR];
+static unsigned long clock_sum[NTHR];
+
+unsigned long fib(unsigned long n)
+{
+	if (n < 2)
+		return n;
+	return fib(n-1)+fib(n-2);
+}
+
+void *worker(void *v)
+{
+	long id = (long)v;
+	int lo = size * id / max_thr, hi = size * (id + 1) / max_thr;
+	double *cur = buf[0], *next = buf[1], *t;
+	unsigned int token;
+	int i, it;
+
+	for ( it = 0; it < iteration; it++ ) {
+		for ( i = (lo ? lo : 1); i < (hi < size ? hi : size - 1); i++ )
+			next[i] = (cur[i-1] + cur[i] + cur[i+1]) / 3.0;
+		if ( hi == size )
+			next[size-1] = cur[size-1];
+
+		token = det_barrier_arrive(&bar);
+		// independent of the other blocks 
+		local_sum[id] += fib(local_work + (id + it) % 4);
+		det_barrier_wait_token(&bar, token);
+		clock_sum[id] = clock_sum[id] * 31 + det_get_clock();
+
+		t = cur; cur = next; next = t;
+		// cur is read by the neighbors until they arrive here 
+		token = det_barrier_arrive(&bar);
+		det_barrier_wait_token(&bar, token);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t allthr[NTHR];
+	unsigned long checksum = 0;
+	double sum = 0;
+	long i;
+	int c;
+
+	while((c=getopt(argc, argv, "n:i:s:l:h")) != EOF) {
+		switch(c) {
+		case 'n':
+			max_thr = atoi(optarg);
+			if (max_thr > NTHR || max_thr < 1)
+				errx(1, "1 to %d threads", NTHR);
+			break;
+		case 'i':
+			iteration = atoi(optarg);
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		case 'l':
+			local_work = atoi(optarg);
+			break;
+		default:
+			printf("splitbar [-n threads] [-i iteration] [-s size] "
+			       "[-l local work]\n");
+			return 0;
+		}
+	}
+
+	buf[0] = calloc(size, sizeof(double));
+	buf[1] = calloc(size, sizeof(double));
+	for ( i = 0; i < size; i++ )
+		buf[0][i] = (i % 17) * 1.5;
+	pthread_barrier_init(&bar, NULL, max_thr);
+
+	for ( i = 1; i < max_thr; i++ )
+		pthread_create(&allthr[i], NULL, worker, (void *)i);
+	worker((void *)0);
+	for ( i = 1; i < max_thr; i++ )
+		pthread_join(allthr[i], NULL);
+
+	for ( i = 0; i < size; i++ )
+		sum += buf[iteration % 2][i];
+	for ( i = 0; i < max_thr; i++ )
+		checksum = checksum * 31 + local_sum[i] + clock_sum[i];
+	printf("sum : %a\n", sum);
+	printf("checksum : %lu\n", checksum);
+	return 0;
+}
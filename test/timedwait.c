@@ -0,0 +1,183 @@
+/**
+ * Timed waits in logical time.
+ *
+ * Thread 0 waits for items with pthread_cond_timedwait() and a short
+ * timeout while the other threads produce them now and then; it also
+ * polls a semaphore with sem_timedwait() and a lock with
+ * pthread_mutex_timedlock(). The deadlines come from the wrapped
+ * clock_gettime(), so which waits time out, and the checksum, are the same
+ * on every run.
+ *
+ * ex) ./timedwait -n 4 -i 1000 -t 200
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include <dpthread-wrapper.h>
+
+#define NTHR 16
+
+static pthread_mutex_t lock, busy;
+static pthread_cond_t cond;
+static sem_t sem;
+
+static int max_thr = 4;
+static int iteration = 1000;
+static int timeout = 200;   // usec
+
+static volatile int items = 0;
+static volatile int done = 0;
+static int timeouts[3], waits[3];
+static unsigned long checksum = 0;
+
+unsigned long fib(unsigned long n)
+{
+	if (n == 0)
+		return 0;
+	if (n == 1)
+		return 2;
+	return fib(n-1)+fib(n-2);
+}
+
+static void deadline(struct timespec *ts, int usecs)
+{
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_nsec += (long)usecs * 1000;
+	while ( ts->tv_nsec >= 1000000000 ) {
+		ts->tv_sec ++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+void *producer(void *v)
+{
+	long id = (long)v;
+	int i;
+
+	for ( i = 0; i < iteration; i++ ) {
+		fib(8 + (id + i) % 6);
+		pthread_mutex_lock(&lock);
+		items ++;
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&lock);
+		if ( i % 7 == 0 )
+			sem_post(&sem);
+		if ( i % 5 == 0 ) {
+			pthread_mutex_lock(&busy);
+			fib(10);
+			pthread_mutex_unlock(&busy);
+		}
+	}
+	pthread_mutex_lock(&lock);
+	done ++;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+void consumer(void)
+{
+	struct timespec ts;
+	int ret;
+
+	pthread_mutex_lock(&lock);
+	while ( done < max_thr - 1 || items > 0 ) {
+		if ( items > 0 ) {
+			items --;
+			checksum = checksum * 31 + 1;
+			continue;
+		}
+		deadline(&ts, timeout);
+		ret = pthread_cond_timedwait(&cond, &lock, &ts);
+		waits[0] ++;
+		if ( ret == ETIMEDOUT ) {
+			timeouts[0] ++;
+			checksum = checksum * 31 + 2;
+
+			pthread_mutex_unlock(&lock);
+			deadline(&ts, timeout);
+			waits[1] ++;
+			if ( sem_timedwait(&sem, &ts) < 0 && errno == ETIMEDOUT )
+				timeouts[1] ++;
+			else
+				checksum = checksum * 31 + 3;
+
+			deadline(&ts, timeout / 4);
+			waits[2] ++;
+			if ( pthread_mutex_timedlock(&busy, &ts) == ETIMEDOUT ) {
+				timeouts[2] ++;
+			} else {
+				checksum = checksum * 31 + 4;
+				pthread_mutex_unlock(&busy);
+			}
+			pthread_mutex_lock(&lock);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t allthr[NTHR];
+	struct timespec ts;
+	long i;
+	int c;
+
+	while((c=getopt(argc, argv, "n:i:t:h")) != EOF) {
+		switch(c) {
+		case 'n':
+			max_thr = atoi(optarg);
+			if (max_thr > NTHR || max_thr < 2)
+				errx(1, "2 to %d threads", NTHR);
+			break;
+		case 'i':
+			iteration = atoi(optarg);
+			break;
+		case 't':
+			timeout = atoi(optarg);
+			break;
+		default:
+			printf("timedwait [-n threads] [-i iteration] [-t timeout usec]\n");
+			return 0;
+		}
+	}
+
+	pthread_mutex_init(&lock, NULL);
+	pthread_mutex_init(&busy, NULL);
+	pthread_cond_init(&cond, NULL);
+	sem_init(&sem, 0, 0);
+
+	for ( i = 1; i < max_thr; i++ )
+		pthread_create(&allthr[i], NULL, producer, (void *)i);
+	consumer();
+	for ( i = 1; i < max_thr; i++ )
+		pthread_join(allthr[i], NULL);
+
+	// nobody left to signal or post: both must time out. 
+	pthread_mutex_lock(&lock);
+	deadline(&ts, timeout);
+	if ( pthread_cond_timedwait(&cond, &lock, &ts) != ETIMEDOUT )
+		errx(1, "cond_timedwait did not time out");
+	pthread_mutex_unlock(&lock);
+	deadline(&ts, timeout);
+	if ( sem_timedwait(&sem, &ts) == 0 ) // drain leftover posts 
+		while ( sem_timedwait(&sem, &ts) == 0 ); 
+	if ( errno != ETIMEDOUT )
+		errx(1, "sem_timedwait did not time out");
+
+	printf("cond %d/%d, sem %d/%d, lock %d/%d timed out\n",
+	       timeouts[0], waits[0], timeouts[1], waits[1],
+	       timeouts[2], waits[2]);
+	printf("checksum : %lu\n", checksum);
+	return 0;
+}
@@ -0,0 +1,172 @@
+/**
+ * dptop - show the DPTHREAD_TOP status page of a running process
+ *
+ * ex) DPTHREAD_TOP=app ./app &
+ *     dptop app.$!            # refresh every second
+ *     dptop -i 0.2 -n 10 app.1234
+ *
+ * per thread: the logical clock and its rate, sync events and lost turns
+ * per second, what it is blocked at and the thread it waits for, which is
+ * the owner of the mutex, the joined thread, or the thread holding the
+ * minimum clock while it waits for its turn.
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <dpthread-trace.h>
+#include <dpthread-top.h>
+
+#define TRACE_NAME(name, ph, text) #name,
+static const char *op_name[] = { DET_TRACE_OPS(TRACE_NAME) };
+
+static const char *state_name[] = { "-", "running", "blocked", "exited" };
+
+static det_top_page_t *attach(const char *arg, char *name, size_t size)
+{
+	det_top_page_t *page;
+	int fd;
+
+	snprintf(name, size, "%s%s", arg[0] == '/' ? "" : "/", arg);
+	if ( (fd = shm_open(name, O_RDONLY, 0)) < 0 )
+		err(1, "%s", name);
+	page = mmap(NULL, sizeof(*page), PROT_READ, MAP_SHARED, fd, 0);
+	if ( page == MAP_FAILED )
+		err(1, "%s", name);
+	close(fd);
+	if ( memcmp(page->magic, DET_TOP_MAGIC, sizeof(page->magic)) ||
+	     page->size != sizeof(*page) )
+		errx(1, "%s: not a dpthread status page", name);
+	return page;
+}
+
+static void op_text(char *buf, size_t size, int op, int obj)
+{
+	size_t i;
+
+	if ( op < 0 || op >= DET_TRACE_NR_OPS ) {
+		snprintf(buf, size, "?");
+		return;
+	}
+	for ( i = 0; op_name[op][i] && i < size - 1; i++ )
+		buf[i] = tolower(op_name[op][i]);
+	snprintf(buf + i, size - i, "(%d)", obj);
+}
+
+/**
+ * the thread t waits for, or -1.
+ */
+static int waits_for(det_top_page_t *p, det_top_thread_t *t)
+{
+	if ( t->turn )
+		return t->blocker;
+	if ( t->state != DET_TOP_BLOCKED )
+		return -1;
+	switch ( t->wait_op ) {
+	case DET_TRACE_ACQ_ENTER:
+		if ( t->wait_obj > 0 && t->wait_obj < DET_TOP_MAX_MUTEX )
+			return p->mutex_owner[t->wait_obj];
+		return -1;
+	case DET_TRACE_JOIN_ENTER:
+	case DET_TRACE_WAITPID_ENTER:
+		return t->wait_obj;
+	}
+	return -1;
+}
+
+static void show(const char *name, det_top_page_t *p, det_top_page_t *prev,
+		 double secs)
+{
+	det_top_thread_t *t, *o;
+	char wait[64], by[16];
+	double events = 0;
+	int i, w;
+
+	printf("\033[H\033[J%s  pid %d  %s mode  %d threads  last sync clock %lld\n\n",
+	       name, p->pid, p->mode ? "native" : "det", p->max_thr,
+	       (long long)p->last_sync_clock);
+	printf("%4s %4s %-8s %20s %12s %10s %10s  %-24s %s\n", "TID", "DOM",
+	       "STATE", "CLOCK", "CLOCK/s", "EVENTS/s", "RETRY/s", "WAIT", "WAITS FOR");
+	for ( i = 0; i < p->max_thr && i < DET_TOP_MAX_THR; i++ ) {
+		t = &p->thread[i];
+		o = &prev->thread[i];
+		if ( t->state == DET_TOP_FREE )
+			continue;
+		wait[0] = by[0] = '\0';
+		if ( t->turn )
+			snprintf(wait, sizeof(wait), "turn");
+		else if ( t->state == DET_TOP_BLOCKED )
+			op_text(wait, sizeof(wait), t->wait_op, t->wait_obj);
+		if ( (w = waits_for(p, t)) >= 0 )
+			snprintf(by, sizeof(by), "%d", w);
+		printf("%4d %4d %-8s %20lld %12.0f %10.0f %10.0f  %-24s %s\n",
+		       i, t->domain, state_name[t->state <= DET_TOP_EXITED ? t->state : 0],
+		       (long long)t->clock,
+		       t->clock >= o->clock ? (t->clock - o->clock) / secs : 0,
+		       (t->events - o->events) / secs,
+		       (t->retries - o->retries) / secs, wait, by);
+		events += t->events - o->events;
+	}
+	printf("\n%.0f events/s\n", events / secs);
+	fflush(stdout);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: dptop [-i seconds] [-n count] <name>.<pid>\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	det_top_page_t *page, prev, cur;
+	struct timespec ts;
+	double interval = 1.0;
+	char name[256];
+	int count = -1;
+	int c;
+
+	while ( (c = getopt(argc, argv, "i:n:h")) != EOF ) {
+		switch ( c ) {
+		case 'i':
+			interval = atof(optarg);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if ( argc - optind != 1 || interval <= 0 )
+		usage();
+
+	page = attach(argv[optind], name, sizeof(name));
+	memcpy(&prev, page, sizeof(prev));
+	ts.tv_sec = (time_t)interval;
+	ts.tv_nsec = (interval - ts.tv_sec) * 1e9;
+	while ( count < 0 || count-- > 0 ) {
+		nanosleep(&ts, NULL);
+		memcpy(&cur, page, sizeof(cur));
+		show(name, &cur, &prev, interval);
+		prev = cur;
+		if ( kill(cur.pid, 0) < 0 && errno == ESRCH ) {
+			printf("process %d is gone\n", cur.pid);
+			break;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,201 @@
+/**
+ * dptrace - decode DPTHREAD_TRACE files
+ *
+ * ex) dptrace log0.p1.trace              # DPTHREAD_DEBUG=1 text
+ *     dptrace -j log0.p*.trace > t.json  # chrome://tracing or Perfetto
+ *     dptrace -d log0.p1.trace log1.p1.trace  # first sync order difference
+ *
+ * -d compares op, object, argument and logical clock of each record; with
+ * -s the clocks are not compared. exits 1 at a difference.
+ *
+ * This file is distributed under the University of Illinois Open Source
+ * License. See LICENSE.TXT for details.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <err.h>
+#include <unistd.h>
+
+#include <dpthread-trace.h>
+
+#define CONTEXT 3 // records shown before a difference
+
+#define TRACE_NAME(name, ph, text) #name,
+#define TRACE_PHASE(name, ph, text) ph,
+#define TRACE_TEXT(name, ph, text) text,
+static const char *op_name[] = { DET_TRACE_OPS(TRACE_NAME) };
+static const char op_phase[] = { DET_TRACE_OPS(TRACE_PHASE) };
+static const char *op_text[] = { DET_TRACE_OPS(TRACE_TEXT) };
+
+typedef struct {
+	const char *path;
+	det_trace_hdr_t hdr;
+	det_trace_rec_t *rec;
+	uint64_t first;          // oldest record in the ring
+} trace_t;
+
+static void load(trace_t *t, const char *path)
+{
+	FILE *fp;
+
+	t->path = path;
+	if ( !(fp = fopen(path, "r")) )
+		err(1, "%s", path);
+	if ( fread(&t->hdr, sizeof(t->hdr), 1, fp) != 1 ||
+	     memcmp(t->hdr.magic, DET_TRACE_MAGIC, sizeof(t->hdr.magic)) ||
+	     t->hdr.rec_size != sizeof(det_trace_rec_t) )
+		errx(1, "%s: not a dpthread trace", path);
+	if ( !(t->rec = calloc(t->hdr.size, sizeof(det_trace_rec_t))) )
+		err(1, "%s", path);
+	if ( fread(t->rec, sizeof(det_trace_rec_t), t->hdr.size, fp) != t->hdr.size )
+		errx(1, "%s: truncated", path);
+	fclose(fp);
+
+	t->first = 0;
+	if ( t->hdr.count > t->hdr.size ) {
+		t->first = t->hdr.count - t->hdr.size;
+		warnx("%s: the first %llu records are lost. raise DPTHREAD_TRACE_SIZE",
+		      path, (unsigned long long)t->first);
+	}
+}
+
+static det_trace_rec_t *rec(trace_t *t, uint64_t i)
+{
+	det_trace_rec_t *r = &t->rec[i & (t->hdr.size - 1)];
+
+	if ( r->op >= DET_TRACE_NR_OPS )
+		errx(1, "%s: bad op %d at record %llu", t->path, r->op,
+		     (unsigned long long)i);
+	return r;
+}
+
+static void print_text(FILE *out, const char *prefix, det_trace_rec_t *r)
+{
+	fprintf(out, "%s[LT:%08lld][%2d]", prefix, (long long)r->clock, r->tid);
+	fprintf(out, op_text[r->op], r->obj, (long long)r->arg);
+}
+
+static void text(trace_t *t)
+{
+	uint64_t i;
+
+	for ( i = t->first; i < t->hdr.count; i++ )
+		print_text(stdout, "", rec(t, i));
+}
+
+/**
+ * chrome trace event format. enter/leave pairs are B/E slices, the rest
+ * instants; time is usec since det_init().
+ */
+static void json(trace_t *t, int n)
+{
+	det_trace_rec_t *r;
+	const char *sep = "";
+	char name[64];
+	uint64_t i;
+	int k, c;
+
+	printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for ( k = 0; k < n; k++ ) {
+		printf("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+		       "\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+		       sep, t[k].hdr.tid, t[k].hdr.tid);
+		sep = ",\n";
+		for ( i = t[k].first; i < t[k].hdr.count; i++ ) {
+			r = rec(&t[k], i);
+			for ( c = 0; op_name[r->op][c] && c < (int)sizeof(name) - 1; c++ )
+				name[c] = tolower(op_name[r->op][c]);
+			name[c] = '\0';
+			printf("%s{\"name\":\"%s\",\"cat\":\"dpthread\",\"ph\":\"%c\","
+			       "\"ts\":%.3f,\"pid\":0,\"tid\":%d,%s"
+			       "\"args\":{\"obj\":%d,\"clock\":%lld,\"arg\":%lld}}",
+			       sep, name, op_phase[r->op],
+			       (r->tsc - t[k].hdr.tsc_base) / t[k].hdr.tsc_per_usec,
+			       r->tid, op_phase[r->op] == 'i' ? "\"s\":\"t\"," : "",
+			       r->obj, (long long)r->clock, (long long)r->arg);
+		}
+	}
+	printf("\n]}\n");
+}
+
+static int same(det_trace_rec_t *a, det_trace_rec_t *b, int sync_only)
+{
+	return a->op == b->op && a->obj == b->obj && a->arg == b->arg &&
+		(sync_only || a->clock == b->clock);
+}
+
+static int diff(trace_t *a, trace_t *b, int sync_only)
+{
+	uint64_t i, j, first = a->first > b->first ? a->first : b->first;
+
+	for ( i = first; i < a->hdr.count && i < b->hdr.count; i++ ) {
+		if ( same(rec(a, i), rec(b, i), sync_only) )
+			continue;
+		printf("%s and %s differ at record %llu\n", a->path, b->path,
+		       (unsigned long long)i);
+		j = i - first > CONTEXT ? i - CONTEXT : first;
+		for ( ; j < i; j++ )
+			print_text(stdout, "  ", rec(a, j));
+		print_text(stdout, "< ", rec(a, i));
+		print_text(stdout, "> ", rec(b, i));
+		return 1;
+	}
+	if ( a->hdr.count != b->hdr.count ) {
+		printf("%s has %llu records, %s has %llu\n",
+		       a->path, (unsigned long long)a->hdr.count,
+		       b->path, (unsigned long long)b->hdr.count);
+		return 1;
+	}
+	return 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: dptrace file\n"
+		"       dptrace -j file...\n"
+		"       dptrace -d [-s] file1 file2\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	trace_t *t;
+	int use_json = 0, use_diff = 0, sync_only = 0;
+	int i, c, n;
+
+	while ( (c = getopt(argc, argv, "jdsh")) != EOF ) {
+		switch ( c ) {
+		case 'j':
+			use_json = 1;
+			break;
+		case 'd':
+			use_diff = 1;
+			break;
+		case 's':
+			sync_only = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	n = argc - optind;
+	if ( n < 1 || (use_diff && n != 2) || (!use_diff && !use_json && n != 1) )
+		usage();
+
+	if ( !(t = calloc(n, sizeof(trace_t))) )
+		err(1, NULL);
+	for ( i = 0; i < n; i++ )
+		load(&t[i], argv[optind + i]);
+
+	if ( use_diff )
+		return diff(&t[0], &t[1], sync_only);
+	if ( use_json )
+		json(t, n);
+	else
+		text(&t[0]);
+	return 0;
+}
@@ -8,13 +8,25 @@ NPROC="$3"
 echo "DBG: $DIR $CMD $NPROC"
 export DPTHREAD_DEBUG=1
 
+# USE_TRACE=1: compare binary traces (DPTHREAD_TRACE) by tools/dptrace 
+# instead of the DPTHREAD_DEBUG text logs. 
+DPTRACE=`cd $(dirname $0); pwd`/tools/dptrace
+
 cd $DIR 
 
 MATCH_MODE="INST_COUNT" # must match exact instruction count 
 # MATCH_MODE="SYNC_ORDER" # only sync order should be matched 
 
+[ "$MATCH_MODE" = "SYNC_ORDER" ] && DPTRACE_OPT="-s"
+
+# USE_FINGERPRINT=1: compare the DPTHREAD_FINGERPRINT hashes only. cheap 
+# enough for full size inputs. 
+FP_FIELD=2
+[ "$MATCH_MODE" = "SYNC_ORDER" ] && FP_FIELD=3
+
 #CMD='./BARNES < input.p$NPROC'
 export DPTHREAD_DEBUG=1
+[ -n "$USE_TRACE" -o -n "$USE_FINGERPRINT" ] && export DPTHREAD_DEBUG=0
 ITER=10
 i=0
 
@@ -34,7 +46,11 @@ error_diff()
     j=$3 
 
     echo $* > err_report.mail
-    diff log$previ.p$j.sync log$i.p$j.sync >> err_report.mail 
+    if [ -n "$USE_TRACE" ]; then 
+	$DPTRACE -d $DPTRACE_OPT log$previ.p$j.trace log$i.p$j.trace >> err_report.mail 
+    else 
+	diff log$previ.p$j.sync log$i.p$j.sync >> err_report.mail 
+    fi 
     if [ ! -z "$EMAIL" ]; then 
 	cat err_report.mail | mail -s "FAIL:dpthread-verify-`date`" $EMAIL
     fi 
@@ -57,11 +73,17 @@ check_vm_randomization
 
 # logging 
 while true; do 
-    DPTHREAD_LOG_FILE="log$i" $CMD || error "Failed to exec" 
+    if [ -n "$USE_FINGERPRINT" ]; then 
+	DPTHREAD_FINGERPRINT="log$i.fp" $CMD || error "Failed to exec" 
+    elif [ -n "$USE_TRACE" ]; then 
+	DPTHREAD_TRACE="log$i" $CMD || error "Failed to exec" 
+    else 
+	DPTHREAD_LOG_FILE="log$i" $CMD || error "Failed to exec" 
+    fi 
 
     # process the log files 
     j=0
-    while true; do 
+    while [ -z "$USE_TRACE" -a -z "$USE_FINGERPRINT" ]; do 
 	if [ "$MATCH_MODE" = "INST_COUNT" ]; then 
 	    grep -v "Thread" log$i.p$j | grep -v "__read_count" | grep -v "STAT" | grep -v "EXIT" | sed "s/\[RT:[0-9]*\]//g" | sed "s/\]([0-9]*,[-]*[0-9]*)/\]/g"> log$i.p$j.sync
 	elif [ "$MATCH_MODE" = "SYNC_ORDER" ]; then 
@@ -72,11 +94,20 @@ while true; do
     done 
     echo "ITERATION $i" 
     # verify with previous 
-    if [ ! -z "$previ" ]; then 
+    if [ ! -z "$previ" -a -n "$USE_FINGERPRINT" ]; then 
+	a=`awk -v f=$FP_FIELD '/^all/ { print $f }' log$previ.fp`
+	b=`awk -v f=$FP_FIELD '/^all/ { print $f }' log$i.fp`
+	echo ">> compare log$previ.fp ($a) vs log$i.fp ($b)" 
+	[ -n "$a" -a "$a" = "$b" ] || error "FAIL at $i th iteration. fingerprint $a vs $b" 
+    elif [ ! -z "$previ" ]; then 
 	j=0
 	while true; do 
 	    echo ">> compare log$previ.p$j vs log$i.p$j" 
-	    diff log$previ.p$j.sync log$i.p$j.sync > /dev/null || error_diff "FAIL at $i th iteration. at proc $j" $i $j 
+	    if [ -n "$USE_TRACE" ]; then 
+		$DPTRACE -d $DPTRACE_OPT log$previ.p$j.trace log$i.p$j.trace > /dev/null || error_diff "FAIL at $i th iteration. at proc $j" $i $j 
+	    else 
+		diff log$previ.p$j.sync log$i.p$j.sync > /dev/null || error_diff "FAIL at $i th iteration. at proc $j" $i $j 
+	    fi 
 	    j=`expr $j + 1`
 	    [ "$j" = "$NPROC" ] && break
 	done 
@@ -89,7 +120,7 @@ while true; do
     [ "$i" = "$ITER" ] && break
 done 
 # cleanup 
-rm log*.sync 
+rm -f log*.sync log*.trace log*.fp 
 
 echo "PASS" 
 